@@ -0,0 +1,73 @@
+/*
+ * Checks the sidebar filter's budget: a trigram_index_query() over 1M
+ * tracked paths should take at most 5 ms.
+ *
+ * Usage: bench_trigram_index.exe [paths]
+ * Builds an index over synthetic paths shaped like a few large source
+ * trees, then times a mix of queries: common trigrams that match most
+ * paths, selective names, typos and short substrings. Each query runs
+ * several times and the fastest run counts, so one scheduling hiccup does
+ * not fail it. Exits with 1 if any query is over budget. Run it through
+ * `make bench-trigram-index`.
+ */
+#include "trigram_index.h"
+#include <gtk/gtk.h>
+#include <stdlib.h>
+
+#define DEFAULT_PATHS 1000000
+#define QUERY_BUDGET_US 5000
+#define QUERY_RUNS 5
+#define MAX_RESULTS 1000  /* what the sidebar asks for */
+
+static const char *const dirs[] = { "src", "include", "lib", "test", "docs", "tools", "node_modules", "build" };
+static const char *const exts[] = { ".c", ".h", ".js", ".ts", ".md", ".txt", ".json", ".py" };
+
+static const char *path_for_id(guint32 id, gpointer user_data) {
+    GPtrArray *paths = user_data;
+    return id < paths->len ? g_ptr_array_index(paths, id) : NULL;
+}
+
+int main(int argc, char *argv[]) {
+    guint n = argc > 1 ? (guint)atoi(argv[1]) : DEFAULT_PATHS;
+    if (n == 0) {
+        g_printerr("Usage: %s [paths]\n", argv[0]);
+        return 1;
+    }
+
+    GPtrArray *paths = g_ptr_array_new_full(n, g_free);
+    for (guint i = 0; i < n; ++i) {
+        gchar *path = g_strdup_printf("/home/user/project%u/%s/module%u/file_%u%s", i % 97,
+                                      dirs[i % G_N_ELEMENTS(dirs)], (i / 7) % 1009, i,
+                                      exts[(i / 3) % G_N_ELEMENTS(exts)]);
+        g_ptr_array_add(paths, path);
+    }
+
+    TrigramIndex *index = trigram_index_new(path_for_id, paths);
+    gint64 start = g_get_monotonic_time();
+    for (guint i = 0; i < n; ++i) trigram_index_add(index, i, g_ptr_array_index(paths, i));
+    g_print("indexed %u paths in %.1f ms\n", n, (g_get_monotonic_time() - start) / 1000.0);
+
+    static const char *const queries[] = {
+        "src", ".js", "/us", "home", "project42", "module7/file_7", "file_123456", "fiel_12345", "mdoule", "c", "js",
+    };
+    int status = 0;
+    for (guint q = 0; q < G_N_ELEMENTS(queries); ++q) {
+        gint64 best = G_MAXINT64;
+        guint found = 0;
+        for (guint run = 0; run < QUERY_RUNS; ++run) {
+            start = g_get_monotonic_time();
+            GArray *ids = trigram_index_query(index, queries[q], MAX_RESULTS);
+            gint64 elapsed = g_get_monotonic_time() - start;
+            found = ids->len;
+            g_array_unref(ids);
+            best = MIN(best, elapsed);
+        }
+        gboolean ok = best <= QUERY_BUDGET_US;
+        if (!ok) status = 1;
+        g_print("%-16s %5u results %8.2f ms  %s\n", queries[q], found, best / 1000.0, ok ? "ok" : "OVER BUDGET");
+    }
+
+    trigram_index_free(index);
+    g_ptr_array_unref(paths);
+    return status;
+}
@@ -0,0 +1,48 @@
+#ifndef BATCH_IO_H
+#define BATCH_IO_H
+
+#include <gtk/gtk.h>
+
+/*
+ * Batched file copies for bulk operations such as restoring a snapshot.
+ *
+ * On Linux, when built with liburing (the Makefile defines HAVE_LIBURING if
+ * pkg-config finds it), the copies are driven through one io_uring. Each
+ * copy is a chain of steps: open the source, unlink the target, create the
+ * target, read and write until the end, close both. The steps of up to
+ * max_in_flight copies are queued together, and each completion queues the
+ * next step of its copy. Thousands of small files then cost a few
+ * io_uring_enter() calls per batch instead of a blocking open/read/write/close
+ * sequence each.
+ *
+ * If io_uring is not compiled in, or the kernel refuses to set up a ring or
+ * lacks one of the operations (openat and unlinkat need Linux 5.11), the
+ * same copies run on the shared scheduler with blocking stdio calls.
+ *
+ * Either way, an existing target is unlinked and recreated, never written
+ * through. That matters when the target is a read-only hard link to a stored
+ * version.
+ */
+
+typedef struct {
+    const char *source;
+    const char *target;
+    gboolean ok;     /* set by batch_io_copy() */
+    int error;       /* errno of the step that failed; ECANCELED if never attempted */
+} BatchIoCopy;
+
+#define BATCH_IO_DEFAULT_IN_FLIGHT 64
+
+/**
+ * Copies every source to its target. The target directories must exist.
+ * Blocks until every copy has finished, so call it from a worker thread.
+ * @param max_in_flight Copies in progress at once; 0 for BATCH_IO_DEFAULT_IN_FLIGHT.
+ * @param cancellable Optional; copies not yet finished when it fires fail with ECANCELED.
+ * @return The number of copies that succeeded.
+ */
+guint batch_io_copy(BatchIoCopy *copies, guint n, guint max_in_flight, GCancellable *cancellable);
+
+/* The backend batch_io_copy() uses on this system: "io_uring" or "threads". */
+const char *batch_io_backend(void);
+
+#endif // BATCH_IO_H
@@ -0,0 +1,57 @@
+#ifndef BINARY_DELTA_H
+#define BINARY_DELTA_H
+
+#include <gtk/gtk.h>
+
+/*
+ * Block-matching delta for binary contents.
+ *
+ * Every BINARY_DELTA_BLOCK-byte block of the source is indexed by a rolling
+ * hash. The target is scanned with the same rolling hash; a verified hit is
+ * extended in both directions and becomes a COPY, and the bytes between
+ * copies become INSERTs. Expected time is linear in both sizes.
+ *
+ * The ops describe which parts of the target changed, and encode into a
+ * compact delta that binary_delta_apply() turns back into the target, for
+ * storing a binary version relative to an earlier one.
+ */
+
+#define BINARY_DELTA_BLOCK 32
+
+typedef enum {
+    BINARY_DELTA_COPY,    /* target[target_offset..+length) = source[source_offset..+length) */
+    BINARY_DELTA_INSERT   /* target[target_offset..+length) is new */
+} BinaryDeltaOpType;
+
+typedef struct {
+    BinaryDeltaOpType type;
+    gsize target_offset;
+    gsize source_offset;  /* COPY only */
+    gsize length;
+} BinaryDeltaOp;
+
+/**
+ * Computes the ops that build target from source, in target order.
+ * @param cancellable Checked every few MiB of target; may be NULL.
+ * @return GArray of BinaryDeltaOp, or NULL if cancelled. Free with g_array_unref().
+ */
+GArray *binary_delta_compute(const guint8 *source, gsize source_len,
+                             const guint8 *target, gsize target_len,
+                             GCancellable *cancellable);
+
+/* Bytes of target covered by INSERT ops. */
+gsize binary_delta_inserted_bytes(GArray *ops);
+
+/**
+ * Serializes ops into a self-contained delta: COPYs as offsets, INSERTs
+ * with their bytes taken from target.
+ */
+GBytes *binary_delta_encode(GArray *ops, const guint8 *target, gsize target_len);
+
+/**
+ * Rebuilds the target from source and an encoded delta.
+ * @return NULL if the delta is malformed or does not fit source.
+ */
+GBytes *binary_delta_apply(const guint8 *source, gsize source_len, GBytes *delta);
+
+#endif // BINARY_DELTA_H
@@ -0,0 +1,21 @@
+#ifndef BLAME_H
+#define BLAME_H
+
+#include <gtk/gtk.h>
+
+/**
+ * Opens an annotate window for a tracked file: every line of its latest
+ * recorded version, labelled with the version that last changed it.
+ *
+ * Origins are found by diffing consecutive versions with the diff engine.
+ * The resulting per-version line-origin maps are cached for the session
+ * (the newest few per file), so after one more record_version only the
+ * new version is diffed against the cached map of its predecessor.
+ * The work runs on a worker thread.
+ *
+ * @param parent        The main window; the annotate window is transient for it.
+ * @param original_path Path of the tracked file.
+ */
+void create_blame_window(GtkWindow *parent, const char *original_path);
+
+#endif // BLAME_H
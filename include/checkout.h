@@ -0,0 +1,52 @@
+#ifndef CHECKOUT_H
+#define CHECKOUT_H
+
+#include <gtk/gtk.h>
+
+/*
+ * Exposing a stored version at another path without copying its bytes.
+ *
+ * Stored versions are whole files in data/versions, so a version can share
+ * its storage with the checked-out file:
+ *
+ *   reflink   a copy-on-write clone (FICLONE on Linux, clonefile() on macOS).
+ *             The result behaves as an independent copy, so it is always
+ *             tried first.
+ *   hardlink  a second name for the stored file. Only when asked for: both
+ *             names are made read-only, since writing through one would
+ *             change the stored version. The stored file keeps mode 0444
+ *             afterwards, so anything copying a version out of the store
+ *             must not carry its permissions over (G_FILE_COPY_TARGET_DEFAULT_PERMS
+ *             for g_file_copy()).
+ *   copy      the contents as materialized by the version cache, used when
+ *             neither is possible (another filesystem, Windows, or a version
+ *             stored inline in the index, see inline_store.h).
+ *
+ * Thread-safe.
+ */
+
+typedef enum {
+    CHECKOUT_FAILED,
+    CHECKOUT_REFLINK,
+    CHECKOUT_HARDLINK,
+    CHECKOUT_COPY
+} CheckoutMethod;
+
+/**
+ * Places a stored version at target_path, replacing whatever is there.
+ * The target's directory must exist.
+ * @param allow_hardlink Whether a read-only hard link is acceptable.
+ * @return How the version was placed, or CHECKOUT_FAILED with error set.
+ */
+CheckoutMethod checkout_version(const char *stored_name, const char *target_path,
+                                gboolean allow_hardlink, GError **error);
+
+/**
+ * Tries only the reflink and hard link steps of checkout_version(), for
+ * callers that copy in bulk themselves (see batch_io.h).
+ * @return CHECKOUT_REFLINK, CHECKOUT_HARDLINK, or CHECKOUT_FAILED if the
+ *         version still has to be copied.
+ */
+CheckoutMethod checkout_link(const char *stored_name, const char *target_path, gboolean allow_hardlink);
+
+#endif // CHECKOUT_H
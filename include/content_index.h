@@ -0,0 +1,44 @@
+#ifndef CONTENT_INDEX_H
+#define CONTENT_INDEX_H
+
+#include <gtk/gtk.h>
+
+/*
+ * Full-text inverted index over the contents of stored versions.
+ *
+ * data/content_index.txt is an append-only log with one line per indexed
+ * version:
+ *
+ *   @id|stored|timestamp|term:count term:count ...
+ *
+ * plus "!|stored" tombstones for deleted versions. It is replayed at startup,
+ * so queries never read data/versions. New versions are tokenized on a worker
+ * thread as soon as the version index reports them. Versions the log does not
+ * know about yet are backfilled the same way, one at a time.
+ *
+ * Terms are runs of ASCII letters, digits and '_' (case-folded) or of
+ * non-ASCII bytes, 2 to 64 bytes long. Binary files and files over 16 MiB
+ * are recorded with no terms.
+ */
+
+typedef struct {
+    const char *stored_name;   /* interned; valid for the whole session */
+    guint32 file_id;
+    char timestamp[16];
+    guint hits;
+} ContentHit;
+
+/* Replays the log, subscribes to version changes and queues the backfill. */
+void content_index_init(void);
+
+/**
+ * Returns the live versions containing every term of text, oldest first,
+ * as a GArray of ContentHit. hits is the smallest occurrence count of any
+ * query term in that version. Free with g_array_unref().
+ */
+GArray *content_index_query(const char *text, guint max_results);
+
+/* Number of versions still waiting to be indexed. */
+guint content_index_pending(void);
+
+#endif // CONTENT_INDEX_H
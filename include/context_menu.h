@@ -23,4 +23,16 @@ void on_widget_right_click(GtkGestureClick *gesture,
                            double y,
                            gpointer user_data);
 
+/**
+ * Opens a file with the platform's default application
+ * (ShellExecute, GAppInfo, then an open/xdg-open fallback).
+ */
+void open_file_path(const char *path);
+
+/**
+ * Opens a stored version's path like open_file_path(). A version stored
+ * inline in the index has no file, so a temporary copy is opened instead.
+ */
+void open_version_path(const char *path);
+
 #endif // CONTEXT_MENU_H
\ No newline at end of file
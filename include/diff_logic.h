@@ -0,0 +1,130 @@
+#ifndef DIFF_LOGIC_H
+#define DIFF_LOGIC_H
+
+#include <gtk/gtk.h>
+
+/*
+ * Diff engine. Inputs are sequences of interned token ids (equal tokens
+ * have equal ids), so comparing two tokens is one integer compare no
+ * matter how long the line or word behind it is.
+ */
+
+typedef enum {
+    DIFF_EQUAL,
+    DIFF_DELETE,   /* tokens a[a_start .. a_start+length) are gone */
+    DIFF_INSERT    /* tokens b[b_start .. b_start+length) are new */
+} DiffOpType;
+
+typedef struct {
+    DiffOpType type;
+    guint a_start;
+    guint b_start;
+    guint length;
+} DiffOp;
+
+/**
+ * Myers O(ND) diff with linear-space middle-snake bisection.
+ * @return A GArray of DiffOp runs covering both inputs in order.
+ *         Free with g_array_unref().
+ */
+GArray *myers_diff(const guint32 *a, guint n, const guint32 *b, guint m);
+
+/* Receives finished runs in order, with how far into a and b they reach. */
+typedef void (*DiffOpFunc)(const DiffOp *ops, guint n_ops, guint a_done, guint b_done, gpointer user_data);
+
+/**
+ * Same diff as myers_diff(), but runs are handed to func as soon as the
+ * recursion settles them, so a caller can show the start of a long diff
+ * while the rest is being computed. Runs never split across calls.
+ * @param cancellable Checked once per edit-distance step; may be NULL.
+ * @return FALSE if cancelled (func may already have seen some runs).
+ */
+gboolean myers_diff_stream(const guint32 *a, guint n, const guint32 *b, guint m,
+                           GCancellable *cancellable, DiffOpFunc func, gpointer user_data);
+
+/* Maps token text to small integer ids. Ids are only meaningful within one interner. */
+typedef struct _DiffInterner DiffInterner;
+
+DiffInterner *diff_interner_new(void);
+void diff_interner_free(DiffInterner *interner);
+guint32 diff_interner_intern(DiffInterner *interner, const char *text, gsize len);
+
+/**
+ * Splits text into lines (the newline stays with its line) and appends one
+ * interned id per line to tokens. If offsets is given it receives the byte
+ * offset of every line start, plus a final entry for the end of the text.
+ */
+void diff_tokenize_lines(DiffInterner *interner, const char *text, gsize len,
+                         GArray *tokens, GArray *offsets);
+
+/* Which differences a line comparison overlooks; flags combine. */
+typedef enum {
+    DIFF_NORMALIZE_NONE        = 0,
+    DIFF_IGNORE_ALL_SPACE      = 1 << 0,  /* spaces, tabs and CRs anywhere */
+    DIFF_IGNORE_TRAILING_SPACE = 1 << 1,  /* blanks at the end of a line */
+    DIFF_IGNORE_CASE           = 1 << 2,  /* ASCII letters only */
+    DIFF_IGNORE_LINE_ENDINGS   = 1 << 3   /* CRLF, LF or none */
+} DiffNormalizeFlags;
+
+/* Appends the byte offset of every line start of text to offsets, plus the end. */
+void diff_line_offsets(const char *text, gsize len, GArray *offsets);
+
+/**
+ * Appends one 64-bit hash per line to hashes, computed over the line as
+ * normalized by flags without copying it. Lines with equal hashes compare
+ * equal under flags. Hashing is the only per-mode pass over the text, so a
+ * caller can keep the hashes of each mode and re-run just the diff.
+ * @param offsets Line starts as produced by diff_line_offsets().
+ */
+void diff_hash_lines(const char *text, GArray *offsets, DiffNormalizeFlags flags, GArray *hashes);
+
+/* How finely changed text is split before it is compared. */
+typedef enum {
+    DIFF_TOKENS_LINES,  /* whole lines, as diff_tokenize_lines() */
+    DIFF_TOKENS_WORDS,  /* runs of non-blank bytes, runs of blanks, newlines */
+    DIFF_TOKENS_CHARS,  /* one UTF-8 character each */
+    DIFF_TOKENS_CODE    /* identifiers and numbers, runs of spaces and tabs,
+                           and every punctuation byte on its own */
+} DiffGranularity;
+
+/**
+ * Splits text into tokens of the given granularity and appends their
+ * interned ids to tokens. Non-ASCII bytes never split a UTF-8 sequence.
+ * offsets works as in diff_tokenize_lines().
+ */
+void diff_tokenize(DiffGranularity granularity, DiffInterner *interner, const char *text, gsize len,
+                   GArray *tokens, GArray *offsets);
+
+/**
+ * Line diff summary of b against a. A deletion directly followed by an
+ * insertion counts as changed lines (as many as both runs share); the rest
+ * are added or removed.
+ */
+void diff_line_stats(const char *a, gsize a_len, const char *b, gsize b_len,
+                     guint *added, guint *removed, guint *changed);
+
+/* A block of lines deleted at a[a_start] and inserted unchanged at b[b_start] */
+typedef struct {
+    guint a_start;
+    guint b_start;
+    guint length;
+} DiffMove;
+
+/**
+ * Finds moved blocks in a finished diff: runs of at least three lines that
+ * ops deletes in one place and inserts unchanged in another. Deleted runs are
+ * indexed by a hash of every three-line window and inserted runs are looked
+ * up window by window, so the pass is linear in the number of lines.
+ * @param ops The DiffOp runs of a against b, as returned by myers_diff().
+ * @return A GArray of DiffMove in b order, each line in at most one move.
+ */
+GArray *diff_find_moves(const guint32 *a, guint n, const guint32 *b, guint m, GArray *ops);
+
+/**
+ * Guesses whether contents are binary from their first 64 KiB: any NUL byte,
+ * or bytes that are not valid UTF-8. Plain ASCII blocks are cleared a word
+ * at a time and only blocks with high bytes go through UTF-8 validation.
+ */
+gboolean diff_is_binary(const char *data, gsize len);
+
+#endif // DIFF_LOGIC_H
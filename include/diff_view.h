@@ -3,6 +3,6 @@
 
 #include <gtk/gtk.h>
 
-void create_diff_window(GtkWindow* parent, const char* file1_path, const char* file2_path, GtkListBoxRow* version_row);
+void create_diff_window(GtkWindow* parent, const char* file1_path, const char* file2_path);
 
 #endif // DIFF_VIEW_H
\ No newline at end of file
@@ -0,0 +1,56 @@
+#ifndef INLINE_STORE_H
+#define INLINE_STORE_H
+
+#include <gtk/gtk.h>
+
+/*
+ * Tiny versions stored inline in a pack file instead of one file each.
+ *
+ * Versions whose contents are at most the inline threshold are appended to
+ * data/inline_versions.pack rather than written to data/versions. Each
+ * record in the pack looks like
+ *
+ *   @stored_name|length\n<length bytes>\0
+ *
+ * The pack is memory-mapped, so reading an inline version costs a hash
+ * lookup and a copy of a few KiB, and no system call. The returned bytes are
+ * followed by a NUL, like every other version content (see version_cache.h).
+ *
+ * The threshold is read from data/storage.ini:
+ *
+ *   [storage]
+ *   inline_max_bytes=4096
+ *
+ * Without it, the threshold is INLINE_STORE_DEFAULT_MAX_BYTES. 0 turns
+ * inlining off. Versions already stored either way stay where they are.
+ *
+ * Deleted versions keep their record until the next start, which rewrites
+ * the pack once dead records make up more than half of it.
+ * inline_store_add() is main-thread only. Lookups are thread-safe.
+ */
+
+#define INLINE_STORE_DEFAULT_MAX_BYTES 4096
+
+/* Maps the pack and reads the threshold. Call after version_index_init(). */
+void inline_store_init(void);
+
+/* Largest contents, in bytes, that record_version stores inline. */
+gsize inline_store_max_bytes(void);
+
+/**
+ * Appends a version's contents to the pack. O(1) plus a remap.
+ * @return FALSE if the record could not be written, or stored_name is
+ *         already in the pack; the caller stores a file instead.
+ */
+gboolean inline_store_add(const char *stored_name, const void *data, gsize len);
+
+/**
+ * Returns a copy of an inline version's contents.
+ * @return A new reference, or NULL if the version is not stored inline.
+ */
+GBytes *inline_store_lookup(const char *stored_name);
+
+/* Whether a version lives in the pack rather than in data/versions. */
+gboolean inline_store_contains(const char *stored_name);
+
+#endif // INLINE_STORE_H
@@ -0,0 +1,46 @@
+#ifndef LIST_ITEMS_H
+#define LIST_ITEMS_H
+
+#include <gtk/gtk.h>
+
+/*
+ * Model items for the two list views. Rows are recycled widgets bound to
+ * these objects, so everything a row or a context-menu action needs lives
+ * here rather than as data on the row widget.
+ */
+
+/* A tracked file in the sidebar */
+#define DELTA_TYPE_FILE_ITEM (delta_file_item_get_type())
+G_DECLARE_FINAL_TYPE(DeltaFileItem, delta_file_item, DELTA, FILE_ITEM, GObject)
+
+DeltaFileItem *delta_file_item_new(const char *path);
+const char *delta_file_item_get_path(DeltaFileItem *self);
+void delta_file_item_set_path(DeltaFileItem *self, const char *path);
+
+/* A recorded version in the versions pane */
+#define DELTA_TYPE_VERSION_ITEM (delta_version_item_get_type())
+G_DECLARE_FINAL_TYPE(DeltaVersionItem, delta_version_item, DELTA, VERSION_ITEM, GObject)
+
+/**
+ * @param stored_name Must outlive the item; catalog names (VersionEntry) are
+ *                    interned for the whole session, so they are not copied.
+ */
+DeltaVersionItem *delta_version_item_new(guint32 file_id, const char *stored_name, const char *timestamp);
+guint32 delta_version_item_get_file_id(DeltaVersionItem *self);
+const char *delta_version_item_get_stored_name(DeltaVersionItem *self);
+const char *delta_version_item_get_timestamp(DeltaVersionItem *self);
+/* Returns data/versions/<stored_name>; free with g_free(). */
+gchar *delta_version_item_dup_path(DeltaVersionItem *self);
+gboolean delta_version_item_get_compare_selected(DeltaVersionItem *self);
+void delta_version_item_set_compare_selected(DeltaVersionItem *self, gboolean selected);
+/* Match count shown by the search panel; 0 elsewhere */
+guint delta_version_item_get_hits(DeltaVersionItem *self);
+void delta_version_item_set_hits(DeltaVersionItem *self, guint hits);
+/* Line changes against the previous version, copied from the catalog; FALSE if not recorded */
+gboolean delta_version_item_get_stats(DeltaVersionItem *self, guint *added, guint *removed, guint *changed);
+void delta_version_item_set_stats(DeltaVersionItem *self, guint added, guint removed, guint changed);
+
+/* Re-binds the row showing item after one of its fields changed. */
+void delta_list_store_refresh(GListStore *store, gpointer item);
+
+#endif // LIST_ITEMS_H
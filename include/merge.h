@@ -0,0 +1,34 @@
+#ifndef MERGE_H
+#define MERGE_H
+
+#include <gtk/gtk.h>
+
+/*
+ * Line-based three-way merge.
+ *
+ * All three texts are tokenized into one interner, so a line has the same
+ * id in every text. Two Myers diffs, base->ours and base->theirs, then
+ * align both sides to the base. A base line matched by both diffs is
+ * stable. Between stable lines, a region changed on one side only takes
+ * that side's lines. A region changed the same way on both sides is taken
+ * once. Anything else is a conflict. Every step compares token ids, so a
+ * merge costs about two diffs.
+ */
+
+/**
+ * Merges the changes base->ours and base->theirs.
+ * Conflicts are written diff3 style:
+ *
+ *   <<<<<<< ours_label / ours lines / ||||||| base / base lines /
+ *   ======= / theirs lines / >>>>>>> theirs_label
+ *
+ * @param conflicts Optional; receives the number of conflict regions.
+ * @return The merged text.
+ */
+GBytes *merge_three_way(const char *base, gsize base_len,
+                        const char *ours, gsize ours_len,
+                        const char *theirs, gsize theirs_len,
+                        const char *ours_label, const char *theirs_label,
+                        guint *conflicts);
+
+#endif // MERGE_H
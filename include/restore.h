@@ -0,0 +1,42 @@
+#ifndef RESTORE_H
+#define RESTORE_H
+
+#include <gtk/gtk.h>
+
+/*
+ * Point-in-time restore of the tracked files.
+ *
+ * For every tracked file the catalog is binary searched for the newest
+ * version recorded at or before the requested time. Those versions are
+ * then written under a target directory, laid out as they are relative
+ * to the deepest directory all the files share. Files that had no version
+ * yet are skipped. The plan is built on the main thread, straight from the
+ * in-memory catalog. The files are reflinked where the filesystem allows it
+ * and, for a linked checkout, hard-linked (see checkout.h). Whatever cannot
+ * be linked is copied in one batch through batch_io.h.
+ */
+
+/* Called on the main thread when a restore ends, cancelled or not. */
+typedef void (*RestoreDoneFunc)(guint restored, guint failed, guint skipped,
+                                const char *target_dir, gpointer user_data);
+
+/**
+ * Turns user input such as "2024-03-01 14:00" into a catalog timestamp.
+ * Separators are ignored. Missing trailing fields mean the end of the
+ * given period, so "2024-03-01" means the end of that day.
+ * @return A newly allocated YYYYMMDDHHMMSS string, or NULL if unparseable.
+ */
+gchar *restore_parse_time(const char *text);
+
+/**
+ * Restores every tracked file as of timestamp into target_dir, which is
+ * created if needed. Existing files there are overwritten.
+ * @param timestamp YYYYMMDDHHMMSS, as returned by restore_parse_time().
+ * @param linked Allow read-only hard links into the store: nearly instant
+ *               and no extra space, for building or testing an old state.
+ * @param cancellable Stops the remaining copies; may be NULL.
+ */
+void restore_snapshot(const char *timestamp, const char *target_dir, gboolean linked,
+                      GCancellable *cancellable, RestoreDoneFunc func, gpointer user_data);
+
+#endif // RESTORE_H
@@ -0,0 +1,15 @@
+#ifndef RESTORE_VIEW_H
+#define RESTORE_VIEW_H
+
+#include <gtk/gtk.h>
+
+/**
+ * Opens the "Restore Snapshot" panel: a point in time and a target
+ * directory, and a button that restores every tracked file as it was at
+ * that time (see restore.h).
+ *
+ * @param parent The main window; the panel is transient for it.
+ */
+void create_restore_window(GtkWindow *parent);
+
+#endif // RESTORE_VIEW_H
@@ -0,0 +1,36 @@
+#ifndef RETENTION_H
+#define RETENTION_H
+
+#include <gtk/gtk.h>
+
+/*
+ * Retention policy and garbage collection of recorded versions.
+ *
+ * Rules are read from data/retention.ini:
+ *
+ *   [retention]
+ *   rules=1d:all;7d:hourly;forever:daily
+ *
+ * Each rule is "age:granularity", youngest first. A version whose age falls
+ * under a rule is kept if it is the newest one in its granularity bucket
+ * (all, minute, hourly, daily, monthly, yearly). Versions older than the
+ * last rule are expired unless that rule is "forever". The newest version
+ * of a file is always kept. Without a rules entry nothing is ever expired.
+ */
+
+/* Called after a GC batch removed versions of original_path. */
+typedef void (*RetentionCollectedFunc)(const char *original_path, gpointer user_data);
+
+/**
+ * Loads the rules and starts the periodic background sweep.
+ * @param func Optional callback so the UI can refresh an affected versions list.
+ */
+void retention_init(RetentionCollectedFunc func, gpointer user_data);
+
+/**
+ * Re-evaluates the rules for one file after a version was recorded and
+ * queues whatever expired. Only that file's history is examined.
+ */
+void retention_note_recorded(const char *original_path);
+
+#endif // RETENTION_H
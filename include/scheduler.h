@@ -0,0 +1,83 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <gtk/gtk.h>
+
+/*
+ * The one worker pool behind all background work.
+ *
+ * A fixed set of threads, one per core, each with a deque per priority.
+ * Work submitted from a worker goes on that worker's own deque. Work
+ * submitted from any other thread goes on a shared queue. An idle worker
+ * takes the most urgent task it can find. It pops its own deque newest
+ * first, then takes from the shared queue, then steals the oldest task of
+ * another worker. A lower priority is only looked at when every higher one
+ * is empty everywhere, so an interactive compare waits behind background
+ * indexing for at most the task a worker is already running.
+ *
+ * Tasks are never interrupted. A task whose GCancellable is cancelled before
+ * it starts is skipped, and a running task is expected to check it.
+ * Completion callbacks run on the GTK main loop.
+ *
+ * Set DELTAC_SCHEDULER_STATS=<seconds> to log scheduler_get_stats()
+ * periodically.
+ */
+
+typedef enum {
+    SCHEDULER_PRIORITY_INTERACTIVE,  /* the user is waiting: compare, merge, annotate */
+    SCHEDULER_PRIORITY_DEFAULT,      /* user-started bulk work: restore, prefetch */
+    SCHEDULER_PRIORITY_BACKGROUND,   /* indexing and housekeeping */
+    SCHEDULER_N_PRIORITIES
+} SchedulerPriority;
+
+/* Runs on a worker thread. */
+typedef void (*SchedulerFunc)(gpointer data, GCancellable *cancellable);
+
+/* Runs on the main loop after func returned, or instead of it if the task
+ * was cancelled before it started. */
+typedef void (*SchedulerDoneFunc)(gpointer data, gboolean cancelled);
+
+/* Called for every index of a scheduler_parallel_for(), on any thread. */
+typedef void (*SchedulerRangeFunc)(guint index, gpointer user_data);
+
+typedef struct {
+    guint threads;
+    guint queued[SCHEDULER_N_PRIORITIES];  /* waiting, per priority */
+    guint running;
+    guint64 completed;
+    guint64 stolen;     /* tasks a worker took from another worker's deque */
+} SchedulerStats;
+
+/* Starts the workers. Called lazily by the other functions; safe to call again. */
+void scheduler_init(void);
+
+/**
+ * Queues func(data, cancellable) on the pool.
+ * @param done Optional; called on the main loop once the task is finished.
+ * @param destroy Optional; frees data after done (or func) has run.
+ * @param cancellable Optional; a task cancelled before it starts is skipped.
+ */
+void scheduler_submit(SchedulerPriority priority, SchedulerFunc func, SchedulerDoneFunc done,
+                      gpointer data, GDestroyNotify destroy, GCancellable *cancellable);
+
+/**
+ * Drop-in for g_task_run_in_thread(): runs func on the pool at the given
+ * priority. The task completes through its own callback as usual. If the
+ * task's cancellable fires before func starts, func is skipped and the task
+ * returns G_IO_ERROR_CANCELLED; once running, func should check it itself.
+ */
+void scheduler_run_task(GTask *task, GTaskThreadFunc func, SchedulerPriority priority);
+
+/**
+ * Calls func for every index in [0, n) across the pool and returns when all
+ * have finished. The calling thread works through indices too, so this is
+ * safe to call from a worker or from the main thread. Other workers help in
+ * chunks of a few indices and requeue in between, so a long range does not
+ * keep them from more urgent tasks.
+ */
+void scheduler_parallel_for(guint n, SchedulerPriority priority, SchedulerRangeFunc func, gpointer user_data);
+
+/* A snapshot of the pool's counters, for instrumentation. */
+void scheduler_get_stats(SchedulerStats *stats);
+
+#endif // SCHEDULER_H
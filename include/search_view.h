@@ -0,0 +1,15 @@
+#ifndef SEARCH_VIEW_H
+#define SEARCH_VIEW_H
+
+#include <gtk/gtk.h>
+
+/**
+ * Opens the "Search Versions" panel: a search entry over the full-text
+ * content index and a list of the versions that contain the query, oldest
+ * first, with their hit counts. Activating a row opens that version.
+ *
+ * @param parent The main window; the panel is transient for it.
+ */
+void create_search_window(GtkWindow *parent);
+
+#endif // SEARCH_VIEW_H
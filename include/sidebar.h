@@ -2,23 +2,44 @@
 #define SIDEBAR_H
 
 #include <gtk/gtk.h>
+#include "list_items.h"
 
 /**
  * Creates the sidebar widget.
  *
  * This function builds a vertical box containing:
- * 1. A browse button at the top.
- * 2. A GtkListBox below it for file names.
+ * 1. A browse button at the top, with a filter box under it.
+ * 2. A GtkListView below it for file names, backed by a GListStore of
+ *    DeltaFileItem. Other modules change it through sidebar_remove_file()
+ *    and sidebar_rename_file().
  *
  * @param parent_window The main GtkWindow, needed to parent the file chooser dialog.
  * @return A GtkWidget pointer to the fully constructed sidebar (a GtkBox).
  */
 GtkWidget *create_sidebar(GtkWindow *parent_window);
 
-/* Clear all children from a container (list box) */
-void clear_list_box_widget(GtkWidget *box_widget);
+/**
+ * Removes a tracked file from the sidebar list and its filter index.
+ * Does not touch the disk or files_index.txt.
+ */
+void sidebar_remove_file(GtkWindow *parent_window, DeltaFileItem *item);
+
+/**
+ * Points a sidebar item at its new path after a rename and re-indexes it
+ * for filtering. Call after version_index_rename_path().
+ */
+void sidebar_rename_file(GtkWindow *parent_window, DeltaFileItem *item, const char *new_path);
+
+/**
+ * Creates the versions list view for the right pane.
+ *
+ * Rows are recycled and bound lazily from a GListStore of DeltaVersionItem,
+ * so only the visible versions ever get widgets. The view and its model are
+ * stored on the window as "versions-list" and "versions-store".
+ */
+GtkWidget *create_versions_view(GtkWindow *parent_window);
 
 /* Populate versions list for an original file path */
-void populate_versions_for_path(GtkWindow *parent, GtkListBox *versions_list, const char *original_path);
+void populate_versions_for_path(GtkWindow *parent, GListStore *versions_store, const char *original_path);
 
 #endif // SIDEBAR_H
@@ -0,0 +1,60 @@
+#ifndef SNAPSHOT_CACHE_H
+#define SNAPSHOT_CACHE_H
+
+#include <gtk/gtk.h>
+
+/*
+ * Unchanged-file detection for record_version.
+ *
+ * For every tracked file the cache remembers the (size, mtime, inode) and
+ * content hash of the file as it was when its newest version was recorded.
+ * A stat match means the file was not touched and nothing is read. On a
+ * mismatch the file is tree-hashed (see tree_hash.h) and only stored if the
+ * root differs; the root is what the version index records as the digest.
+ * The cache lives for the session; on a miss it is seeded from the newest
+ * version's digest in the index.
+ */
+
+typedef struct {
+    guint64 size;
+    gint64 mtime;    /* seconds */
+    guint64 inode;   /* 0 where the platform has none */
+    guint64 hash;           /* tree hash root */
+    guint64 changed_bytes;  /* bytes differing from the newest version; G_MAXUINT64 if unknown */
+} SnapshotStamp;
+
+/*
+ * Checking a tracked file against the stamp of its newest recorded version
+ * takes three steps, so that the hashing stays off the main thread:
+ *
+ *   snapshot_check_begin()   main thread: stats the file, consults the cache
+ *   snapshot_check_run()     any thread: tree-hashes the file if needed
+ *   snapshot_check_finish()  main thread: updates the cache, frees the check
+ */
+typedef struct SnapshotCheck SnapshotCheck;
+
+SnapshotCheck *snapshot_check_begin(const char *path);
+
+/* TRUE if the stat alone showed the file unchanged; run() then does nothing. */
+gboolean snapshot_check_unchanged_by_stat(const SnapshotCheck *check);
+
+void snapshot_check_run(SnapshotCheck *check);
+
+/* The file's stamp so far: stat fields after begin(), the hash after run(). */
+const SnapshotStamp *snapshot_check_stamp(const SnapshotCheck *check);
+
+/* After run(): whether the file differs from the newest version as the cache
+ * knew it at begin(). finish() has the final word. */
+gboolean snapshot_check_changed(const SnapshotCheck *check);
+
+/**
+ * @param stamp Receives the file's current stamp, for snapshot_cache_note_recorded().
+ *              Its hash is 0 if the file could not be read.
+ * @return TRUE if the contents are the same as the newest version.
+ */
+gboolean snapshot_check_finish(SnapshotCheck *check, SnapshotStamp *stamp);
+
+/* Remembers the stamp of a version that was just recorded. */
+void snapshot_cache_note_recorded(const char *path, const char *stored_name, const SnapshotStamp *stamp);
+
+#endif // SNAPSHOT_CACHE_H
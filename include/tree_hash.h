@@ -0,0 +1,53 @@
+#ifndef TREE_HASH_H
+#define TREE_HASH_H
+
+#include <gtk/gtk.h>
+
+/*
+ * Tree-structured content hash.
+ *
+ * A file is cut into TREE_HASH_LEAF_BYTES leaves, each hashed with XXH64
+ * (seeded by its index). Pairs of nodes are hashed into parents until one
+ * node is left, and the root is that node combined with the file size.
+ * Leaves are independent, so large files are hashed across the shared scheduler.
+ * Keeping the tree lets two versions be compared region by region: equal
+ * subtrees are skipped without looking at their leaves.
+ *
+ * This is a fast change detector, not a cryptographic hash.
+ */
+
+#define TREE_HASH_LEAF_BYTES (64 * 1024)
+
+typedef struct {
+    guint64 size;
+    guint64 root;
+    GPtrArray *levels; /* GArray of guint64 per level; levels[0] are the leaves */
+} TreeHash;
+
+typedef struct {
+    guint64 offset;
+    guint64 length;
+} TreeHashRange;
+
+/**
+ * Hashes a file. Files over a few leaves are split across worker threads.
+ * @return NULL if the file could not be read.
+ */
+TreeHash *tree_hash_file(const char *path);
+
+/* Hashes a buffer in the calling thread; the root matches tree_hash_file(). */
+TreeHash *tree_hash_data(const void *data, gsize len);
+
+void tree_hash_free(TreeHash *tree);
+
+/**
+ * Finds the parts of b that differ from a at the same offsets, by walking
+ * both trees from the root and only descending into differing subtrees.
+ * @return GArray of TreeHashRange in b's coordinates, merged and sorted. Free with g_array_unref().
+ */
+GArray *tree_hash_changed_ranges(const TreeHash *a, const TreeHash *b);
+
+/* Plain XXH64 of a buffer. */
+guint64 tree_hash_xxh64(const void *data, gsize len, guint64 seed);
+
+#endif // TREE_HASH_H
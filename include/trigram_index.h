@@ -0,0 +1,48 @@
+#ifndef TRIGRAM_INDEX_H
+#define TRIGRAM_INDEX_H
+
+#include <gtk/gtk.h>
+
+/*
+ * In-memory trigram index over short strings (tracked file paths) keyed by
+ * a caller-chosen id. Every distinct ASCII-case-folded 3-byte window of a
+ * string gets a sorted posting list of ids, so a query only looks at the
+ * ids that share all of its trigrams and ranks that candidate set alone.
+ *
+ * The index does not copy the strings. It reads them back through the
+ * text function given at creation, which must return the current string
+ * for an id.
+ */
+
+typedef struct _TrigramIndex TrigramIndex;
+
+typedef const char *(*TrigramTextFunc)(guint32 id, gpointer user_data);
+
+TrigramIndex *trigram_index_new(TrigramTextFunc text_for_id, gpointer user_data);
+void trigram_index_free(TrigramIndex *index);
+
+/* Indexes text under id. O(trigrams in text); usually appends to each posting list. */
+void trigram_index_add(TrigramIndex *index, guint32 id, const char *text);
+
+/**
+ * Drops id from the postings of text, which must be the string it was added with.
+ * A rename is remove(old text) followed by add(new text).
+ */
+void trigram_index_remove(TrigramIndex *index, guint32 id, const char *text);
+
+/**
+ * Returns up to max_results ids matching query, best first, as a GArray of guint32.
+ *
+ * An id matches when its text holds every trigram of the query. If nothing
+ * does, ids holding at least two thirds of them are returned instead, so a
+ * typo still finds something. Queries shorter than three bytes have no
+ * trigrams and fall back to a substring scan that stops at max_results.
+ * Ranking prefers a hit in the basename, then a contiguous hit anywhere,
+ * then shorter strings. Only the first few thousand matching ids (in id
+ * order) are ranked, so a query that matches most of a large index stays
+ * fast but may miss better matches among the rest. Free the result with
+ * g_array_unref().
+ */
+GArray *trigram_index_query(TrigramIndex *index, const char *query, guint max_results);
+
+#endif // TRIGRAM_INDEX_H
@@ -0,0 +1,56 @@
+#ifndef VERSION_CACHE_H
+#define VERSION_CACHE_H
+
+#include <gtk/gtk.h>
+
+/*
+ * Bounded-memory LRU cache of materialized version contents.
+ *
+ * Every read of a stored version's bytes should go through here: this is
+ * the one place that turns a stored name into contents, so whatever storage
+ * scheme lies behind it is paid for once per cached version. The cache holds
+ * at most VERSION_CACHE_BYTES; versions larger than a quarter of that are
+ * returned without being cached. Contents are always followed by a NUL byte
+ * (not counted in the size), so text can be used as a string. All functions
+ * are thread-safe except version_cache_stored_name_for_path(), which reads
+ * the version index.
+ *
+ * The versions view prefetches the neighbours of the selected row on worker
+ * threads, so stepping through history finds them already loaded.
+ */
+
+#define VERSION_CACHE_BYTES (64 * 1024 * 1024)
+
+/* Subscribes to version removals so deleted versions are evicted. Main thread. */
+void version_cache_init(void);
+
+/**
+ * Returns the contents of a stored version, loading it on a miss.
+ * @return A new reference, or NULL if it could not be read.
+ */
+GBytes *version_cache_get(const char *stored_name);
+
+/**
+ * Like version_cache_get(), but a miss is read without being inserted, so
+ * bulk readers such as a restore do not flush the cache.
+ */
+GBytes *version_cache_get_uncached(const char *stored_name);
+
+/**
+ * Tells whether path is the file of a live stored version. Main thread only;
+ * pass the result on to version_cache_load() on a worker.
+ * @return The version's interned stored name, or NULL for any other path.
+ */
+const char *version_cache_stored_name_for_path(const char *path);
+
+/**
+ * Like version_cache_get() for any file: a stored version goes through the
+ * cache, otherwise path is read directly.
+ * @param stored_name From version_cache_stored_name_for_path(), or NULL.
+ */
+GBytes *version_cache_load(const char *stored_name, const char *path);
+
+/* Starts loading a version on a worker thread unless it is cached or already loading. */
+void version_cache_prefetch(const char *stored_name);
+
+#endif // VERSION_CACHE_H
@@ -0,0 +1,178 @@
+#ifndef VERSION_INDEX_H
+#define VERSION_INDEX_H
+
+#include <gtk/gtk.h>
+
+/*
+ * On-disk indexes under data/:
+ *
+ *   paths_index.txt     path dictionary, "id|path" lines. The last line for
+ *                       an id wins, so a rename is a single append.
+ *   versions_index.txt  one "@id|stored|timestamp|digest|added:removed:changed"
+ *                       line per recorded version, plus "!|stored|timestamp"
+ *                       tombstones. digest is the version's tree hash in hex
+ *                       (see tree_hash.h); the last field counts lines against
+ *                       the previous version. Either may be missing on records
+ *                       written before they existed.
+ *   files_index.txt     one "@id" line per tracked file, plus "!@id" tombstones.
+ *
+ * Logs written before the dictionary existed carried the full path on every
+ * line; they are converted to ids the first time they are loaded.
+ *
+ * Both files are append-only logs: a delete appends a tombstone instead of
+ * rewriting the file. A later tombstone hides every earlier record with the
+ * same key (the stored name for versions, the path for files). Dead lines
+ * are dropped by an incremental compactor that runs from the main loop at
+ * idle priority once enough tombstones have piled up.
+ *
+ * The versions log is replayed once at startup into an in-memory catalog
+ * (file id -> versions sorted by timestamp). Lookups never touch the disk.
+ */
+
+/* Line changes against the previous version, computed at record time.
+ * A changed line is one rewritten in place; added and removed exclude those. */
+typedef struct {
+    guint32 added;
+    guint32 removed;
+    guint32 changed;
+} VersionStats;
+
+/* A live version as held by the in-memory catalog: a small fixed-size record.
+ * stored_name is interned and stays valid for the whole session. */
+typedef struct {
+    guint32 file_id;
+    const char *stored_name;
+    char timestamp[16];   /* YYYYMMDDHHMMSS, local time */
+    guint64 digest;       /* tree hash root of the contents; 0 if unknown */
+    VersionStats stats;   /* valid if has_stats */
+    gboolean has_stats;
+} VersionEntry;
+
+/* Called for every live version of a path, oldest first. */
+typedef void (*VersionIndexFunc)(const char *original_path,
+                                 const char *stored_name,
+                                 const char *timestamp,
+                                 gpointer user_data);
+
+typedef enum {
+    VERSION_INDEX_ADDED,
+    VERSION_INDEX_REMOVED
+} VersionIndexChange;
+
+/* Called after a single catalog change. position is the entry's index in
+ * version_index_get_versions_by_id(entry->file_id): where it now is for
+ * ADDED, where it was for REMOVED. */
+typedef void (*VersionIndexWatchFunc)(VersionIndexChange change,
+                                      const VersionEntry *entry,
+                                      guint position,
+                                      gpointer user_data);
+
+/* Called for every live tracked file, in the order they were added. */
+typedef void (*FilesIndexFunc)(const char *path, gpointer user_data);
+
+/**
+ * Loads both indexes into memory, counts their tombstones and schedules
+ * compaction if needed. Safe to call more than once; only the first call does work.
+ */
+void version_index_init(void);
+
+/**
+ * Appends a version record. O(1): a single line is appended to the log.
+ * @param digest Tree hash root of the stored contents, or 0 if not known.
+ * @param stats  Line changes against the previous version, or NULL if not known.
+ * @return TRUE if the record was written.
+ */
+gboolean version_index_append(const char *original_path, const char *stored_name, const char *timestamp,
+                              guint64 digest, const VersionStats *stats);
+
+/**
+ * Marks a stored version as deleted by appending a tombstone. O(1).
+ * @param stored_name Basename of the file in data/versions.
+ */
+gboolean version_index_remove(const char *stored_name);
+
+/**
+ * Tombstones several stored versions with a single write to the log.
+ * Used by garbage collection so a batch of deletes costs one append.
+ */
+gboolean version_index_remove_batch(const char * const *stored_names, guint n);
+
+/**
+ * Registers a callback for every version appended or removed from now on,
+ * so views can mirror the catalog with in-place inserts and removals.
+ * @return A watch id for version_index_unwatch().
+ */
+guint version_index_watch(VersionIndexWatchFunc func, gpointer user_data);
+void version_index_unwatch(guint watch_id);
+
+/* Calls func for every live version recorded for original_path. */
+void version_index_foreach_for_path(const char *original_path, VersionIndexFunc func, gpointer user_data);
+
+/* Calls func for every live version of every file. */
+void version_index_foreach(VersionIndexFunc func, gpointer user_data);
+
+/**
+ * Returns the catalog's versions of a file as a GArray of VersionEntry,
+ * sorted oldest first. The array belongs to the catalog: do not modify or free it.
+ * @return NULL if the path has no recorded versions.
+ */
+GArray *version_index_get_versions(const char *original_path);
+GArray *version_index_get_versions_by_id(guint32 file_id);
+
+/**
+ * Binary search over a file's versions (as returned by version_index_get_versions)
+ * for the first one recorded at or after timestamp. Two calls bound a time
+ * range: the versions in [from, to) are [lower_bound(from), lower_bound(to)).
+ * @return An index in [0, versions->len].
+ */
+guint version_index_lower_bound(GArray *versions, const char *timestamp);
+
+/**
+ * Finds the version a file had at a point in time: the newest one recorded
+ * at or before timestamp. O(log n) in the file's versions.
+ * @param entry Receives a copy of the catalog entry.
+ * @return FALSE if the file had no version yet.
+ */
+gboolean version_index_version_at(guint32 file_id, const char *timestamp, VersionEntry *entry);
+
+/**
+ * Looks up a live version by its stored name.
+ * @param entry Optional; receives a copy of the catalog entry.
+ * @return FALSE if the name is unknown or was deleted.
+ */
+gboolean version_index_lookup_stored(const char *stored_name, VersionEntry *entry);
+
+/* Returns the stable id of a path, or 0 if it was never seen. */
+guint32 version_index_lookup_path(const char *path);
+
+/* Returns the stable id of a path, adding it to the dictionary if needed. */
+guint32 version_index_intern_path(const char *path);
+
+/* Returns the current path of a file id, or NULL. */
+const char *version_index_path_for_id(guint32 id);
+
+/**
+ * Points a file id at a new path after the file was renamed on disk.
+ * Its versions and its place in the tracked files list follow it; only
+ * one dictionary line is written.
+ * @return FALSE if new_path already has an id of its own (check with
+ *         version_index_lookup_path() before moving the file), or the write failed.
+ */
+gboolean version_index_rename_path(const char *old_path, const char *new_path);
+
+/**
+ * Adds a path to the tracked files list.
+ * @return TRUE if the path was added, FALSE if it was already tracked.
+ */
+gboolean files_index_add(const char *path);
+
+/* Removes a path from the tracked files list by appending a tombstone. */
+gboolean files_index_remove(const char *path);
+
+/* Calls func for every tracked path. */
+void files_index_foreach(FilesIndexFunc func, gpointer user_data);
+
+/* Starts an idle-time compaction of any index whose tombstone ratio is over the threshold. */
+void version_index_maybe_compact(void);
+
+#endif // VERSION_INDEX_H
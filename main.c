@@ -1,6 +1,14 @@
 #include <gtk/gtk.h>
 #include "sidebar.h"
 #include "context_menu.h"
+#include "version_index.h"
+#include "retention.h"
+#include "content_index.h"
+#include "search_view.h"
+#include "restore_view.h"
+#include "version_cache.h"
+#include "scheduler.h"
+#include "inline_store.h"
 #include <stdlib.h> // For _putenv_s on Windows
 // Use a struct to hold application state instead of globals
 typedef struct {
@@ -21,6 +29,16 @@ static gboolean paned_set_cb(gpointer user_data) {
     g_free(d);
     return G_SOURCE_REMOVE;
 }
+/* Opens the point-in-time restore panel */
+static void on_restore_button_clicked(GtkButton *button, gpointer user_data) {
+    create_restore_window(GTK_WINDOW(user_data));
+}
+
+/* Opens the full-text search panel over all stored versions */
+static void on_search_button_clicked(GtkButton *button, gpointer user_data) {
+    create_search_window(GTK_WINDOW(user_data));
+}
+
 // Dark mode callback now uses the AppData struct
 static void on_toggle_button_clicked(GtkButton *button, gpointer user_data) {
     AppData *data = (AppData *)user_data; // Get our data struct
@@ -82,7 +100,14 @@ static void on_activate(GApplication *app, gpointer user_data) {
     // GTK4: Use gtk_box_append and set expand/fill on the child
     gtk_widget_set_hexpand(header_label, TRUE);
     gtk_widget_set_halign(header_label, GTK_ALIGN_FILL);
+    GtkWidget *search_button = gtk_button_new_with_label("Search Versions");
+    g_signal_connect(search_button, "clicked", G_CALLBACK(on_search_button_clicked), window);
+    GtkWidget *restore_button = gtk_button_new_with_label("Restore Snapshot");
+    g_signal_connect(restore_button, "clicked", G_CALLBACK(on_restore_button_clicked), window);
+
     gtk_box_append(GTK_BOX(header_box), header_label);
+    gtk_box_append(GTK_BOX(header_box), search_button);
+    gtk_box_append(GTK_BOX(header_box), restore_button);
     gtk_box_append(GTK_BOX(header_box), toggle_button);
     gtk_box_append(GTK_BOX(main_vbox), header_box);
 
@@ -93,7 +118,14 @@ static void on_activate(GApplication *app, gpointer user_data) {
     gtk_widget_set_valign(main_paned, GTK_ALIGN_FILL);
     gtk_box_append(GTK_BOX(main_vbox), main_paned);
 
-    // 4. Create and add the sidebar
+    // 4. Create the versions view first: the sidebar populates it on selection
+    GtkWidget *versions_list = create_versions_view(GTK_WINDOW(window));
+
+    // 5. Create and add the sidebar
+    // Load the on-disk indexes first; this may also queue an idle compaction
+    version_index_init();
+    // Tiny versions live in a mapped pack; it needs the catalog to tell live records from dead ones
+    inline_store_init();
     // This function must also be GTK4-friendly (as converted in previous steps)
     sidebar = create_sidebar(GTK_WINDOW(window));
     
@@ -105,17 +137,11 @@ static void on_activate(GApplication *app, gpointer user_data) {
     gtk_paned_set_start_child(GTK_PANED(main_paned), sidebar);
     gtk_widget_set_size_request(sidebar, 250, -1);
 
-    // 5. Create the Right Pane (Versions list)
+    // Right pane: the versions list
     GtkWidget *versions_scrolled = gtk_scrolled_window_new();
     gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(versions_scrolled), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
-
-    GtkWidget *versions_list = gtk_list_box_new();
-    gtk_widget_set_name(versions_list, "versions-list");
     gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(versions_scrolled), versions_list);
 
-    // Store the versions list on the window so sidebar can populate it
-    g_object_set_data(G_OBJECT(window), "versions-list", versions_list);
-
     // GTK4: Use gtk_paned_set_end_child
     gtk_paned_set_end_child(GTK_PANED(main_paned), versions_scrolled);
 
@@ -166,6 +192,16 @@ static void on_activate(GApplication *app, gpointer user_data) {
                                                GTK_STYLE_PROVIDER_PRIORITY_USER);
     g_object_unref(cssProvider); // Can unref immediately
 
+    // One worker pool for all background work; started before anything queues on it
+    scheduler_init();
+    // Start background retention / garbage collection once the UI exists.
+    // Collected versions reach the versions view through index change events.
+    retention_init(NULL, NULL);
+    // Replay the content index and start indexing any versions it has not seen
+    content_index_init();
+    // Deleted versions are evicted from the contents cache through the same events
+    version_cache_init();
+
     // 9. Show the window
     // GTK4: No gtk_widget_show_all()
     gtk_window_present(GTK_WINDOW(window));
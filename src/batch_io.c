@@ -0,0 +1,323 @@
+#include "batch_io.h"
+#include "scheduler.h"
+#include <gtk/gtk.h>
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#if defined(__linux__) && defined(HAVE_LIBURING)
+#include <fcntl.h>
+#include <unistd.h>
+#include <liburing.h>
+#define BATCH_IO_URING 1
+#endif
+
+#define COPY_BUFFER_BYTES (32 * 1024)
+#define MAX_IN_FLIGHT 4096
+
+// ---
+// --- Fallback: blocking copies on the scheduler
+// ---
+
+typedef struct {
+    BatchIoCopy *copies;
+    guint first;
+    GCancellable *cancellable;
+} BlockingJob;
+
+/* Returns 0 or an errno value */
+static int copy_blocking(const char *source, const char *target) {
+    FILE *in = g_fopen(source, "rb");
+    if (!in) return errno;
+    /* Replace, never write through: the target may be a read-only link to a stored version */
+    if (g_unlink(target) != 0 && errno != ENOENT) {
+        g_chmod(target, 0644);
+        g_unlink(target);
+    }
+    FILE *out = g_fopen(target, "wb");
+    if (!out) {
+        int err = errno;
+        fclose(in);
+        return err;
+    }
+
+    char *buf = g_malloc(COPY_BUFFER_BYTES);
+    int err = 0;
+    size_t n;
+    while ((n = fread(buf, 1, COPY_BUFFER_BYTES, in)) > 0) {
+        if (fwrite(buf, 1, n, out) != n) {
+            err = errno ? errno : EIO;
+            break;
+        }
+    }
+    if (!err && ferror(in)) err = EIO;
+    if (fclose(out) != 0 && !err) err = errno ? errno : EIO;
+    fclose(in);
+    g_free(buf);
+    if (err) g_unlink(target);
+    return err;
+}
+
+static void copy_one(guint index, gpointer user_data) {
+    BlockingJob *job = user_data;
+    BatchIoCopy *copy = &job->copies[job->first + index];
+    if (g_cancellable_is_cancelled(job->cancellable)) return;
+    copy->error = copy_blocking(copy->source, copy->target);
+    copy->ok = copy->error == 0;
+}
+
+// ---
+// --- io_uring: one chain of steps per copy, many copies in flight
+// ---
+
+#ifdef BATCH_IO_URING
+
+typedef enum {
+    STEP_OPEN_SOURCE,
+    STEP_UNLINK_TARGET,
+    STEP_OPEN_TARGET,
+    STEP_READ,
+    STEP_WRITE,
+    STEP_CLOSE_SOURCE,
+    STEP_CLOSE_TARGET
+} CopyStep;
+
+typedef struct {
+    BatchIoCopy *copy;
+    CopyStep step;
+    int in;
+    int out;
+    guint64 offset;      /* bytes of the file already written */
+    guint32 filled;      /* bytes in buf from the last read */
+    guint32 written;     /* of which written so far */
+    guint8 *buf;
+} CopySlot;
+
+static const int needed_ops[] = {
+    IORING_OP_OPENAT, IORING_OP_UNLINKAT, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_CLOSE
+};
+
+static gboolean ring_supports_copies(struct io_uring *ring) {
+    struct io_uring_probe *probe = io_uring_get_probe_ring(ring);
+    if (!probe) return FALSE;
+    gboolean ok = TRUE;
+    for (guint i = 0; i < G_N_ELEMENTS(needed_ops); ++i) {
+        if (!io_uring_opcode_supported(probe, needed_ops[i])) ok = FALSE;
+    }
+    io_uring_free_probe(probe);
+    return ok;
+}
+
+/* Queues the slot's current step. The ring has a submission entry per slot, so this cannot run out. */
+static void queue_step(struct io_uring *ring, CopySlot *slot) {
+    struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+    switch (slot->step) {
+    case STEP_OPEN_SOURCE:
+        io_uring_prep_openat(sqe, AT_FDCWD, slot->copy->source, O_RDONLY | O_CLOEXEC, 0);
+        break;
+    case STEP_UNLINK_TARGET:
+        io_uring_prep_unlinkat(sqe, AT_FDCWD, slot->copy->target, 0);
+        break;
+    case STEP_OPEN_TARGET:
+        io_uring_prep_openat(sqe, AT_FDCWD, slot->copy->target, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+        break;
+    case STEP_READ:
+        io_uring_prep_read(sqe, slot->in, slot->buf, COPY_BUFFER_BYTES, slot->offset);
+        break;
+    case STEP_WRITE:
+        io_uring_prep_write(sqe, slot->out, slot->buf + slot->written, slot->filled - slot->written,
+                            slot->offset + slot->written);
+        break;
+    case STEP_CLOSE_SOURCE:
+        io_uring_prep_close(sqe, slot->in);
+        break;
+    case STEP_CLOSE_TARGET:
+        io_uring_prep_close(sqe, slot->out);
+        break;
+    }
+    io_uring_sqe_set_data(sqe, slot);
+}
+
+/* Ends a copy early. Cleanup happens in place, since failures are rare. */
+static gboolean fail_slot(CopySlot *slot, int err) {
+    if (slot->in >= 0) close(slot->in);
+    if (slot->out >= 0) {
+        close(slot->out);
+        unlink(slot->copy->target);
+    }
+    slot->in = slot->out = -1;
+    slot->copy->error = err;
+    return TRUE;
+}
+
+/* Applies the result of the slot's step and picks the next one. Returns TRUE when the copy is over. */
+static gboolean advance(CopySlot *slot, int res, GCancellable *cancellable) {
+    if (slot->step < STEP_CLOSE_SOURCE && g_cancellable_is_cancelled(cancellable)) {
+        if (slot->step == STEP_OPEN_SOURCE && res >= 0) slot->in = res;
+        if (slot->step == STEP_OPEN_TARGET && res >= 0) slot->out = res;
+        return fail_slot(slot, ECANCELED);
+    }
+    switch (slot->step) {
+    case STEP_OPEN_SOURCE:
+        if (res < 0) return fail_slot(slot, -res);
+        slot->in = res;
+        slot->step = STEP_UNLINK_TARGET;
+        return FALSE;
+    case STEP_UNLINK_TARGET:
+        if (res < 0 && res != -ENOENT) return fail_slot(slot, -res);
+        slot->step = STEP_OPEN_TARGET;
+        return FALSE;
+    case STEP_OPEN_TARGET:
+        if (res < 0) return fail_slot(slot, -res);
+        slot->out = res;
+        slot->step = STEP_READ;
+        return FALSE;
+    case STEP_READ:
+        if (res < 0) return fail_slot(slot, -res);
+        if (res == 0) {
+            slot->step = STEP_CLOSE_SOURCE;
+        } else {
+            slot->filled = (guint32)res;
+            slot->written = 0;
+            slot->step = STEP_WRITE;
+        }
+        return FALSE;
+    case STEP_WRITE:
+        if (res <= 0) return fail_slot(slot, res < 0 ? -res : EIO);
+        slot->written += (guint32)res;
+        if (slot->written == slot->filled) {
+            slot->offset += slot->filled;
+            slot->step = STEP_READ;
+        }
+        return FALSE;
+    case STEP_CLOSE_SOURCE:
+        slot->in = -1;
+        slot->step = STEP_CLOSE_TARGET;
+        return FALSE;
+    case STEP_CLOSE_TARGET:
+        slot->out = -1;
+        /* A failed close of a written file can mean lost data */
+        if (res < 0) {
+            unlink(slot->copy->target);
+            slot->copy->error = -res;
+        } else {
+            slot->copy->error = 0;
+            slot->copy->ok = TRUE;
+        }
+        return TRUE;
+    }
+    return TRUE;
+}
+
+/* Returns how many copies were handled; the caller finishes the rest another way */
+static guint copy_with_uring(BatchIoCopy *copies, guint n, guint depth, GCancellable *cancellable) {
+    struct io_uring ring;
+    if (io_uring_queue_init(depth, &ring, 0) < 0) return 0;
+    if (!ring_supports_copies(&ring)) {
+        io_uring_queue_exit(&ring);
+        return 0;
+    }
+
+    CopySlot *slots = g_new0(CopySlot, depth);
+    CopySlot **idle = g_new(CopySlot *, depth);
+    guint8 *buffers = g_malloc((gsize)depth * COPY_BUFFER_BYTES);
+    for (guint i = 0; i < depth; ++i) {
+        slots[i].buf = buffers + (gsize)i * COPY_BUFFER_BYTES;
+        idle[i] = &slots[depth - 1 - i];
+    }
+
+    guint n_idle = depth;
+    guint next = 0;
+    guint active = 0;
+    for (;;) {
+        while (n_idle > 0 && next < n && !g_cancellable_is_cancelled(cancellable)) {
+            CopySlot *slot = idle[--n_idle];
+            slot->copy = &copies[next++];
+            slot->step = STEP_OPEN_SOURCE;
+            slot->in = slot->out = -1;
+            slot->offset = 0;
+            queue_step(&ring, slot);
+            active++;
+        }
+        if (active == 0) break;
+
+        int ret = io_uring_submit_and_wait(&ring, 1);
+        if (ret < 0 && ret != -EINTR && ret != -EAGAIN && ret != -EBUSY) {
+            /* The ring is unusable: abandon what is in flight, leave the rest to the caller */
+            g_printerr("batch_io: io_uring_submit_and_wait failed: %s\n", g_strerror(-ret));
+            for (guint i = 0; i < depth; ++i) {
+                if (slots[i].copy && !slots[i].copy->ok && (slots[i].in >= 0 || slots[i].out >= 0))
+                    fail_slot(&slots[i], -ret);
+            }
+            break;
+        }
+
+        struct io_uring_cqe *cqe;
+        unsigned head;
+        unsigned seen = 0;
+        io_uring_for_each_cqe(&ring, head, cqe) {
+            CopySlot *slot = io_uring_cqe_get_data(cqe);
+            if (advance(slot, cqe->res, cancellable)) {
+                slot->copy = NULL;
+                idle[n_idle++] = slot;
+                active--;
+            } else {
+                queue_step(&ring, slot);
+            }
+            seen++;
+        }
+        io_uring_cq_advance(&ring, seen);
+    }
+
+    /* Tears down the ring, waiting for anything still in flight */
+    io_uring_queue_exit(&ring);
+    g_free(buffers);
+    g_free(idle);
+    g_free(slots);
+    return next;
+}
+
+static gpointer probe_uring(gpointer data) {
+    struct io_uring ring;
+    if (io_uring_queue_init(2, &ring, 0) < 0) return GINT_TO_POINTER(FALSE);
+    gboolean ok = ring_supports_copies(&ring);
+    io_uring_queue_exit(&ring);
+    return GINT_TO_POINTER(ok);
+}
+
+#endif
+
+static gboolean uring_available(void) {
+#ifdef BATCH_IO_URING
+    static GOnce once = G_ONCE_INIT;
+    return GPOINTER_TO_INT(g_once(&once, probe_uring, NULL));
+#else
+    return FALSE;
+#endif
+}
+
+const char *batch_io_backend(void) {
+    return uring_available() ? "io_uring" : "threads";
+}
+
+guint batch_io_copy(BatchIoCopy *copies, guint n, guint max_in_flight, GCancellable *cancellable) {
+    for (guint i = 0; i < n; ++i) {
+        copies[i].ok = FALSE;
+        copies[i].error = ECANCELED;
+    }
+    if (max_in_flight == 0) max_in_flight = BATCH_IO_DEFAULT_IN_FLIGHT;
+
+    guint handled = 0;
+#ifdef BATCH_IO_URING
+    if (n > 0 && uring_available())
+        handled = copy_with_uring(copies, n, MIN(MIN(max_in_flight, n), MAX_IN_FLIGHT), cancellable);
+#endif
+    if (handled < n) {
+        BlockingJob job = { copies, handled, cancellable };
+        scheduler_parallel_for(n - handled, SCHEDULER_PRIORITY_DEFAULT, copy_one, &job);
+    }
+
+    guint succeeded = 0;
+    for (guint i = 0; i < n; ++i) succeeded += copies[i].ok;
+    return succeeded;
+}
@@ -0,0 +1,213 @@
+#include "binary_delta.h"
+#include <gtk/gtk.h>
+#include <string.h>
+
+#define HASH_BASE 0x01000193u
+#define CANCEL_CHECK_BYTES (4 * 1024 * 1024)
+#define DELTA_MAGIC "DDLT1"
+
+// ---
+// --- Rolling hash and source block index
+// ---
+
+static guint32 hash_block(const guint8 *p) {
+    guint32 h = 0;
+    for (guint i = 0; i < BINARY_DELTA_BLOCK; ++i) h = h * HASH_BASE + p[i];
+    return h;
+}
+
+/* HASH_BASE^(BLOCK-1), the weight of the byte leaving the window */
+static guint32 outgoing_weight(void) {
+    guint32 w = 1;
+    for (guint i = 0; i < BINARY_DELTA_BLOCK - 1; ++i) w *= HASH_BASE;
+    return w;
+}
+
+/* Open-addressed table of block-aligned source offsets (stored + 1; 0 is empty).
+ * The first block with a given hash wins, so repeated blocks do not pile up. */
+typedef struct {
+    gsize *slots;
+    guint32 *hashes;
+    gsize mask;
+} BlockIndex;
+
+static void block_index_build(BlockIndex *index, const guint8 *source, gsize source_len) {
+    gsize blocks = source_len / BINARY_DELTA_BLOCK;
+    gsize size = 16;
+    while (size < blocks * 2) size <<= 1;
+    index->mask = size - 1;
+    index->slots = g_new0(gsize, size);
+    index->hashes = g_new(guint32, size);
+    for (gsize b = 0; b < blocks; ++b) {
+        guint32 h = hash_block(source + b * BINARY_DELTA_BLOCK);
+        gsize slot = (h * 0x9e3779b1u) & index->mask;
+        while (index->slots[slot] && index->hashes[slot] != h) slot = (slot + 1) & index->mask;
+        if (index->slots[slot]) continue;
+        index->slots[slot] = b * BINARY_DELTA_BLOCK + 1;
+        index->hashes[slot] = h;
+    }
+}
+
+static gboolean block_index_lookup(const BlockIndex *index, guint32 h, gsize *offset) {
+    gsize slot = (h * 0x9e3779b1u) & index->mask;
+    while (index->slots[slot]) {
+        if (index->hashes[slot] == h) {
+            *offset = index->slots[slot] - 1;
+            return TRUE;
+        }
+        slot = (slot + 1) & index->mask;
+    }
+    return FALSE;
+}
+
+// ---
+// --- Delta computation
+// ---
+
+static void push_op(GArray *ops, BinaryDeltaOpType type, gsize target_offset, gsize source_offset, gsize length) {
+    if (length == 0) return;
+    BinaryDeltaOp op = { type, target_offset, source_offset, length };
+    g_array_append_val(ops, op);
+}
+
+GArray *binary_delta_compute(const guint8 *source, gsize source_len,
+                             const guint8 *target, gsize target_len,
+                             GCancellable *cancellable) {
+    GArray *ops = g_array_new(FALSE, FALSE, sizeof(BinaryDeltaOp));
+    if (source_len < BINARY_DELTA_BLOCK || target_len < BINARY_DELTA_BLOCK) {
+        push_op(ops, BINARY_DELTA_INSERT, 0, 0, target_len);
+        return ops;
+    }
+
+    BlockIndex index;
+    block_index_build(&index, source, source_len);
+    const guint32 weight = outgoing_weight();
+
+    gsize literal = 0;      /* start of the bytes not yet covered by an op */
+    gsize pos = 0;
+    gsize next_check = CANCEL_CHECK_BYTES;
+    guint32 h = hash_block(target);
+    while (pos + BINARY_DELTA_BLOCK <= target_len) {
+        if (pos >= next_check) {
+            next_check += CANCEL_CHECK_BYTES;
+            if (cancellable && g_cancellable_is_cancelled(cancellable)) {
+                g_free(index.slots);
+                g_free(index.hashes);
+                g_array_unref(ops);
+                return NULL;
+            }
+        }
+
+        gsize src;
+        if (block_index_lookup(&index, h, &src) &&
+            memcmp(source + src, target + pos, BINARY_DELTA_BLOCK) == 0) {
+            /* Grow the match backwards into the literal run and forwards as far as it goes */
+            gsize start = pos, src_start = src;
+            while (start > literal && src_start > 0 && target[start - 1] == source[src_start - 1]) {
+                start--;
+                src_start--;
+            }
+            gsize end = pos + BINARY_DELTA_BLOCK, src_end = src + BINARY_DELTA_BLOCK;
+            while (end < target_len && src_end < source_len && target[end] == source[src_end]) {
+                end++;
+                src_end++;
+            }
+            push_op(ops, BINARY_DELTA_INSERT, literal, 0, start - literal);
+            push_op(ops, BINARY_DELTA_COPY, start, src_start, end - start);
+            literal = pos = end;
+            if (pos + BINARY_DELTA_BLOCK <= target_len) h = hash_block(target + pos);
+            continue;
+        }
+
+        if (pos + BINARY_DELTA_BLOCK < target_len) {
+            h = (h - target[pos] * weight) * HASH_BASE + target[pos + BINARY_DELTA_BLOCK];
+        }
+        pos++;
+    }
+    push_op(ops, BINARY_DELTA_INSERT, literal, 0, target_len - literal);
+
+    g_free(index.slots);
+    g_free(index.hashes);
+    return ops;
+}
+
+gsize binary_delta_inserted_bytes(GArray *ops) {
+    gsize total = 0;
+    for (guint i = 0; i < ops->len; ++i) {
+        const BinaryDeltaOp *op = &g_array_index(ops, BinaryDeltaOp, i);
+        if (op->type == BINARY_DELTA_INSERT) total += op->length;
+    }
+    return total;
+}
+
+// ---
+// --- Encoding: magic, varint target size, then 'C' src len | 'I' len bytes
+// ---
+
+static void put_varint(GByteArray *out, guint64 v) {
+    while (v >= 0x80) {
+        guint8 b = (guint8)(v | 0x80);
+        g_byte_array_append(out, &b, 1);
+        v >>= 7;
+    }
+    guint8 b = (guint8)v;
+    g_byte_array_append(out, &b, 1);
+}
+
+static gboolean get_varint(const guint8 **p, const guint8 *end, guint64 *v) {
+    *v = 0;
+    for (guint shift = 0; shift < 64; shift += 7) {
+        if (*p >= end) return FALSE;
+        guint8 b = *(*p)++;
+        *v |= (guint64)(b & 0x7f) << shift;
+        if (!(b & 0x80)) return TRUE;
+    }
+    return FALSE;
+}
+
+GBytes *binary_delta_encode(GArray *ops, const guint8 *target, gsize target_len) {
+    GByteArray *out = g_byte_array_new();
+    g_byte_array_append(out, (const guint8 *)DELTA_MAGIC, strlen(DELTA_MAGIC));
+    put_varint(out, target_len);
+    for (guint i = 0; i < ops->len; ++i) {
+        const BinaryDeltaOp *op = &g_array_index(ops, BinaryDeltaOp, i);
+        guint8 tag = op->type == BINARY_DELTA_COPY ? 'C' : 'I';
+        g_byte_array_append(out, &tag, 1);
+        if (op->type == BINARY_DELTA_COPY) put_varint(out, op->source_offset);
+        put_varint(out, op->length);
+        if (op->type == BINARY_DELTA_INSERT) g_byte_array_append(out, target + op->target_offset, op->length);
+    }
+    return g_byte_array_free_to_bytes(out);
+}
+
+GBytes *binary_delta_apply(const guint8 *source, gsize source_len, GBytes *delta) {
+    gsize delta_len;
+    const guint8 *p = g_bytes_get_data(delta, &delta_len);
+    const guint8 *end = p + delta_len;
+    gsize magic_len = strlen(DELTA_MAGIC);
+    guint64 target_len;
+    if (delta_len < magic_len || memcmp(p, DELTA_MAGIC, magic_len) != 0) return NULL;
+    p += magic_len;
+    if (!get_varint(&p, end, &target_len)) return NULL;
+
+    GByteArray *out = g_byte_array_sized_new((guint)MIN(target_len, (guint64)G_MAXUINT));
+    while (p < end) {
+        guint8 tag = *p++;
+        guint64 offset = 0, length;
+        if (tag == 'C' && !get_varint(&p, end, &offset)) break;
+        if ((tag != 'C' && tag != 'I') || !get_varint(&p, end, &length)) break;
+        if (tag == 'C') {
+            if (offset > source_len || length > source_len - offset) break;
+            g_byte_array_append(out, source + offset, (guint)length);
+        } else {
+            if (length > (guint64)(end - p)) break;
+            g_byte_array_append(out, p, (guint)length);
+            p += length;
+        }
+    }
+    if (p != end || out->len != target_len) {
+        g_byte_array_unref(out);
+        return NULL;
+    }
+    return g_byte_array_free_to_bytes(out);
+}
@@ -0,0 +1,277 @@
+#include "blame.h"
+#include "diff_logic.h"
+#include "scheduler.h"
+#include "version_index.h"
+#include "version_cache.h"
+#include <gtk/gtk.h>
+#include <string.h>
+
+/* Line-origin maps kept per file; enough to absorb new records and recent deletes */
+#define BLAME_MAPS_PER_FILE 4
+
+/* stored name (interned by the catalog) -> GArray of const char* origins, one per line */
+static GHashTable *blame_cache = NULL;
+static guint blame_watch = 0;
+
+typedef struct {
+    GtkWidget *window;        /* weak; NULL once the window is closed */
+    guint32 file_id;
+    GPtrArray *stored;        /* versions to replay, oldest first (interned names) */
+    guint base;               /* index in stored of the newest version with a cached map */
+    GArray *base_origins;     /* that cached map, or NULL to start from scratch */
+    GPtrArray *maps;          /* out: a map for each version replayed after the base */
+    gchar *latest_text;       /* out: contents of the newest version */
+    gsize latest_len;
+} BlameJob;
+
+static void blame_job_free(BlameJob *job) {
+    if (job->window) g_object_remove_weak_pointer(G_OBJECT(job->window), (gpointer *)&job->window);
+    g_ptr_array_free(job->stored, TRUE);
+    if (job->base_origins) g_array_unref(job->base_origins);
+    g_ptr_array_free(job->maps, TRUE);
+    g_free(job->latest_text);
+    g_free(job);
+}
+
+/* A delete changes the history of every later version, so their maps go */
+static void on_version_changed(VersionIndexChange change, const VersionEntry *entry, guint position, gpointer user_data) {
+    if (change != VERSION_INDEX_REMOVED) return;
+    g_hash_table_remove(blame_cache, entry->stored_name);
+    GArray *versions = version_index_get_versions_by_id(entry->file_id);
+    for (guint i = position; versions && i < versions->len; ++i) {
+        g_hash_table_remove(blame_cache, g_array_index(versions, VersionEntry, i).stored_name);
+    }
+}
+
+static void blame_init(void) {
+    if (blame_cache) return;
+    blame_cache = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)g_array_unref);
+    blame_watch = version_index_watch(on_version_changed, NULL);
+}
+
+/* Keeps only the newest BLAME_MAPS_PER_FILE maps of a file */
+static void prune_cache(guint32 file_id) {
+    GArray *versions = version_index_get_versions_by_id(file_id);
+    if (!versions || versions->len <= BLAME_MAPS_PER_FILE) return;
+    for (guint i = 0; i < versions->len - BLAME_MAPS_PER_FILE; ++i) {
+        g_hash_table_remove(blame_cache, g_array_index(versions, VersionEntry, i).stored_name);
+    }
+}
+
+/* A private NUL-terminated copy: the newest text outlives the replay */
+static gchar *read_version(const char *stored_name, gsize *len) {
+    GBytes *bytes = version_cache_get_uncached(stored_name);
+    if (!bytes) {
+        *len = 0;
+        return g_strdup("");
+    }
+    const char *data = g_bytes_get_data(bytes, len);
+    gchar *contents = g_malloc(*len + 1);
+    memcpy(contents, data, *len);
+    contents[*len] = '\0';
+    g_bytes_unref(bytes);
+    return contents;
+}
+
+/* Worker: replays the versions after the base, one diff per version */
+static void blame_worker(GTask *task, gpointer source, gpointer task_data, GCancellable *cancellable) {
+    BlameJob *job = task_data;
+    DiffInterner *interner = diff_interner_new();
+    GArray *prev_tokens = NULL;
+    GArray *prev_origins = NULL;
+    guint first = 0;
+    gchar *text = NULL;
+    gsize len = 0;
+
+    if (job->base_origins) {
+        text = read_version(g_ptr_array_index(job->stored, job->base), &len);
+        prev_tokens = g_array_new(FALSE, FALSE, sizeof(guint32));
+        diff_tokenize_lines(interner, text, len, prev_tokens, NULL);
+        if (prev_tokens->len == job->base_origins->len) {
+            prev_origins = job->base_origins;
+            first = job->base + 1;
+        } else {
+            /* The map does not fit the file any more; replay the whole history from version 0 */
+            g_array_unref(prev_tokens);
+            prev_tokens = NULL;
+        }
+        if (first < job->stored->len) g_free(text);
+        else { job->latest_text = text; job->latest_len = len; }
+    }
+
+    for (guint i = first; i < job->stored->len; ++i) {
+        const char *stored = g_ptr_array_index(job->stored, i);
+        text = read_version(stored, &len);
+        GArray *tokens = g_array_new(FALSE, FALSE, sizeof(guint32));
+        diff_tokenize_lines(interner, text, len, tokens, NULL);
+
+        GArray *origins = g_array_sized_new(FALSE, FALSE, sizeof(const char *), tokens->len);
+        g_array_set_size(origins, tokens->len);
+        if (!prev_tokens) {
+            for (guint l = 0; l < tokens->len; ++l) g_array_index(origins, const char *, l) = stored;
+        } else {
+            GArray *ops = myers_diff((const guint32 *)prev_tokens->data, prev_tokens->len,
+                                     (const guint32 *)tokens->data, tokens->len);
+            for (guint k = 0; k < ops->len; ++k) {
+                DiffOp *op = &g_array_index(ops, DiffOp, k);
+                for (guint l = 0; l < op->length; ++l) {
+                    if (op->type == DIFF_EQUAL)
+                        g_array_index(origins, const char *, op->b_start + l) =
+                            g_array_index(prev_origins, const char *, op->a_start + l);
+                    else if (op->type == DIFF_INSERT)
+                        g_array_index(origins, const char *, op->b_start + l) = stored;
+                }
+            }
+            g_array_unref(ops);
+            g_array_unref(prev_tokens);
+        }
+        g_ptr_array_add(job->maps, origins);
+        prev_tokens = tokens;
+        prev_origins = origins;
+
+        if (i + 1 == job->stored->len) { job->latest_text = text; job->latest_len = len; }
+        else g_free(text);
+    }
+
+    if (prev_tokens) g_array_unref(prev_tokens);
+    diff_interner_free(interner);
+    g_task_return_boolean(task, TRUE);
+}
+
+// ---
+// --- Annotate window
+// ---
+
+static void blame_row_setup(GtkSignalListItemFactory *factory, GtkListItem *list_item, gpointer user_data) {
+    GtkWidget *hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 12);
+    GtkWidget *origin_label = gtk_label_new(NULL);
+    gtk_label_set_width_chars(GTK_LABEL(origin_label), 16);
+    gtk_label_set_xalign(GTK_LABEL(origin_label), 0.0);
+    gtk_widget_add_css_class(origin_label, "dim-label");
+    GtkWidget *line_label = gtk_label_new(NULL);
+    gtk_label_set_xalign(GTK_LABEL(line_label), 0.0);
+    gtk_widget_set_hexpand(line_label, TRUE);
+    gtk_box_append(GTK_BOX(hbox), origin_label);
+    gtk_box_append(GTK_BOX(hbox), line_label);
+    g_object_set_data(G_OBJECT(hbox), "origin-label", origin_label);
+    g_object_set_data(G_OBJECT(hbox), "line-label", line_label);
+    gtk_list_item_set_child(list_item, hbox);
+}
+
+static void blame_row_bind(GtkSignalListItemFactory *factory, GtkListItem *list_item, gpointer user_data) {
+    GArray *origins = user_data;
+    GtkWidget *hbox = gtk_list_item_get_child(list_item);
+    GtkStringObject *line = gtk_list_item_get_item(list_item);
+    guint pos = gtk_list_item_get_position(list_item);
+    const char *origin = pos < origins->len ? g_array_index(origins, const char *, pos) : NULL;
+
+    /* Live origins show their record time; deleted ones fall back to the stored name */
+    char when[32] = "";
+    VersionEntry entry;
+    if (origin && version_index_lookup_stored(origin, &entry) && strlen(entry.timestamp) >= 12) {
+        const char *ts = entry.timestamp;
+        g_snprintf(when, sizeof(when), "%.4s-%.2s-%.2s %.2s:%.2s", ts, ts + 4, ts + 6, ts + 8, ts + 10);
+    } else if (origin) {
+        g_strlcpy(when, origin, sizeof(when));
+    }
+
+    GtkWidget *origin_label = g_object_get_data(G_OBJECT(hbox), "origin-label");
+    gtk_label_set_text(GTK_LABEL(origin_label), when);
+    gtk_widget_set_tooltip_text(origin_label, origin);
+    gtk_label_set_text(GTK_LABEL(g_object_get_data(G_OBJECT(hbox), "line-label")),
+                       gtk_string_object_get_string(line));
+}
+
+static void fill_blame_window(GtkWidget *window, GArray *origins, const char *text, gsize len) {
+    GtkStringList *lines = gtk_string_list_new(NULL);
+    gsize pos = 0;
+    while (pos < len) {
+        const char *nl = memchr(text + pos, '\n', len - pos);
+        gsize end = nl ? (gsize)(nl - text) : len;
+        gsize stop = (end > pos && text[end - 1] == '\r') ? end - 1 : end;
+        gchar *line = g_strndup(text + pos, stop - pos);
+        gtk_string_list_take(lines, line);
+        pos = nl ? end + 1 : len;
+    }
+
+    GtkListItemFactory *factory = gtk_signal_list_item_factory_new();
+    g_signal_connect(factory, "setup", G_CALLBACK(blame_row_setup), NULL);
+    g_signal_connect(factory, "bind", G_CALLBACK(blame_row_bind), origins);
+    /* The rows read the origins array; keep it alive as long as the window */
+    g_object_set_data_full(G_OBJECT(window), "blame-origins", g_array_ref(origins), (GDestroyNotify)g_array_unref);
+
+    GtkWidget *list_view = gtk_list_view_new(GTK_SELECTION_MODEL(gtk_no_selection_new(G_LIST_MODEL(lines))), factory);
+    gtk_widget_add_css_class(list_view, "monospace");
+    GtkWidget *scrolled = gtk_scrolled_window_new();
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(scrolled), list_view);
+    gtk_window_set_child(GTK_WINDOW(window), scrolled);
+}
+
+static void on_blame_done(GObject *source, GAsyncResult *res, gpointer user_data) {
+    BlameJob *job = g_task_get_task_data(G_TASK(res));
+    g_task_propagate_boolean(G_TASK(res), NULL);
+
+    /* New maps belong to the last maps->len versions of stored; the base (if any) was already cached */
+    guint offset = job->stored->len - job->maps->len;
+    for (guint i = 0; i < job->maps->len; ++i) {
+        const char *stored = g_ptr_array_index(job->stored, offset + i);
+        /* Skip versions deleted while the worker ran */
+        if (version_index_lookup_stored(stored, NULL))
+            g_hash_table_replace(blame_cache, (gpointer)stored, g_array_ref(g_ptr_array_index(job->maps, i)));
+    }
+    prune_cache(job->file_id);
+
+    if (job->window) {
+        GArray *latest = job->maps->len ? g_ptr_array_index(job->maps, job->maps->len - 1) : job->base_origins;
+        if (latest) fill_blame_window(job->window, latest, job->latest_text ? job->latest_text : "", job->latest_len);
+    }
+}
+
+void create_blame_window(GtkWindow *parent, const char *original_path) {
+    blame_init();
+    GArray *versions = version_index_get_versions(original_path);
+    if (!versions || versions->len == 0) {
+        GtkAlertDialog *alert = gtk_alert_dialog_new("No recorded versions to annotate yet.");
+        gtk_alert_dialog_show(alert, parent);
+        g_object_unref(alert);
+        return;
+    }
+
+    GtkWidget *window = gtk_window_new();
+    gchar *basename = g_path_get_basename(original_path);
+    gchar *title = g_strdup_printf("Annotate: %s", basename);
+    gtk_window_set_title(GTK_WINDOW(window), title);
+    g_free(title);
+    g_free(basename);
+    gtk_window_set_transient_for(GTK_WINDOW(window), parent);
+    gtk_window_set_default_size(GTK_WINDOW(window), 900, 700);
+    gtk_window_set_child(GTK_WINDOW(window), gtk_label_new("Annotating…"));
+
+    /* Resume from the newest version whose map is cached. stored still lists the whole
+     * history, so the worker can fall back to replaying it if that map turns out stale. */
+    BlameJob *job = g_new0(BlameJob, 1);
+    job->window = window;
+    g_object_add_weak_pointer(G_OBJECT(window), (gpointer *)&job->window);
+    job->file_id = g_array_index(versions, VersionEntry, 0).file_id;
+    job->stored = g_ptr_array_new();
+    job->maps = g_ptr_array_new_with_free_func((GDestroyNotify)g_array_unref);
+    for (guint i = versions->len; i > 0; --i) {
+        GArray *cached = g_hash_table_lookup(blame_cache, g_array_index(versions, VersionEntry, i - 1).stored_name);
+        if (cached) {
+            job->base_origins = g_array_ref(cached);
+            job->base = i - 1;
+            break;
+        }
+    }
+    for (guint i = 0; i < versions->len; ++i) {
+        g_ptr_array_add(job->stored, (gpointer)g_array_index(versions, VersionEntry, i).stored_name);
+    }
+
+    GTask *task = g_task_new(NULL, NULL, on_blame_done, NULL);
+    g_task_set_task_data(task, job, (GDestroyNotify)blame_job_free);
+    scheduler_run_task(task, blame_worker, SCHEDULER_PRIORITY_INTERACTIVE);
+    g_object_unref(task);
+
+    gtk_window_present(GTK_WINDOW(window));
+}
@@ -0,0 +1,89 @@
+#include "checkout.h"
+#include "version_cache.h"
+#include "inline_store.h"
+#include <gtk/gtk.h>
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#if defined(__linux__)
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <linux/fs.h>
+#elif defined(__APPLE__)
+#include <unistd.h>
+#include <sys/clonefile.h>
+#endif
+
+static gboolean try_reflink(const char *source, const char *target) {
+#if defined(__linux__) && defined(FICLONE)
+    int in = g_open(source, O_RDONLY, 0);
+    if (in < 0) return FALSE;
+    int out = g_open(target, O_WRONLY | O_CREAT | O_EXCL, 0666);
+    if (out < 0) {
+        close(in);
+        return FALSE;
+    }
+    gboolean ok = ioctl(out, FICLONE, in) == 0;
+    close(in);
+    close(out);
+    if (!ok) g_unlink(target);
+    return ok;
+#elif defined(__APPLE__)
+    if (clonefile(source, target, 0) != 0) return FALSE;
+    /* clonefile() copies the mode, which is read-only once the version was hard-linked */
+    g_chmod(target, 0644);
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+static gboolean try_hardlink(const char *source, const char *target) {
+#if defined(__linux__) || defined(__APPLE__) || defined(__unix__)
+    if (link(source, target) != 0) return FALSE;
+    /* Shared inode: read-only keeps an edit of the checkout from rewriting
+     * history. The mode belongs to the inode, so the stored file stays
+     * read-only for good. */
+    g_chmod(target, 0444);
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+CheckoutMethod checkout_link(const char *stored_name, const char *target_path, gboolean allow_hardlink) {
+    /* Links need the name to be free; a stale read-only link must go too */
+    if (g_unlink(target_path) != 0 && errno != ENOENT) {
+        g_chmod(target_path, 0644);
+        g_unlink(target_path);
+    }
+    /* An inline version has no file of its own to share */
+    if (inline_store_contains(stored_name)) return CHECKOUT_FAILED;
+
+    gchar *source = g_build_filename("data", "versions", stored_name, NULL);
+
+    CheckoutMethod method = CHECKOUT_FAILED;
+    if (try_reflink(source, target_path)) method = CHECKOUT_REFLINK;
+    else if (allow_hardlink && try_hardlink(source, target_path)) method = CHECKOUT_HARDLINK;
+    g_free(source);
+    return method;
+}
+
+CheckoutMethod checkout_version(const char *stored_name, const char *target_path,
+                                gboolean allow_hardlink, GError **error) {
+    CheckoutMethod method = checkout_link(stored_name, target_path, allow_hardlink);
+    if (method == CHECKOUT_FAILED) {
+        GBytes *bytes = version_cache_get_uncached(stored_name);
+        if (!bytes) {
+            g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_NOENT, "Cannot read version %s", stored_name);
+        } else {
+            gsize len;
+            const char *contents = g_bytes_get_data(bytes, &len);
+            if (g_file_set_contents_full(target_path, contents, (gssize)len, G_FILE_SET_CONTENTS_NONE, 0666, error))
+                method = CHECKOUT_COPY;
+            g_bytes_unref(bytes);
+        }
+    }
+    return method;
+}
@@ -0,0 +1,334 @@
+#include "content_index.h"
+#include "version_index.h"
+#include "version_cache.h"
+#include "inline_store.h"
+#include "scheduler.h"
+#include <gtk/gtk.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TERM_MIN 2
+#define TERM_MAX 64
+#define MAX_INDEXED_SIZE (16 * 1024 * 1024)
+/* Rewrite the log at startup once dead lines reach this count and a quarter of the file */
+#define COMPACT_MIN_DEAD 32
+
+typedef struct {
+    const char *stored_name;   /* interned */
+    guint32 file_id;
+    char timestamp[16];
+    gboolean indexed;          /* its terms are in memory and in the log */
+    gboolean dead;             /* the version was deleted */
+} ContentDoc;
+
+typedef struct {
+    ContentDoc *doc;
+    guint32 count;
+} Posting;
+
+static gboolean initialized = FALSE;
+static GStringChunk *strings = NULL;
+static GHashTable *docs = NULL;     /* stored name -> ContentDoc */
+static GHashTable *terms = NULL;    /* interned term -> GArray of Posting */
+static GQueue pending = G_QUEUE_INIT; /* ContentDoc waiting for the worker */
+static gboolean worker_busy = FALSE;
+
+static gchar *log_path(void) {
+    return g_build_filename("data", "content_index.txt", NULL);
+}
+
+static void log_append(const char *line) {
+    g_mkdir_with_parents("data", 0755);
+    gchar *path = log_path();
+    FILE *f = fopen(path, "ab");
+    if (f) {
+        fputs(line, f);
+        fputc('\n', f);
+        fclose(f);
+    } else {
+        g_printerr("content_index: failed to open %s for append\n", path);
+    }
+    g_free(path);
+}
+
+// ---
+// --- Tokenizer (also run on the worker thread)
+// ---
+
+static gboolean is_term_byte(guchar c) {
+    return g_ascii_isalnum(c) || c == '_' || c >= 0x80;
+}
+
+/* Counts case-folded terms of text into counts (term -> count, keys owned) */
+static void count_terms(const char *text, gsize len, GHashTable *counts) {
+    gsize i = 0;
+    while (i < len) {
+        while (i < len && !is_term_byte((guchar)text[i])) i++;
+        gsize start = i;
+        while (i < len && is_term_byte((guchar)text[i])) i++;
+        gsize n = i - start;
+        if (n < TERM_MIN || n > TERM_MAX) continue;
+        gchar *term = g_ascii_strdown(text + start, (gssize)n);
+        guint c = GPOINTER_TO_UINT(g_hash_table_lookup(counts, term));
+        g_hash_table_replace(counts, term, GUINT_TO_POINTER(c + 1));
+    }
+}
+
+/* Worker: reads one stored version and returns its "term:count ..." list */
+static void index_worker(GTask *task, gpointer source, gpointer task_data, GCancellable *cancellable) {
+    const char *stored_name = task_data;
+    gchar *path = g_build_filename("data", "versions", stored_name, NULL);
+    GString *pairs = g_string_new("");
+    GStatBuf st;
+    GBytes *bytes = NULL;
+    /* Inline versions are small by definition; files are sized up before being read */
+    if (inline_store_contains(stored_name) || (g_stat(path, &st) == 0 && st.st_size <= MAX_INDEXED_SIZE))
+        bytes = version_cache_get_uncached(stored_name);
+    gsize len = 0;
+    const char *contents = bytes ? g_bytes_get_data(bytes, &len) : NULL;
+    if (contents && len <= MAX_INDEXED_SIZE && memchr(contents, '\0', MIN(len, 8192)) == NULL) {
+        GHashTable *counts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+        count_terms(contents, len, counts);
+        GHashTableIter iter;
+        gpointer key, value;
+        g_hash_table_iter_init(&iter, counts);
+        while (g_hash_table_iter_next(&iter, &key, &value)) {
+            if (pairs->len) g_string_append_c(pairs, ' ');
+            g_string_append_printf(pairs, "%s:%u", (const char *)key, GPOINTER_TO_UINT(value));
+        }
+        g_hash_table_destroy(counts);
+    }
+    if (bytes) g_bytes_unref(bytes);
+    g_free(path);
+    g_task_return_pointer(task, g_string_free(pairs, FALSE), g_free);
+}
+
+// ---
+// --- In-memory postings
+// ---
+
+static ContentDoc *doc_new(const char *stored_name, guint32 file_id, const char *timestamp) {
+    ContentDoc *doc = g_new0(ContentDoc, 1);
+    doc->stored_name = g_string_chunk_insert_const(strings, stored_name);
+    doc->file_id = file_id;
+    g_strlcpy(doc->timestamp, timestamp ? timestamp : "", sizeof(doc->timestamp));
+    g_hash_table_insert(docs, (gpointer)doc->stored_name, doc);
+    return doc;
+}
+
+/* Adds a doc's "term:count term:count" list to the postings; pairs is modified */
+static void add_doc_terms(ContentDoc *doc, char *pairs) {
+    char *p = pairs;
+    while (p && *p) {
+        char *end = strchr(p, ' ');
+        if (end) *end = '\0';
+        char *colon = strrchr(p, ':');
+        if (colon && colon != p) {
+            *colon = '\0';
+            Posting posting = { doc, (guint32)strtoul(colon + 1, NULL, 10) };
+            GArray *list = g_hash_table_lookup(terms, p);
+            if (!list) {
+                list = g_array_new(FALSE, FALSE, sizeof(Posting));
+                g_hash_table_insert(terms, (gpointer)g_string_chunk_insert_const(strings, p), list);
+            }
+            g_array_append_val(list, posting);
+        }
+        p = end ? end + 1 : NULL;
+    }
+    doc->indexed = TRUE;
+}
+
+static void start_next(void);
+
+static void on_indexed(GObject *source, GAsyncResult *res, gpointer user_data) {
+    ContentDoc *doc = (ContentDoc *)user_data;
+    gchar *pairs = g_task_propagate_pointer(G_TASK(res), NULL);
+    worker_busy = FALSE;
+    if (pairs && !doc->dead) {
+        gchar *line = g_strdup_printf("@%u|%s|%s|%s", doc->file_id, doc->stored_name, doc->timestamp, pairs);
+        add_doc_terms(doc, pairs);
+        log_append(line);
+        g_free(line);
+    }
+    g_free(pairs);
+    start_next();
+}
+
+/* One version at a time, so background indexing never competes with itself for the disk */
+static void start_next(void) {
+    while (!worker_busy && !g_queue_is_empty(&pending)) {
+        ContentDoc *doc = g_queue_pop_head(&pending);
+        if (doc->dead) continue;
+        worker_busy = TRUE;
+        GTask *task = g_task_new(NULL, NULL, on_indexed, doc);
+        g_task_set_task_data(task, g_strdup(doc->stored_name), g_free);
+        scheduler_run_task(task, index_worker, SCHEDULER_PRIORITY_BACKGROUND);
+        g_object_unref(task);
+    }
+}
+
+static void queue_version(const char *stored_name, guint32 file_id, const char *timestamp) {
+    if (g_hash_table_contains(docs, stored_name)) return;
+    g_queue_push_tail(&pending, doc_new(stored_name, file_id, timestamp));
+    start_next();
+}
+
+static void on_version_changed(VersionIndexChange change, const VersionEntry *entry, guint position, gpointer user_data) {
+    if (change == VERSION_INDEX_ADDED) {
+        queue_version(entry->stored_name, entry->file_id, entry->timestamp);
+        return;
+    }
+    ContentDoc *doc = g_hash_table_lookup(docs, entry->stored_name);
+    if (!doc || doc->dead) return;
+    doc->dead = TRUE;
+    if (doc->indexed) {
+        gchar *line = g_strdup_printf("!|%s", doc->stored_name);
+        log_append(line);
+        g_free(line);
+    }
+}
+
+static void backfill_version(const char *original_path, const char *stored_name, const char *timestamp, gpointer user_data) {
+    queue_version(stored_name, version_index_lookup_path(original_path), timestamp);
+}
+
+/* Replays content_index.txt, keeping only versions that are still live */
+static void load_log(void) {
+    gchar *path = log_path();
+    gchar *contents = NULL;
+    if (!g_file_get_contents(path, &contents, NULL, NULL)) {
+        g_free(path);
+        return;
+    }
+    GString *snapshot = g_string_new("");
+    guint lines = 0, dead = 0;
+    char *line = contents;
+    while (line && *line) {
+        char *next = strchr(line, '\n');
+        if (next) *next++ = '\0';
+        gsize n = strlen(line);
+        if (n && line[n - 1] == '\r') line[--n] = '\0';
+        if (n == 0) { line = next; continue; }
+        lines++;
+
+        char *f1 = strchr(line, '|');
+        char *f2 = f1 ? strchr(f1 + 1, '|') : NULL;
+        char *f3 = f2 ? strchr(f2 + 1, '|') : NULL;
+        if (line[0] != '@' || !f3) { dead++; line = next; continue; }
+        *f1 = *f2 = *f3 = '\0';
+        const char *stored = f1 + 1;
+        if (g_hash_table_contains(docs, stored) || !version_index_lookup_stored(stored, NULL)) {
+            dead++;
+        } else {
+            g_string_append_printf(snapshot, "%s|%s|%s|%s\n", line, stored, f2 + 1, f3 + 1);
+            add_doc_terms(doc_new(stored, (guint32)strtoul(line + 1, NULL, 10), f2 + 1), f3 + 1);
+        }
+        line = next;
+    }
+    if (dead >= COMPACT_MIN_DEAD && dead * 4 >= lines) {
+        GError *error = NULL;
+        if (!g_file_set_contents(path, snapshot->str, (gssize)snapshot->len, &error)) {
+            g_printerr("content_index: compaction failed: %s\n", error ? error->message : "unknown");
+            g_clear_error(&error);
+        }
+    }
+    g_string_free(snapshot, TRUE);
+    g_free(contents);
+    g_free(path);
+}
+
+void content_index_init(void) {
+    if (initialized) return;
+    initialized = TRUE;
+    strings = g_string_chunk_new(64 * 1024);
+    docs = g_hash_table_new(g_str_hash, g_str_equal);
+    terms = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify)g_array_unref);
+
+    version_index_init();
+    load_log();
+    version_index_watch(on_version_changed, NULL);
+    version_index_foreach(backfill_version, NULL);
+}
+
+guint content_index_pending(void) {
+    return g_queue_get_length(&pending) + (worker_busy ? 1 : 0);
+}
+
+// ---
+// --- Queries
+// ---
+
+static gint compare_list_length(gconstpointer a, gconstpointer b) {
+    const GArray *x = *(GArray * const *)a, *y = *(GArray * const *)b;
+    return x->len < y->len ? -1 : (x->len > y->len ? 1 : 0);
+}
+
+static gint compare_hits(gconstpointer a, gconstpointer b) {
+    const ContentHit *x = a, *y = b;
+    int c = strcmp(x->timestamp, y->timestamp);
+    return c ? c : strcmp(x->stored_name, y->stored_name);
+}
+
+GArray *content_index_query(const char *text, guint max_results) {
+    GArray *hits = g_array_new(FALSE, FALSE, sizeof(ContentHit));
+    if (!initialized || !text) return hits;
+
+    GHashTable *query = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    count_terms(text, strlen(text), query);
+    GPtrArray *lists = g_ptr_array_new();
+    gboolean missing = g_hash_table_size(query) == 0;
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, query);
+    while (!missing && g_hash_table_iter_next(&iter, &key, &value)) {
+        GArray *list = g_hash_table_lookup(terms, key);
+        if (list) g_ptr_array_add(lists, list);
+        else missing = TRUE;
+    }
+    g_hash_table_destroy(query);
+    if (missing) {
+        g_ptr_array_free(lists, TRUE);
+        return hits;
+    }
+
+    /* Start from the rarest term; every later list can only shrink the set */
+    g_ptr_array_sort(lists, compare_list_length);
+    GHashTable *acc = g_hash_table_new(g_direct_hash, g_direct_equal);
+    GArray *first = g_ptr_array_index(lists, 0);
+    for (guint i = 0; i < first->len; ++i) {
+        Posting *p = &g_array_index(first, Posting, i);
+        if (!p->doc->dead) g_hash_table_insert(acc, p->doc, GUINT_TO_POINTER(p->count));
+    }
+    for (guint l = 1; l < lists->len && g_hash_table_size(acc) > 0; ++l) {
+        GArray *list = g_ptr_array_index(lists, l);
+        GHashTable *next = g_hash_table_new(g_direct_hash, g_direct_equal);
+        for (guint i = 0; i < list->len; ++i) {
+            Posting *p = &g_array_index(list, Posting, i);
+            gpointer prev;
+            if (g_hash_table_lookup_extended(acc, p->doc, NULL, &prev)) {
+                guint count = MIN(GPOINTER_TO_UINT(prev), p->count);
+                g_hash_table_insert(next, p->doc, GUINT_TO_POINTER(count));
+            }
+        }
+        g_hash_table_destroy(acc);
+        acc = next;
+    }
+    g_ptr_array_free(lists, TRUE);
+
+    g_hash_table_iter_init(&iter, acc);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        ContentDoc *doc = key;
+        ContentHit hit;
+        hit.stored_name = doc->stored_name;
+        hit.file_id = doc->file_id;
+        memcpy(hit.timestamp, doc->timestamp, sizeof(hit.timestamp));
+        hit.hits = GPOINTER_TO_UINT(value);
+        g_array_append_val(hits, hit);
+    }
+    g_hash_table_destroy(acc);
+    g_array_sort(hits, compare_hits);
+    if (hits->len > max_results) g_array_set_size(hits, max_results);
+    return hits;
+}
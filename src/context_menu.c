@@ -1,17 +1,23 @@
 #include <gtk/gtk.h>
 #include "context_menu.h"
 #include "diff_view.h"
+#include "blame.h"
+#include "version_index.h"
+#include "retention.h"
+#include "snapshot_cache.h"
+#include "version_cache.h"
+#include "diff_logic.h"
+#include "checkout.h"
+#include "scheduler.h"
+#include "inline_store.h"
+#include "list_items.h"
+#include "sidebar.h"
 #include <stdio.h> // For printf
 #include <gio/gio.h>
+#include <glib/gstdio.h>
 #include <time.h>
 #include <errno.h>
 #include <string.h>
-#if defined(__has_include)
-# if __has_include(<json-glib/json-glib.h>)
-#  include <json-glib/json-glib.h>
-#  define HAVE_JSON_GLIB 1
-# endif
-#endif
 #if defined(G_OS_WIN32) || defined(_WIN32) || defined(__MINGW32__)
 #include <windows.h>
 #include <shellapi.h>
@@ -22,21 +28,53 @@
 // --- Globals for version comparison
 // ---
 
-// List to store pointers to selected version widgets for comparison
+// List of DeltaVersionItem (owned refs) selected for comparison
 static GList *selected_for_comparison = NULL;
 
 // ---
-// --- CONTEXT 1: "sidebar-element" Actions
+// --- The row a context menu was opened on
 // ---
 
-static void open(GSimpleAction *action, GVariant *parameter, gpointer user_data) {
-    GtkWidget *widget = GTK_WIDGET(user_data);
+// Rows are recycled by the list views, so actions get the model item the
+// click resolved to rather than a row widget. Only one menu is open at a time.
+typedef struct {
+    GtkWindow *window;   // toplevel the menu belongs to
+    GtkWidget *view;     // list view the click landed on (owns the popover)
+    GObject *item;       // DeltaFileItem or DeltaVersionItem (owned ref)
+    gchar *path;         // tracked file path, or data/versions/<stored> for a version
+} MenuTarget;
+
+static MenuTarget menu_target = {0};
+
+static void menu_target_set(GtkWindow *window, GtkWidget *view, GObject *item) {
+    menu_target.window = window;
+    menu_target.view = view;
+    g_set_object(&menu_target.item, item);
+    g_free(menu_target.path);
+    if (DELTA_IS_FILE_ITEM(item))
+        menu_target.path = g_strdup(delta_file_item_get_path(DELTA_FILE_ITEM(item)));
+    else
+        menu_target.path = delta_version_item_dup_path(DELTA_VERSION_ITEM(item));
+}
 
-    const char *stored_path = g_object_get_data(G_OBJECT(widget), "file-path");
-    const char *path = stored_path ? stored_path : gtk_widget_get_name(widget);
+/* Walks up from the picked widget to the row child that was bound to an item */
+static GObject *item_at_point(GtkWidget *view, double x, double y) {
+    GtkWidget *picked = gtk_widget_pick(view, x, y, GTK_PICK_DEFAULT);
+    while (picked && picked != view) {
+        GObject *item = g_object_get_data(G_OBJECT(picked), "list-item");
+        if (item) return item;
+        picked = gtk_widget_get_parent(picked);
+    }
+    return NULL;
+}
 
+// ---
+// --- CONTEXT 1: "sidebar-element" Actions
+// ---
+
+void open_file_path(const char *path) {
     if (path == NULL) {
-        g_printerr("Open: no path available for widget\n");
+        g_printerr("Open: no path available for item\n");
         return;
     }
 
@@ -143,10 +181,16 @@ static void open(GSimpleAction *action, GVariant *parameter, gpointer user_data)
     g_free(abs_path);
 }
 
+static void open(GSimpleAction *action, GVariant *parameter, gpointer user_data) {
+    MenuTarget *target = (MenuTarget *)user_data;
+    open_file_path(target->path);
+}
+
 typedef struct {
     GtkWidget *dialog;
     GtkWidget *entry;
-    GtkWidget *target_widget; /* the label widget representing the file */
+    GtkWindow *window;
+    DeltaFileItem *item; /* the tracked file being renamed (owned ref) */
 } RenameData;
 
 static void on_rename_response(GtkDialog *dialog, int response_id, gpointer user_data) {
@@ -156,9 +200,9 @@ static void on_rename_response(GtkDialog *dialog, int response_id, gpointer user
         gchar *new_name = NULL;
         g_object_get(G_OBJECT(rd->entry), "text", &new_name, NULL);
         if (new_name && *new_name) {
-            const char *old_path = g_object_get_data(G_OBJECT(rd->target_widget), "file-path");
+            gchar *old_path = g_strdup(delta_file_item_get_path(rd->item));
             if (old_path == NULL) {
-                g_printerr("Rename: no original path stored on widget\n");
+                g_printerr("Rename: no original path stored on item\n");
             } else {
                 char *dir = g_path_get_dirname(old_path);
                 char *new_path = g_build_filename(dir, new_name, NULL);
@@ -166,21 +210,26 @@ static void on_rename_response(GtkDialog *dialog, int response_id, gpointer user
                 GFile *src = g_file_new_for_path(old_path);
                 GFile *dest = g_file_new_for_path(new_path);
                 GError *error = NULL;
-                gboolean moved = g_file_move(src, dest, G_FILE_COPY_NONE, NULL, NULL, NULL, &error);
-                if (!moved) {
+                /* The history cannot follow onto a name that already has one, so refuse before moving */
+                gboolean taken = version_index_lookup_path(new_path) != 0;
+                gboolean moved = !taken && g_file_move(src, dest, G_FILE_COPY_NONE, NULL, NULL, NULL, &error);
+                if (taken) {
+                    g_printerr("Rename failed: %s already has recorded versions\n", new_path);
+                } else if (!moved) {
                     g_printerr("Rename failed: %s\n", error ? error->message : "unknown");
                     g_clear_error(&error);
                 } else {
-                    /* Update stored path (g_object_set_data_full will handle freeing the previous value) */
-                    g_object_set_data_full(G_OBJECT(rd->target_widget), "file-path", g_strdup(new_path), g_free);
-
-                    /* Update widget name and label text */
-                    gtk_widget_set_name(rd->target_widget, new_name);
-                    /* The row stores a pointer to the label widget */
-                    GtkWidget *label = g_object_get_data(G_OBJECT(rd->target_widget), "label-widget");
-                    if (label && GTK_IS_LABEL(label)) {
-                        gtk_label_set_text(GTK_LABEL(label), new_name);
+                    /* Keep the history attached: the file id now points at the new path */
+                    version_index_rename_path(old_path, new_path);
+
+                    /* Keep the versions pane pointing at the file it shows */
+                    GObject *window = G_OBJECT(rd->window);
+                    if (g_strcmp0(g_object_get_data(window, "original-path"), old_path) == 0) {
+                        g_object_set_data_full(window, "original-path", g_strdup(new_path), g_free);
                     }
+
+                    /* Update the item, its filter entry and its row, if one is on screen */
+                    sidebar_rename_file(rd->window, rd->item, new_path);
                 }
 
                 g_object_unref(src);
@@ -188,11 +237,13 @@ static void on_rename_response(GtkDialog *dialog, int response_id, gpointer user
                 g_free(dir);
                 g_free(new_path);
             }
+            g_free(old_path);
             g_free(new_name);
         }
     }
 
     gtk_window_destroy(GTK_WINDOW(rd->dialog));
+    g_object_unref(rd->item);
     g_free(rd);
 }
 
@@ -207,14 +258,15 @@ static void on_rename_cancel_clicked(GtkButton *button, gpointer user_data) {
 }
 
 static void _rename(GSimpleAction *action, GVariant *parameter, gpointer user_data) {
-    /* user_data is the GtkWidget (the label) we passed in. */
-    GtkWidget *widget = GTK_WIDGET(user_data);
+    MenuTarget *target = (MenuTarget *)user_data;
+    if (!DELTA_IS_FILE_ITEM(target->item)) return;
 
     /* Get parent window to be transient for */
-    GtkWindow *parent = GTK_WINDOW(gtk_widget_get_ancestor(widget, GTK_TYPE_WINDOW));
+    GtkWindow *parent = target->window;
 
     RenameData *rd = g_new0(RenameData, 1);
-    rd->target_widget = widget;
+    rd->window = parent;
+    rd->item = DELTA_FILE_ITEM(g_object_ref(target->item));
 
     /* Create a transient window with entry and buttons (GTK4-friendly) */
     GtkWidget *dialog = gtk_window_new();
@@ -232,13 +284,7 @@ static void _rename(GSimpleAction *action, GVariant *parameter, gpointer user_da
     rd->entry = entry;
 
     /* Pre-fill with current basename */
-    const char *old_path = g_object_get_data(G_OBJECT(widget), "file-path");
-    char *base = NULL;
-    if (old_path) base = g_path_get_basename(old_path);
-    else {
-        const char *wname = gtk_widget_get_name(widget);
-        if (wname) base = g_strdup(wname);
-    }
+    char *base = g_path_get_basename(delta_file_item_get_path(rd->item));
     if (base) {
         g_object_set(G_OBJECT(entry), "text", base, NULL);
         g_free(base);
@@ -263,11 +309,11 @@ static void _rename(GSimpleAction *action, GVariant *parameter, gpointer user_da
     /* Show dialog */
     gtk_window_present(GTK_WINDOW(dialog));
 }
-/* Helper that performs the actual deletion of a sidebar row and index update */
-static void perform_delete_row(GtkWidget *row) {
-    if (!row) return;
-    const char *path = g_object_get_data(G_OBJECT(row), "file-path");
-    g_print("perform_delete_row: row=%p path=%s\n", row, path ? path : "(null)");
+/* Helper that performs the actual deletion of a tracked file and index update */
+static void perform_delete_row(GtkWindow *parent_window, DeltaFileItem *item) {
+    if (!item) return;
+    const char *path = delta_file_item_get_path(item);
+    g_print("perform_delete_row: item=%p path=%s\n", (void *)item, path ? path : "(null)");
 
     /* Try to remove the file from disk first */
     if (path) {
@@ -275,8 +321,6 @@ static void perform_delete_row(GtkWidget *row) {
             int err = errno;
             const char *errstr = strerror(err);
             /* Show an error dialog and abort deletion */
-            GtkWidget *toplevel = gtk_widget_get_ancestor(row, GTK_TYPE_WINDOW);
-            GtkWindow *parent_window = toplevel ? GTK_WINDOW(toplevel) : NULL;
             GtkWidget *dialog = gtk_window_new();
             gtk_window_set_title(GTK_WINDOW(dialog), "Delete Failed");
             if (parent_window) gtk_window_set_transient_for(GTK_WINDOW(dialog), parent_window);
@@ -301,85 +345,57 @@ static void perform_delete_row(GtkWidget *row) {
         g_print("perform_delete_row: removed file from disk: %s\n", path);
     }
 
-    /* Remove row from UI */
-    GtkWidget *parent = gtk_widget_get_parent(row);
-    if (GTK_IS_LIST_BOX(parent)) {
-        gtk_list_box_remove(GTK_LIST_BOX(parent), row);
-        g_print("perform_delete_row: removed row from list box\n");
-    } else {
-        gtk_widget_unparent(row);
-        g_print("perform_delete_row: unparented row\n");
-    }
-
-    /* Remove from data/files_index.txt */
+    /* Remove from data/files_index.txt (appends a tombstone, no rewrite) */
     if (path) {
-        const char *data_dir = "data";
-        gchar *index_path = g_build_filename(data_dir, "files_index.txt", NULL);
-        if (g_file_test(index_path, G_FILE_TEST_EXISTS)) {
-            GPtrArray *lines = g_ptr_array_new_with_free_func(g_free);
-            FILE *f = fopen(index_path, "r");
-            if (f) {
-                char buf[4096];
-                while (fgets(buf, sizeof(buf), f)) {
-                    char *nl = strchr(buf, '\n'); if (nl) *nl = '\0';
-                    if (g_strcmp0(buf, path) != 0) {
-                        g_ptr_array_add(lines, g_strdup(buf));
-                    }
-                }
-                fclose(f);
-            }
-            /* write back */
-            FILE *fw = fopen(index_path, "w");
-            if (fw) {
-                for (guint i = 0; i < lines->len; ++i) {
-                    fprintf(fw, "%s\n", (char *)g_ptr_array_index(lines, i));
-                }
-                fclose(fw);
-            }
-            g_ptr_array_free(lines, TRUE);
-            g_print("perform_delete_row: updated files_index.txt\n");
-        }
-        g_free(index_path);
+        files_index_remove(path);
+        g_print("perform_delete_row: updated files_index.txt\n");
     }
 
+    if (!parent_window) return;
+
+    /* Remove the item from the sidebar model and filter index; its row goes with it */
+    sidebar_remove_file(parent_window, item);
+    g_print("perform_delete_row: removed item from files list\n");
+
     /* Hide versions list if present on the same toplevel window */
-    GtkWidget *toplevel = gtk_widget_get_ancestor(row, GTK_TYPE_WINDOW);
-    if (toplevel) {
-        GtkWidget *versions_list = g_object_get_data(G_OBJECT(toplevel), "versions-list");
-        if (versions_list) {
-            extern void clear_list_box_widget(GtkWidget *box_widget);
-            clear_list_box_widget(versions_list);
-            gtk_widget_set_visible(versions_list, FALSE);
-            g_print("perform_delete_row: cleared and hid versions list\n");
-        }
+    GtkWidget *versions_list = g_object_get_data(G_OBJECT(parent_window), "versions-list");
+    GListStore *versions_store = g_object_get_data(G_OBJECT(parent_window), "versions-store");
+    if (versions_list && versions_store) {
+        g_list_store_remove_all(versions_store);
+        gtk_widget_set_visible(versions_list, FALSE);
+        g_print("perform_delete_row: cleared and hid versions list\n");
     }
 }
 
-typedef struct { GtkWidget *row; GtkWidget *dialog; } DeleteConfirmData;
+typedef struct { GtkWindow *window; DeltaFileItem *item; GtkWidget *dialog; } DeleteConfirmData;
+
+static void delete_confirm_data_free(DeleteConfirmData *d) {
+    if (!d) return;
+    if (d->dialog) gtk_window_destroy(GTK_WINDOW(d->dialog));
+    if (d->item) g_object_unref(d->item);
+    g_free(d);
+}
 
 static void on_delete_confirm_clicked(GtkButton *button, gpointer user_data) {
     DeleteConfirmData *d = (DeleteConfirmData *)user_data;
-    if (d && d->row) perform_delete_row(d->row);
-    if (d && d->dialog) gtk_window_destroy(GTK_WINDOW(d->dialog));
-    g_free(d);
+    if (d && d->item) perform_delete_row(d->window, d->item);
+    delete_confirm_data_free(d);
 }
 
 static void on_delete_cancel_clicked(GtkButton *button, gpointer user_data) {
-    DeleteConfirmData *d = (DeleteConfirmData *)user_data;
-    if (d && d->dialog) gtk_window_destroy(GTK_WINDOW(d->dialog));
-    g_free(d);
+    delete_confirm_data_free((DeleteConfirmData *)user_data);
 }
 
 static void delete_file(GSimpleAction *action, GVariant *parameter, gpointer user_data) {
-    GtkWidget *row = GTK_WIDGET(user_data);
-    if (!row) return;
+    MenuTarget *target = (MenuTarget *)user_data;
+    if (!DELTA_IS_FILE_ITEM(target->item)) return;
 
-    GtkWidget *toplevel = gtk_widget_get_ancestor(row, GTK_TYPE_WINDOW);
-    GtkWindow *parent_window = toplevel ? GTK_WINDOW(toplevel) : NULL;
+    GtkWindow *parent_window = target->window;
 
     /* Build simple confirmation dialog */
     DeleteConfirmData *d = g_new0(DeleteConfirmData, 1);
-    d->row = row;
+    d->window = parent_window;
+    d->item = DELTA_FILE_ITEM(g_object_ref(target->item));
 
     GtkWidget *dialog = gtk_window_new();
     d->dialog = dialog;
@@ -393,7 +409,7 @@ static void delete_file(GSimpleAction *action, GVariant *parameter, gpointer use
     gtk_widget_set_margin_start(vbox, 8);
     gtk_widget_set_margin_end(vbox, 8);
 
-    const char *path = g_object_get_data(G_OBJECT(row), "file-path");
+    const char *path = delta_file_item_get_path(d->item);
     const char *name = NULL;
     if (path) name = g_path_get_basename(path);
 
@@ -435,10 +451,172 @@ static void delete_file(GSimpleAction *action, GVariant *parameter, gpointer use
 }
 
 /* Record a version: copy the current file into data/versions and append index */
+/* Files above this size are recorded without line stats */
+#define STATS_MAX_BYTES (16 * 1024 * 1024)
+
+/* Line stats of a freshly stored version against the newest existing one
+ * (prev_stored, NULL for a first version). Runs on the record worker, so
+ * neither version is inserted into the cache: prev may be deleted while it
+ * is read, and next is not indexed yet, so no removal would evict them. */
+static gboolean compute_version_stats(const char *prev_stored, GBytes *next, VersionStats *stats) {
+    GBytes *prev = NULL;
+    if (prev_stored) {
+        prev = version_cache_get_uncached(prev_stored);
+        if (!prev) return FALSE;
+    }
+    if (!next) {
+        if (prev) g_bytes_unref(prev);
+        return FALSE;
+    }
+
+    gsize prev_len = 0, next_len = 0;
+    const char *prev_data = prev ? g_bytes_get_data(prev, &prev_len) : "";
+    const char *next_data = g_bytes_get_data(next, &next_len);
+    /* Line counts say nothing about binary contents */
+    gboolean ok = prev_len <= STATS_MAX_BYTES && next_len <= STATS_MAX_BYTES &&
+                  !diff_is_binary(prev_data, prev_len) && !diff_is_binary(next_data, next_len);
+    if (ok) {
+        guint added, removed, changed;
+        diff_line_stats(prev_data, prev_len, next_data, next_len, &added, &removed, &changed);
+        stats->added = added;
+        stats->removed = removed;
+        stats->changed = changed;
+    }
+    if (prev) g_bytes_unref(prev);
+    return ok;
+}
+
+typedef struct {
+    gchar *path;
+    gchar *dest_name;
+    gchar *dest_path;
+    gchar *timestamp;
+    gsize inline_max;
+    const char *prev_stored;  /* newest version when recording started; interned, NULL if none */
+    SnapshotCheck *check;
+    GBytes *inline_contents;  /* out: contents for the inline pack instead of a file */
+    gboolean copied;          /* out: dest_path was written */
+    gchar *error;             /* out: why nothing was stored */
+    VersionStats stats;       /* out: valid if has_stats */
+    gboolean has_stats;
+} RecordJob;
+
+static void record_job_free(RecordJob *job) {
+    g_free(job->path);
+    g_free(job->dest_name);
+    g_free(job->dest_path);
+    g_free(job->timestamp);
+    if (job->check) {
+        SnapshotStamp stamp;
+        snapshot_check_finish(job->check, &stamp);
+    }
+    if (job->inline_contents) g_bytes_unref(job->inline_contents);
+    g_free(job->error);
+    g_free(job);
+}
+
+/* Worker: hashes the file and, if it changed, copies it into the store and counts its line changes */
+static void record_worker(GTask *task, gpointer source, gpointer task_data, GCancellable *cancellable) {
+    RecordJob *job = task_data;
+    snapshot_check_run(job->check);
+    if (!snapshot_check_changed(job->check)) {
+        g_task_return_boolean(task, TRUE);
+        return;
+    }
+
+    /* Tiny versions go into the inline pack instead of a file of their own */
+    if (job->inline_max > 0 && snapshot_check_stamp(job->check)->size <= job->inline_max) {
+        gchar *contents = NULL;
+        gsize len = 0;
+        if (g_file_get_contents(job->path, &contents, &len, NULL) && len <= job->inline_max) {
+            job->inline_contents = g_bytes_new_take(contents, len);
+            contents = NULL;
+        }
+        g_free(contents);
+    }
+    if (!job->inline_contents) {
+        GError *error = NULL;
+        GFile *src = g_file_new_for_path(job->path);
+        GFile *dest = g_file_new_for_path(job->dest_path);
+        job->copied = g_file_copy(src, dest, G_FILE_COPY_NONE, NULL, NULL, NULL, &error);
+        if (!job->copied) job->error = g_strdup(error ? error->message : "unknown");
+        g_clear_error(&error);
+        g_object_unref(src);
+        g_object_unref(dest);
+    }
+
+    GBytes *next = job->inline_contents ? g_bytes_ref(job->inline_contents)
+                 : job->copied ? version_cache_get_uncached(job->dest_name) : NULL;
+    if (next) {
+        job->has_stats = compute_version_stats(job->prev_stored, next, &job->stats);
+        g_bytes_unref(next);
+    }
+    g_task_return_boolean(task, TRUE);
+}
+
+/* Main loop: settles the check, then indexes what the worker stored */
+static void on_record_done(GObject *source, GAsyncResult *result, gpointer user_data) {
+    RecordJob *job = g_task_get_task_data(G_TASK(result));
+    SnapshotStamp stamp;
+    gboolean unchanged = snapshot_check_finish(job->check, &stamp);
+    job->check = NULL;
+    if (unchanged || (!job->copied && !job->inline_contents && !job->error)) {
+        /* An identical version may have been recorded while this one was hashed */
+        if (job->copied) g_remove(job->dest_path);
+        g_print("record_version: %s is unchanged since its last version\n", job->path);
+        return;
+    }
+
+    /* Stored names only resolve to the second, so a second recording within
+     * it would take the first one's name */
+    if (version_index_lookup_stored(job->dest_name, NULL)) {
+        if (job->copied) g_remove(job->dest_path);
+        g_printerr("record_version: %s was already recorded as %s this second\n", job->path, job->dest_name);
+        return;
+    }
+
+    gboolean stored = job->copied;
+    if (job->inline_contents) {
+        gsize len;
+        const char *contents = g_bytes_get_data(job->inline_contents, &len);
+        stored = inline_store_add(job->dest_name, contents, len);
+        GError *error = NULL;
+        if (!stored) stored = g_file_set_contents(job->dest_path, contents, (gssize)len, &error);
+        if (!stored) job->error = g_strdup(error ? error->message : "unknown");
+        g_clear_error(&error);
+    }
+    if (!stored) {
+        g_printerr("record_version: copy failed: %s\n", job->error);
+        return;
+    }
+
+    /* Append to the versions index (original|stored|timestamp) */
+    version_index_append(job->path, job->dest_name, job->timestamp, stamp.hash, job->has_stats ? &job->stats : NULL);
+    snapshot_cache_note_recorded(job->path, job->dest_name, &stamp);
+    if (stamp.changed_bytes != G_MAXUINT64) {
+        g_print("record_version: %s: %" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT " bytes changed\n",
+                job->path, stamp.changed_bytes, stamp.size);
+    }
+    /* Expire older versions of this file according to the retention rules */
+    retention_note_recorded(job->path);
+
+    /* The versions view picks the new entry up from the index's change event */
+}
+
 static void record_version(GSimpleAction *action, GVariant *parameter, gpointer user_data) {
-    GtkWidget *widget = GTK_WIDGET(user_data);
-    const char *path = g_object_get_data(G_OBJECT(widget), "file-path");
-    if (!path) { g_printerr("record_version: no file path\n"); return; }
+    MenuTarget *target = (MenuTarget *)user_data;
+    const char *path = target->path;
+    if (!path || !DELTA_IS_FILE_ITEM(target->item)) { g_printerr("record_version: no file path\n"); return; }
+
+    /* Recording an unchanged file would only add a duplicate version. A stat
+     * match settles that here; otherwise the file is hashed on a worker. */
+    SnapshotCheck *check = snapshot_check_begin(path);
+    if (snapshot_check_unchanged_by_stat(check)) {
+        SnapshotStamp stamp;
+        snapshot_check_finish(check, &stamp);
+        g_print("record_version: %s is unchanged since its last version\n", path);
+        return;
+    }
 
     const char *data_dir = "data";
     gchar *versions_dir = g_build_filename(data_dir, "versions", NULL);
@@ -469,83 +647,31 @@ static void record_version(GSimpleAction *action, GVariant *parameter, gpointer
     gchar *dest_name;
     if (ext && *ext) dest_name = g_strdup_printf("%s_%s.%s", safe_base, timestr, ext);
     else dest_name = g_strdup_printf("%s_%s", safe_base, timestr);
-    gchar *dest_path = g_build_filename(versions_dir, dest_name, NULL);
-
-    GError *error = NULL;
-    GFile *src = g_file_new_for_path(path);
-    GFile *dest = g_file_new_for_path(dest_path);
-    if (!g_file_copy(src, dest, G_FILE_COPY_NONE, NULL, NULL, NULL, &error)) {
-        g_printerr("record_version: copy failed: %s\n", error ? error->message : "unknown");
-        g_clear_error(&error);
-    } else {
-#ifdef HAVE_JSON_GLIB
-        /* Update JSON index: data/versions_index.json */
-        gchar *index_path = g_build_filename(data_dir, "versions_index.json", NULL);
-        JsonParser *parser = json_parser_new();
-        JsonArray *arr = NULL;
-        if (g_file_test(index_path, G_FILE_TEST_EXISTS)) {
-            if (json_parser_load_from_file(parser, index_path, &error)) {
-                JsonNode *root = json_parser_get_root(parser);
-                if (JSON_NODE_HOLDS_ARRAY(root)) arr = json_node_get_array(root);
-            } else {
-                g_clear_error(&error);
-            }
-        }
-        if (!arr) arr = json_array_new();
-
-        JsonObject *obj = json_object_new();
-        json_object_set_string_member(obj, "original", path);
-        json_object_set_string_member(obj, "stored", dest_name);
-        json_object_set_string_member(obj, "timestamp", timestr);
-
-        JsonNode *obj_node = json_node_new(JSON_NODE_OBJECT);
-        json_node_set_object(obj_node, obj);
-        json_array_add_element(arr, obj_node);
-
-        /* write back */
-        JsonGenerator *gen = json_generator_new();
-        JsonNode *root_node = json_node_new(JSON_NODE_ARRAY);
-        json_node_set_array(root_node, arr);
-        json_generator_set_root(gen, root_node);
-        if (!json_generator_to_file(gen, index_path, &error)) {
-            g_printerr("Failed to write versions index: %s\n", error ? error->message : "unknown");
-            g_clear_error(&error);
-        }
 
-        if (gen) g_object_unref(gen);
-        if (root_node) json_node_free(root_node);
-        if (parser) g_object_unref(parser);
-
-        g_free(index_path);
-#else
-        /* Fallback: append to text index versions_index.txt (original|stored|timestamp) */
-        gchar *index_path = g_build_filename(data_dir, "versions_index.txt", NULL);
-        FILE *fi = fopen(index_path, "a");
-        if (fi) {
-            fprintf(fi, "%s|%s|%s\n", path, dest_name, timestr);
-            fclose(fi);
-        }
-        g_free(index_path);
-#endif
-
-        /* update UI: find versions-list on toplevel and repopulate */
-        GtkWidget *toplevel = gtk_widget_get_ancestor(widget, GTK_TYPE_WINDOW);
-        if (toplevel) {
-            GtkWidget *versions_list = g_object_get_data(G_OBJECT(toplevel), "versions-list");
-            if (versions_list) {
-                extern void populate_versions_for_path(GtkWindow *parent, GtkListBox *versions_list, const char *original_path);
-                populate_versions_for_path(GTK_WINDOW(toplevel), GTK_LIST_BOX(versions_list), path);
-            }
-        }
-    }
+    RecordJob *job = g_new0(RecordJob, 1);
+    job->path = g_strdup(path);
+    job->dest_name = dest_name;
+    job->dest_path = g_build_filename(versions_dir, dest_name, NULL);
+    job->timestamp = g_strdup(timestr);
+    job->inline_max = inline_store_max_bytes();
+    GArray *versions = version_index_get_versions(path);
+    if (versions && versions->len > 0) job->prev_stored = g_array_index(versions, VersionEntry, versions->len - 1).stored_name;
+    job->check = check;
+
+    GTask *task = g_task_new(NULL, NULL, on_record_done, NULL);
+    g_task_set_task_data(task, job, (GDestroyNotify)record_job_free);
+    scheduler_run_task(task, record_worker, SCHEDULER_PRIORITY_INTERACTIVE);
+    g_object_unref(task);
 
     g_free(versions_dir);
     g_free(safe_base);
-    g_free(dest_name);
-    g_free(dest_path);
     if (base) g_free(base);
-    if (src) g_object_unref(src);
-    if (dest) g_object_unref(dest);
+}
+
+static void annotate_file(GSimpleAction *action, GVariant *parameter, gpointer user_data) {
+    MenuTarget *target = (MenuTarget *)user_data;
+    if (!target->path) { g_printerr("annotate_file: no file path\n"); return; }
+    create_blame_window(target->window, target->path);
 }
 
 // An array of actions for the "sideabar-element" context
@@ -553,19 +679,53 @@ static const GActionEntry sidebar_element_menu_actions[] = {
     {"open_file", open, NULL, NULL, NULL},
     {"record_version", record_version, NULL, NULL, NULL},
     {"delete_file", delete_file, NULL, NULL, NULL},
-    {"rename_file",  _rename,  NULL, NULL, NULL}
+    {"rename_file",  _rename,  NULL, NULL, NULL},
+    {"annotate_file", annotate_file, NULL, NULL, NULL}
 };
 
 /* Actions for a version row (right pane) */
+void open_version_path(const char *path) {
+    gchar *stored_name = path ? g_path_get_basename(path) : NULL;
+    GBytes *inlined = inline_store_lookup(stored_name);
+    if (!inlined) {
+        open_file_path(path);
+        g_free(stored_name);
+        return;
+    }
+
+    /* An inline version has no file of its own; hand the application a temporary copy */
+    gchar *dir = g_build_filename(g_get_tmp_dir(), "deltac-versions", NULL);
+    gchar *tmp_path = g_build_filename(dir, stored_name, NULL);
+    gsize len;
+    const char *contents = g_bytes_get_data(inlined, &len);
+    GError *error = NULL;
+    g_mkdir_with_parents(dir, 0700);
+    if (g_file_set_contents(tmp_path, contents, (gssize)len, &error)) {
+        open_file_path(tmp_path);
+    } else {
+        g_printerr("open_version: cannot write %s: %s\n", tmp_path, error ? error->message : "unknown");
+        g_clear_error(&error);
+    }
+    g_bytes_unref(inlined);
+    g_free(tmp_path);
+    g_free(dir);
+    g_free(stored_name);
+}
+
 static void open_version(GSimpleAction *action, GVariant *parameter, gpointer user_data) {
-    /* user_data will be the version row widget */
-    open(action, parameter, user_data);
+    /* user_data is the menu target; its path is the stored version */
+    MenuTarget *target = (MenuTarget *)user_data;
+    open_version_path(target->path);
 }
 
-static void clear_comparison_selection() {
+static void set_compare_selected(GtkWindow *window, DeltaVersionItem *item, gboolean selected) {
+    delta_version_item_set_compare_selected(item, selected);
+    if (window) delta_list_store_refresh(g_object_get_data(G_OBJECT(window), "versions-store"), item);
+}
+
+static void clear_comparison_selection(GtkWindow *window) {
     for (GList *l = selected_for_comparison; l != NULL; l = l->next) {
-        GtkWidget *widget = GTK_WIDGET(l->data);
-        gtk_widget_remove_css_class(widget, "selected-for-compare");
+        set_compare_selected(window, DELTA_VERSION_ITEM(l->data), FALSE);
     }
     g_list_free_full(selected_for_comparison, g_object_unref);
     selected_for_comparison = NULL;
@@ -577,224 +737,137 @@ static void compare_versions(GSimpleAction *action, GVariant *parameter, gpointe
         return;
     }
 
-    GtkWidget *widget1 = GTK_WIDGET(selected_for_comparison->data);
-    GtkWidget *widget2 = GTK_WIDGET(selected_for_comparison->next->data);
+    MenuTarget *target = (MenuTarget *)user_data;
+    DeltaVersionItem *item1 = DELTA_VERSION_ITEM(selected_for_comparison->data);
+    DeltaVersionItem *item2 = DELTA_VERSION_ITEM(selected_for_comparison->next->data);
 
-    const char *path1 = g_object_get_data(G_OBJECT(widget1), "file-path");
-    const char *path2 = g_object_get_data(G_OBJECT(widget2), "file-path");
+    gchar *path1 = delta_version_item_dup_path(item1);
+    gchar *path2 = delta_version_item_dup_path(item2);
 
     if (path1 && path2) {
         g_print("Comparing '%s' and '%s'\n", path1, path2);
-        GtkWindow *parent = GTK_WINDOW(gtk_widget_get_ancestor(widget1, GTK_TYPE_WINDOW));
-        create_diff_window(parent, path1, path2, GTK_LIST_BOX_ROW(widget2));
+        create_diff_window(target->window, path1, path2);
     } else {
         g_printerr("Could not get paths for comparison\n");
     }
-    clear_comparison_selection();
+    g_free(path1);
+    g_free(path2);
+    clear_comparison_selection(target->window);
 }
 
 static void select_for_comparison(GSimpleAction *action, GVariant *parameter, gpointer user_data) {
-    GtkWidget *widget = GTK_WIDGET(user_data);
+    MenuTarget *target = (MenuTarget *)user_data;
+    if (!DELTA_IS_VERSION_ITEM(target->item)) return;
+    DeltaVersionItem *item = DELTA_VERSION_ITEM(target->item);
 
-    if (g_list_find(selected_for_comparison, widget)) {
+    if (g_list_find(selected_for_comparison, item)) {
         // Already selected, so unselect it
-        gtk_widget_remove_css_class(widget, "selected-for-compare");
-        selected_for_comparison = g_list_remove(selected_for_comparison, widget);
-        g_object_unref(widget);
+        set_compare_selected(target->window, item, FALSE);
+        selected_for_comparison = g_list_remove(selected_for_comparison, item);
+        g_object_unref(item);
     } else {
         // Not selected, so add it
-        gtk_widget_add_css_class(widget, "selected-for-compare");
-        selected_for_comparison = g_list_prepend(selected_for_comparison, widget);
-        g_object_ref(widget);
+        selected_for_comparison = g_list_prepend(selected_for_comparison, g_object_ref(item));
+        set_compare_selected(target->window, item, TRUE);
 
         // If we now have more than 2 items, remove the oldest one
         if (g_list_length(selected_for_comparison) > 2) {
             GList *last = g_list_last(selected_for_comparison);
-            GtkWidget *last_widget = GTK_WIDGET(last->data);
-            gtk_widget_remove_css_class(last_widget, "selected-for-compare");
-            g_object_unref(last_widget);
+            DeltaVersionItem *last_item = DELTA_VERSION_ITEM(last->data);
+            set_compare_selected(target->window, last_item, FALSE);
+            g_object_unref(last_item);
             selected_for_comparison = g_list_delete_link(selected_for_comparison, last);
         }
     }
 }
 
-// Data for repopulating versions list after deletion
-typedef struct {
-    GtkWindow *window;
-    GtkListBox *versions_list;
-    gchar *original_path;
-} RepopulateData;
-
-static gboolean repopulate_versions_idle(gpointer user_data) {
-    RepopulateData *data = (RepopulateData *)user_data;
-    if (data && data->window && data->versions_list && data->original_path) {
-        extern void populate_versions_for_path(GtkWindow *parent, GtkListBox *versions_list, const char *original_path);
-        populate_versions_for_path(data->window, data->versions_list, data->original_path);
-    }
-    if (data) {
-        g_free(data->original_path);
-        g_free(data);
-    }
-    return G_SOURCE_REMOVE;
-}
-
 static void delete_version(GSimpleAction *action, GVariant *parameter, gpointer user_data) {
-    GtkWidget *row = GTK_WIDGET(user_data);
-    const char *vpath = g_object_get_data(G_OBJECT(row), "version-path");
-    if (!vpath) return;
-
-    // Store information we need before destroying anything
-    GtkWidget *toplevel = gtk_widget_get_ancestor(row, GTK_TYPE_WINDOW);
-    const char *original_path = NULL;
-    GtkWidget *versions_list = NULL;
-    
-    if (toplevel) {
-        original_path = g_object_get_data(G_OBJECT(toplevel), "original-path");
-        versions_list = g_object_get_data(G_OBJECT(toplevel), "versions-list");
-    }
+    MenuTarget *target = (MenuTarget *)user_data;
+    if (!DELTA_IS_VERSION_ITEM(target->item) || !target->path) return;
 
-    // Duplicate the path since vpath is stored on the row which will be destroyed
-    gchar *vpath_copy = g_strdup(vpath);
+    gchar *vpath_copy = g_strdup(target->path);
+    gchar *stored_name = g_path_get_basename(vpath_copy);
     
-    // Destroy the popover menu before attempting to remove the row
-    GtkWidget *popover = g_object_get_data(G_OBJECT(row), "popover");
+    // Destroy the popover menu before the list changes under it
+    GtkWidget *popover = g_object_get_data(G_OBJECT(target->view), "popover");
     if (popover && GTK_IS_WIDGET(popover)) {
         gtk_popover_popdown(GTK_POPOVER(popover));
         gtk_widget_unparent(popover);
-        g_object_set_data(G_OBJECT(row), "popover", NULL);
+        g_object_set_data(G_OBJECT(target->view), "popover", NULL);
     }
 
     // Try to remove the file (use _wremove on Windows for better Unicode support)
+    // An inline version has no file; its tombstone is all there is to write
+    int result = 0;
+    if (!inline_store_contains(stored_name)) {
 #if defined(_WIN32) || defined(__MINGW32__)
-    wchar_t *wpath = g_utf8_to_utf16(vpath_copy, -1, NULL, NULL, NULL);
-    int result = -1;
-    if (wpath) {
-        result = _wremove(wpath);
-        g_free(wpath);
-    }
+        wchar_t *wpath = g_utf8_to_utf16(vpath_copy, -1, NULL, NULL, NULL);
+        result = -1;
+        if (wpath) {
+            result = _wremove(wpath);
+            g_free(wpath);
+        }
 #else
-    int result = remove(vpath_copy);
+        result = remove(vpath_copy);
 #endif
+    }
 
     if (result == 0) {
         g_print("delete_version: successfully removed %s\n", vpath_copy);
 
-        gchar *stored_basename = g_path_get_basename(vpath_copy);
-
-#ifdef HAVE_JSON_GLIB
-        /* Update JSON index: data/versions_index.json */
-        const char *data_dir = "data";
-        gchar *index_path = g_build_filename(data_dir, "versions_index.json", NULL);
-        JsonParser *parser = json_parser_new();
-        JsonArray *arr = NULL;
-        GError *error = NULL;
-
-        if (g_file_test(index_path, G_FILE_TEST_EXISTS)) {
-            if (json_parser_load_from_file(parser, index_path, &error)) {
-                JsonNode *root = json_parser_get_root(parser);
-                if (JSON_NODE_HOLDS_ARRAY(root)) {
-                    arr = json_node_get_array(root);
-                    JsonArray *new_arr = json_array_new();
-
-                    for (guint i = 0; i < json_array_get_length(arr); i++) {
-                        JsonNode *elem = json_array_get_element(arr, i);
-                        if (JSON_NODE_HOLDS_OBJECT(elem)) {
-                            JsonObject *obj = json_node_get_object(elem);
-                            const char *stored = json_object_get_string_member(obj, "stored");
-                            if (g_strcmp0(stored, stored_basename) != 0) {
-                                json_array_add_element(new_arr, json_node_copy(elem));
-                            }
-                        }
-                    }
-
-                    // Write back the new array
-                    JsonGenerator *gen = json_generator_new();
-                    JsonNode *root_node = json_node_new(JSON_NODE_ARRAY);
-                    json_node_set_array(root_node, new_arr);
-                    json_generator_set_root(gen, root_node);
-                    json_generator_to_file(gen, index_path, NULL);
-                    g_object_unref(gen);
-                    json_node_free(root_node);
-                }
-            } else {
-                g_clear_error(&error);
-            }
-        }
-        if (parser) g_object_unref(parser);
-        g_free(index_path);
-#else
-        /* Fallback index: data/versions_index.txt */
-        const char *data_dir = "data";
-        gchar *index_path = g_build_filename(data_dir, "versions_index.txt", NULL);
-        if (stored_basename && g_file_test(index_path, G_FILE_TEST_EXISTS)) {
-            GPtrArray *lines = g_ptr_array_new_with_free_func(g_free);
-            FILE *f = fopen(index_path, "r");
-            if (f) {
-                char buf[4096];
-                while (fgets(buf, sizeof(buf), f)) {
-                    char *trimmed = g_strdup(buf);
-                    if (!trimmed) continue;
-                    char *nl = strpbrk(trimmed, "\r\n");
-                    if (nl) *nl = '\0';
-
-                    gboolean keep = TRUE;
-                    char *sep1 = strchr(trimmed, '|');
-                    if (sep1) {
-                        char *sep2 = strchr(sep1 + 1, '|');
-                        if (sep2) {
-                            *sep2 = '\0';
-                            const char *stored = sep1 + 1;
-                            if (g_strcmp0(stored, stored_basename) == 0) {
-                                keep = FALSE;
-                            }
-                            *sep2 = '|';
-                        }
-                    }
-
-                    if (keep) {
-                        g_ptr_array_add(lines, trimmed);
-                    } else {
-                        g_free(trimmed);
-                    }
-                }
-                fclose(f);
-            }
+        /* Tombstone the version in the index; compaction reclaims the line later */
+        if (stored_name) version_index_remove(stored_name);
 
-            FILE *fw = fopen(index_path, "w");
-            if (fw) {
-                for (guint i = 0; i < lines->len; ++i) {
-                    const char *line = g_ptr_array_index(lines, i);
-                    fprintf(fw, "%s\n", line);
-                }
-                fclose(fw);
-            }
-
-            g_ptr_array_free(lines, TRUE);
-        }
-        g_free(index_path);
-#endif
-
-        if (stored_basename) g_free(stored_basename);
-
-        /* Schedule repopulation in an idle callback to avoid issues with widget destruction */
-        if (toplevel && original_path && versions_list) {
-            RepopulateData *data = g_new0(RepopulateData, 1);
-            data->window = GTK_WINDOW(toplevel);
-            data->versions_list = GTK_LIST_BOX(versions_list);
-            data->original_path = g_strdup(original_path);
-            g_idle_add(repopulate_versions_idle, data);
-        }
+        /* The tombstone's change event removes the row from the versions view */
     } else {
         int err = errno;
         g_printerr("delete_version: failed to remove %s: %s (errno=%d)\n", 
                    vpath_copy, strerror(err), err);
     }
     
+    g_free(stored_name);
     g_free(vpath_copy);
 }
 
+static void on_checkout_folder_chosen(GObject *source, GAsyncResult *result, gpointer user_data) {
+    DeltaVersionItem *item = DELTA_VERSION_ITEM(user_data);
+    GFile *folder = gtk_file_dialog_select_folder_finish(GTK_FILE_DIALOG(source), result, NULL);
+    gchar *dir = folder ? g_file_get_path(folder) : NULL;
+    const char *original = version_index_path_for_id(delta_version_item_get_file_id(item));
+    if (dir && original) {
+        gchar *name = g_path_get_basename(original);
+        gchar *target = g_build_filename(dir, name, NULL);
+        GError *error = NULL;
+        static const char *const methods[] = { "failed", "reflinked", "hard-linked (read-only)", "copied" };
+        CheckoutMethod method = checkout_version(delta_version_item_get_stored_name(item), target, TRUE, &error);
+        if (method != CHECKOUT_FAILED) {
+            g_print("Checked out %s to %s: %s\n", delta_version_item_get_stored_name(item), target, methods[method]);
+        } else {
+            g_printerr("Check out to %s failed: %s\n", target, error ? error->message : "unknown error");
+            g_clear_error(&error);
+        }
+        g_free(target);
+        g_free(name);
+    }
+    g_free(dir);
+    if (folder) g_object_unref(folder);
+    g_object_unref(item);
+}
+
+/* Exposes the version under its original name in a chosen directory,
+ * sharing storage with data/versions when the filesystem allows it */
+static void checkout_version_action(GSimpleAction *action, GVariant *parameter, gpointer user_data) {
+    MenuTarget *target = (MenuTarget *)user_data;
+    if (!DELTA_IS_VERSION_ITEM(target->item)) return;
+    GtkFileDialog *dialog = gtk_file_dialog_new();
+    gtk_file_dialog_set_title(dialog, "Check Out To");
+    gtk_file_dialog_select_folder(dialog, target->window, NULL, on_checkout_folder_chosen, g_object_ref(target->item));
+    g_object_unref(dialog);
+}
+
 static const GActionEntry version_element_menu_actions[] = {
     {"open_version", open_version, NULL, NULL, NULL},
+    {"checkout_version", checkout_version_action, NULL, NULL, NULL},
     {"delete_version", delete_version, NULL, NULL, NULL},
     {"select_for_comparison", select_for_comparison, NULL, NULL, NULL},
     {"compare_versions", compare_versions, NULL, NULL, NULL}
@@ -812,12 +885,17 @@ void on_widget_right_click(GtkGestureClick *gesture,
     
     // --- 1. Get Context and Widget ---
     
-    // Get the widget that the gesture is attached to
+    // Get the list view that the gesture is attached to
     GtkWidget *widget = gtk_event_controller_get_widget(GTK_EVENT_CONTROLLER(gesture));
     
     // Get the top-level window to add actions to
     GtkWidget *toplevel = gtk_widget_get_ancestor(widget, GTK_TYPE_WINDOW);
 
+    // Resolve the row under the pointer; clicks on empty space get no menu
+    GObject *item = item_at_point(widget, x, y);
+    if (!item || !toplevel) return;
+    menu_target_set(GTK_WINDOW(toplevel), widget, item);
+
     // This is the MOST IMPORTANT line:
     // We cast the generic 'user_data' pointer to the string we passed.
     const char *context = (const char *)user_data;
@@ -840,14 +918,15 @@ void on_widget_right_click(GtkGestureClick *gesture,
         g_action_map_add_action_entries(G_ACTION_MAP(toplevel),
                                         sidebar_element_menu_actions,
                                         G_N_ELEMENTS(sidebar_element_menu_actions),
-                                        widget); // Pass widget to the actions
+                                        &menu_target); // Pass the clicked item to the actions
         
         // Build the menu model
     g_menu_append(menu_model, "Open File", "win.open_file");
     g_menu_append(menu_model, "Record This Version", "win.record_version");
+    g_menu_append(menu_model, "Annotate Lines", "win.annotate_file");
     g_menu_append(menu_model, "Rename File", "win.rename_file");
     g_menu_append(menu_model, "Delete File", "win.delete_file");
-    clear_comparison_selection();
+    clear_comparison_selection(GTK_WINDOW(toplevel));
 
     }
     else if (g_strcmp0(context, "version-element") == 0) {
@@ -855,8 +934,9 @@ void on_widget_right_click(GtkGestureClick *gesture,
         g_action_map_add_action_entries(G_ACTION_MAP(toplevel),
                                         version_element_menu_actions,
                                         G_N_ELEMENTS(version_element_menu_actions),
-                                        widget);
+                                        &menu_target);
         g_menu_append(menu_model, "Open Version", "win.open_version");
+        g_menu_append(menu_model, "Check Out to Directory...", "win.checkout_version");
         g_menu_append(menu_model, "Select for Compare", "win.select_for_comparison");
         
         // The 'Compare' item is only enabled if exactly two items are selected
@@ -873,7 +953,7 @@ void on_widget_right_click(GtkGestureClick *gesture,
         
         // No actions to add, just build a simple model
         g_menu_append(menu_model, "No actions for this widget", NULL); // NULL = greyed out
-        clear_comparison_selection();
+        clear_comparison_selection(GTK_WINDOW(toplevel));
     }
 
 
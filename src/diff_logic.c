@@ -0,0 +1,372 @@
+#include "diff_logic.h"
+#include <gtk/gtk.h>
+#include <string.h>
+
+struct _DiffInterner {
+    GHashTable *ids;      /* DiffKey (text in chunk) -> id */
+    GStringChunk *chunk;
+    guint32 next_id;
+};
+
+/* Length-delimited key, so tokens may contain NUL bytes */
+typedef struct {
+    const char *text;
+    gsize len;
+} DiffKey;
+
+static guint diff_key_hash(gconstpointer key) {
+    const DiffKey *k = key;
+    guint32 h = 2166136261u; /* FNV-1a */
+    for (gsize i = 0; i < k->len; i++) {
+        h ^= (guchar)k->text[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static gboolean diff_key_equal(gconstpointer a, gconstpointer b) {
+    const DiffKey *x = a, *y = b;
+    return x->len == y->len && memcmp(x->text, y->text, x->len) == 0;
+}
+
+DiffInterner *diff_interner_new(void) {
+    DiffInterner *interner = g_new0(DiffInterner, 1);
+    interner->ids = g_hash_table_new_full(diff_key_hash, diff_key_equal, g_free, NULL);
+    interner->chunk = g_string_chunk_new(64 * 1024);
+    interner->next_id = 1;
+    return interner;
+}
+
+void diff_interner_free(DiffInterner *interner) {
+    if (!interner) return;
+    g_hash_table_destroy(interner->ids);
+    g_string_chunk_free(interner->chunk);
+    g_free(interner);
+}
+
+guint32 diff_interner_intern(DiffInterner *interner, const char *text, gsize len) {
+    DiffKey probe = { text, len };
+    gpointer id = g_hash_table_lookup(interner->ids, &probe);
+    if (id) return GPOINTER_TO_UINT(id);
+    /* Only first sightings are copied */
+    DiffKey *key = g_new(DiffKey, 1);
+    key->text = g_string_chunk_insert_len(interner->chunk, text, (gssize)len);
+    key->len = len;
+    guint32 new_id = interner->next_id++;
+    g_hash_table_insert(interner->ids, key, GUINT_TO_POINTER(new_id));
+    return new_id;
+}
+
+void diff_tokenize_lines(DiffInterner *interner, const char *text, gsize len,
+                         GArray *tokens, GArray *offsets) {
+    gsize pos = 0;
+    while (pos < len) {
+        const char *nl = memchr(text + pos, '\n', len - pos);
+        gsize end = nl ? (gsize)(nl - text) + 1 : len;
+        guint32 id = diff_interner_intern(interner, text + pos, end - pos);
+        g_array_append_val(tokens, id);
+        if (offsets) {
+            guint off = (guint)pos;
+            g_array_append_val(offsets, off);
+        }
+        pos = end;
+    }
+    if (offsets) {
+        guint off = (guint)len;
+        g_array_append_val(offsets, off);
+    }
+}
+
+void diff_line_offsets(const char *text, gsize len, GArray *offsets) {
+    gsize pos = 0;
+    while (pos < len) {
+        const char *nl = memchr(text + pos, '\n', len - pos);
+        guint off = (guint)pos;
+        g_array_append_val(offsets, off);
+        pos = nl ? (gsize)(nl - text) + 1 : len;
+    }
+    guint off = (guint)len;
+    g_array_append_val(offsets, off);
+}
+
+static gboolean is_blank_byte(guchar c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v';
+}
+
+/* FNV-1a over the line as flags see it; nothing is copied */
+static guint64 hash_line(const char *line, gsize len, DiffNormalizeFlags flags) {
+    const guchar *p = (const guchar *)line;
+    gsize end = len;
+    /* Any of these also drops the terminator, so "\r\n", "\n" and a missing
+     * final newline compare equal */
+    if (flags & (DIFF_IGNORE_LINE_ENDINGS | DIFF_IGNORE_TRAILING_SPACE | DIFF_IGNORE_ALL_SPACE)) {
+        if (end > 0 && p[end - 1] == '\n') end--;
+        if (end > 0 && p[end - 1] == '\r') end--;
+    }
+    if (flags & DIFF_IGNORE_TRAILING_SPACE) {
+        while (end > 0 && is_blank_byte(p[end - 1])) end--;
+    }
+    guint64 h = 14695981039346656037ULL;
+    for (gsize i = 0; i < end; ++i) {
+        guchar c = p[i];
+        if ((flags & DIFF_IGNORE_ALL_SPACE) && is_blank_byte(c)) continue;
+        if (flags & DIFF_IGNORE_CASE) c = (guchar)g_ascii_tolower(c);
+        h = (h ^ c) * 1099511628211ULL;
+    }
+    return h;
+}
+
+void diff_hash_lines(const char *text, GArray *offsets, DiffNormalizeFlags flags, GArray *hashes) {
+    for (guint i = 0; i + 1 < offsets->len; ++i) {
+        guint start = g_array_index(offsets, guint, i);
+        guint end = g_array_index(offsets, guint, i + 1);
+        guint64 h = hash_line(text + start, end - start, flags);
+        g_array_append_val(hashes, h);
+    }
+}
+
+/*
+ * Sub-line tokenizers. Each granularity is a 256-entry byte class table run
+ * through one inlined kernel: bytes of the same joining class form a token,
+ * TOKEN_SINGLE bytes stand alone and TOKEN_TAIL bytes (UTF-8 continuations,
+ * character mode only) stay with the token before them. Every granularity
+ * gets its own copy of the kernel with its table and tail handling folded
+ * in, so the inner loop is a table load and a compare per byte.
+ */
+enum {
+    TOKEN_SINGLE,
+    TOKEN_TAIL,
+    TOKEN_WORD,   /* first joining class */
+    TOKEN_SPACE
+};
+
+enum { CLASSES_WORDS, CLASSES_CHARS, CLASSES_CODE, N_CLASS_TABLES };
+
+static guint8 class_tables[N_CLASS_TABLES][256];
+
+static void init_class_tables(void) {
+    static gsize initialized = 0;
+    if (!g_once_init_enter(&initialized)) return;
+    for (guint c = 0; c < 256; ++c) {
+        gboolean blank = c == ' ' || c == '\t' || c == '\r';
+        /* Words: anything between blanks; newlines stand alone */
+        class_tables[CLASSES_WORDS][c] = blank ? TOKEN_SPACE : c == '\n' ? TOKEN_SINGLE : TOKEN_WORD;
+        /* Characters: one token per UTF-8 sequence */
+        class_tables[CLASSES_CHARS][c] = (c & 0xC0) == 0x80 ? TOKEN_TAIL : TOKEN_SINGLE;
+        /* Code: identifiers and numbers, blank runs, and each punctuation byte */
+        class_tables[CLASSES_CODE][c] = g_ascii_isalnum(c) || c == '_' || c >= 0x80 ? TOKEN_WORD
+                                      : c == ' ' || c == '\t' ? TOKEN_SPACE : TOKEN_SINGLE;
+    }
+    g_once_init_leave(&initialized, 1);
+}
+
+/* Plain inline is ignored without optimization, and the Makefile builds
+ * without -O; forcing it gives every DEFINE_TOKENIZER its own copy */
+#if defined(G_ALWAYS_INLINE)
+#define TOKENIZER_INLINE G_ALWAYS_INLINE static inline
+#elif defined(__GNUC__)
+#define TOKENIZER_INLINE static inline __attribute__((always_inline))
+#else
+#define TOKENIZER_INLINE static inline
+#endif
+
+TOKENIZER_INLINE void tokenize_classes(const guint8 *classes, gboolean tails, DiffInterner *interner,
+                                    const char *text, gsize len, GArray *tokens, GArray *offsets) {
+    const guchar *p = (const guchar *)text;
+    gsize pos = 0;
+    while (pos < len) {
+        guint8 c = classes[p[pos]];
+        gsize end = pos + 1;
+        if (c >= TOKEN_WORD) {
+            while (end < len && classes[p[end]] == c) end++;
+        }
+        if (tails) {
+            while (end < len && classes[p[end]] == TOKEN_TAIL) end++;
+        }
+        guint32 id = diff_interner_intern(interner, text + pos, end - pos);
+        g_array_append_val(tokens, id);
+        if (offsets) {
+            guint off = (guint)pos;
+            g_array_append_val(offsets, off);
+        }
+        pos = end;
+    }
+    if (offsets) {
+        guint off = (guint)len;
+        g_array_append_val(offsets, off);
+    }
+}
+
+#define DEFINE_TOKENIZER(name, table, tails) \
+    static void name(DiffInterner *interner, const char *text, gsize len, GArray *tokens, GArray *offsets) { \
+        tokenize_classes(class_tables[table], tails, interner, text, len, tokens, offsets); \
+    }
+
+DEFINE_TOKENIZER(tokenize_words, CLASSES_WORDS, FALSE)
+DEFINE_TOKENIZER(tokenize_chars, CLASSES_CHARS, TRUE)
+DEFINE_TOKENIZER(tokenize_code, CLASSES_CODE, FALSE)
+
+void diff_tokenize(DiffGranularity granularity, DiffInterner *interner, const char *text, gsize len,
+                   GArray *tokens, GArray *offsets) {
+    init_class_tables();
+    switch (granularity) {
+        case DIFF_TOKENS_LINES:
+            diff_tokenize_lines(interner, text, len, tokens, offsets);
+            break;
+        case DIFF_TOKENS_WORDS:
+            tokenize_words(interner, text, len, tokens, offsets);
+            break;
+        case DIFF_TOKENS_CHARS:
+            tokenize_chars(interner, text, len, tokens, offsets);
+            break;
+        case DIFF_TOKENS_CODE:
+            tokenize_code(interner, text, len, tokens, offsets);
+            break;
+    }
+}
+
+void diff_line_stats(const char *a, gsize a_len, const char *b, gsize b_len,
+                     guint *added, guint *removed, guint *changed) {
+    DiffInterner *interner = diff_interner_new();
+    GArray *tokens_a = g_array_new(FALSE, FALSE, sizeof(guint32));
+    GArray *tokens_b = g_array_new(FALSE, FALSE, sizeof(guint32));
+    diff_tokenize_lines(interner, a, a_len, tokens_a, NULL);
+    diff_tokenize_lines(interner, b, b_len, tokens_b, NULL);
+    GArray *ops = myers_diff((const guint32 *)tokens_a->data, tokens_a->len,
+                             (const guint32 *)tokens_b->data, tokens_b->len);
+
+    *added = *removed = *changed = 0;
+    guint deleted_run = 0;
+    for (guint i = 0; i < ops->len; ++i) {
+        const DiffOp *op = &g_array_index(ops, DiffOp, i);
+        if (op->type == DIFF_DELETE) {
+            deleted_run = op->length;
+            *removed += op->length;
+            continue;
+        }
+        if (op->type == DIFF_INSERT) {
+            /* Lines replaced in place count as changed, the rest as added or removed */
+            guint paired = MIN(deleted_run, op->length);
+            *changed += paired;
+            *removed -= paired;
+            *added += op->length - paired;
+        }
+        deleted_run = 0;
+    }
+
+    g_array_unref(ops);
+    g_array_unref(tokens_a);
+    g_array_unref(tokens_b);
+    diff_interner_free(interner);
+}
+
+/* Lines hashed together to find a moved block; shorter runs are left alone,
+ * as braces and blank lines would match all over the file */
+#define MOVE_MIN_LINES 3
+
+static guint32 window_hash(const guint32 *tokens) {
+    guint32 h = 2166136261u;
+    for (guint i = 0; i < MOVE_MIN_LINES; ++i) h = (h ^ tokens[i]) * 16777619u;
+    return h;
+}
+
+/* Per-token flags: set for tokens inside a run of the given type */
+static guint8 *mark_runs(GArray *ops, DiffOpType type, guint count) {
+    guint8 *marks = g_malloc0(count + 1);
+    for (guint i = 0; i < ops->len; ++i) {
+        const DiffOp *op = &g_array_index(ops, DiffOp, i);
+        if (op->type != type) continue;
+        memset(marks + (type == DIFF_DELETE ? op->a_start : op->b_start), 1, op->length);
+    }
+    return marks;
+}
+
+/* Whether all MOVE_MIN_LINES lines from marks[0] on are marked */
+static gboolean window_marked(const guint8 *marks) {
+    for (guint i = 0; i < MOVE_MIN_LINES; ++i)
+        if (!marks[i]) return FALSE;
+    return TRUE;
+}
+
+GArray *diff_find_moves(const guint32 *a, guint n, const guint32 *b, guint m, GArray *ops) {
+    GArray *moves = g_array_new(FALSE, FALSE, sizeof(DiffMove));
+    if (n < MOVE_MIN_LINES || m < MOVE_MIN_LINES) return moves;
+    guint8 *deleted = mark_runs(ops, DIFF_DELETE, n);   /* cleared once claimed by a move */
+    guint8 *inserted = mark_runs(ops, DIFF_INSERT, m);
+
+    /* Every window of deleted lines, keyed by its hash; the first one wins */
+    GHashTable *windows = g_hash_table_new(g_direct_hash, g_direct_equal);
+    guint run = 0;
+    for (guint i = 0; i < n; ++i) {
+        run = deleted[i] ? run + 1 : 0;
+        if (run < MOVE_MIN_LINES) continue;
+        guint start = i + 1 - MOVE_MIN_LINES;
+        gpointer key = GUINT_TO_POINTER(window_hash(a + start));
+        if (!g_hash_table_contains(windows, key)) g_hash_table_insert(windows, key, GUINT_TO_POINTER(start));
+    }
+
+    /* Walk the inserted lines; a window that matches deleted lines starts a
+     * move, which then grows as long as both sides keep agreeing */
+    guint j = 0;
+    while (j + MOVE_MIN_LINES <= m) {
+        gpointer value;
+        if (window_marked(inserted + j) &&
+            g_hash_table_lookup_extended(windows, GUINT_TO_POINTER(window_hash(b + j)), NULL, &value)) {
+            guint i = GPOINTER_TO_UINT(value);
+            guint len = 0;
+            while (i + len < n && j + len < m && deleted[i + len] && inserted[j + len] && a[i + len] == b[j + len]) len++;
+            if (len >= MOVE_MIN_LINES) {
+                DiffMove move = { i, j, len };
+                g_array_append_val(moves, move);
+                memset(deleted + i, 0, len);
+                j += len;
+                continue;
+            }
+        }
+        j++;
+    }
+
+    g_hash_table_unref(windows);
+    g_free(deleted);
+    g_free(inserted);
+    return moves;
+}
+
+/* Bytes examined by diff_is_binary(), in blocks of DETECT_BLOCK */
+#define DETECT_BYTES (64 * 1024)
+#define DETECT_BLOCK 4096
+
+/* Pure ASCII, checked eight bytes at a time */
+static gboolean block_is_ascii(const guint8 *p, gsize len) {
+    const guint64 high = 0x8080808080808080ULL;
+    gsize i = 0;
+    for (; i + 8 <= len; i += 8) {
+        guint64 w;
+        memcpy(&w, p + i, 8);
+        if (w & high) return FALSE;
+    }
+    for (; i < len; ++i) {
+        if (p[i] >= 0x80) return FALSE;
+    }
+    return TRUE;
+}
+
+gboolean diff_is_binary(const char *data, gsize len) {
+    gsize limit = MIN(len, (gsize)DETECT_BYTES);
+    if (memchr(data, '\0', limit)) return TRUE;
+    gsize pos = 0;
+    while (pos < limit) {
+        gsize n = MIN((gsize)DETECT_BLOCK, limit - pos);
+        if (!block_is_ascii((const guint8 *)data + pos, n)) {
+            /* Validate from here to the limit; a sequence cut by the limit is not an error */
+            const char *end = NULL;
+            if (!g_utf8_validate_len(data + pos, limit - pos, &end)) {
+                gsize rest = (gsize)((data + limit) - end);
+                return !(limit < len && rest < 4);
+            }
+            return FALSE;
+        }
+        pos += n;
+    }
+    return FALSE;
+}
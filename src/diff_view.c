@@ -1,15 +1,15 @@
 #include "diff_view.h"
 #include "diff_logic.h"
+#include "binary_delta.h"
+#include "merge.h"
+#include "inline_store.h"
+#include "scheduler.h"
 #include <gtk/gtk.h>
 #include <string.h>
 #include <gio/gio.h>
 #include "sidebar.h"
-#if defined(__has_include)
-# if __has_include(<json-glib/json-glib.h>)
-#  include <json-glib/json-glib.h>
-#  define HAVE_JSON_GLIB 1
-# endif
-#endif
+#include "version_index.h"
+#include "version_cache.h"
 #if defined(_WIN32) || defined(__MINGW32__)
 #include <windows.h>
 #endif
@@ -20,10 +20,15 @@ typedef struct {
     gchar *latest_file_path;
     gchar *original_file_path;
     GtkWindow *parent_window;
-    GtkListBox *versions_list;
-    GtkListBoxRow *version_row;  /* The version row to remove from UI */
 } RevertData;
 
+static void revert_data_free(RevertData *data) {
+    if (!data) return;
+    g_free(data->latest_file_path);
+    g_free(data->original_file_path);
+    g_free(data);
+}
+
 /* Forward declarations */
 
 static void on_revert_confirm_clicked(GtkButton *button, gpointer user_data);
@@ -32,162 +37,6 @@ static void on_revert_cancel_clicked(GtkButton *button, gpointer user_data);
 
 
 
-/* Helper function to remove a version file from the index */
-
-static void remove_version_from_index(const char *version_file_path) {
-
-    const char *data_dir = "data";
-
-    gchar *basename = g_path_get_basename(version_file_path);
-
-    
-
-#ifdef HAVE_JSON_GLIB
-
-    gchar *index_path = g_build_filename(data_dir, "versions_index.json", NULL);
-
-    if (g_file_test(index_path, G_FILE_TEST_EXISTS)) {
-
-        // JSON index handling
-
-        GError *error = NULL;
-
-        JsonParser *parser = json_parser_new();
-
-        if (json_parser_load_from_file(parser, index_path, &error)) {
-
-            JsonNode *root = json_parser_get_root(parser);
-
-            if (JSON_NODE_HOLDS_ARRAY(root)) {
-
-                JsonArray *array = json_node_get_array(root);
-
-                guint len = json_array_get_length(array);
-
-                for (guint i = 0; i < len; i++) {
-
-                    JsonNode *node = json_array_get_element(array, i);
-
-                    if (JSON_NODE_HOLDS_OBJECT(node)) {
-
-                        JsonObject *obj = json_node_get_object(node);
-
-                        const char *stored = json_object_get_string_member(obj, "stored");
-
-                        if (g_strcmp0(stored, basename) == 0) {
-
-                            json_array_remove_element(array, i);
-
-                            break;
-
-                        }
-
-                    }
-
-                }
-
-                JsonGenerator *generator = json_generator_new();
-
-                json_generator_set_root(generator, root);
-
-                json_generator_to_file(generator, index_path, NULL);
-
-                g_object_unref(generator);
-
-            }
-
-        }
-
-        g_object_unref(parser);
-
-        if (error) g_error_free(error);
-
-    }
-
-    g_free(index_path);
-
-#endif
-
-
-
-    /* Fallback: use text-based index */
-
-    gchar *index_path_txt = g_build_filename(data_dir, "versions_index.txt", NULL);
-
-    if (g_file_test(index_path_txt, G_FILE_TEST_EXISTS)) {
-
-        FILE *f = fopen(index_path_txt, "r");
-
-        GString *new_contents = g_string_new("");
-
-        if (f) {
-
-            char line[4096];
-
-            while (fgets(line, sizeof(line), f)) {
-
-                // Parse the line: orig|stored|ts
-
-                char *copy = g_strdup(line);
-
-                char *nl = strchr(copy, '\n');
-
-                if (nl) *nl = '\0';
-
-                char *p1 = strchr(copy, '|');
-
-                if (!p1) { g_free(copy); continue; }
-
-                *p1 = '\0';
-
-                char *p2 = strchr(p1 + 1, '|');
-
-                if (!p2) { g_free(copy); continue; }
-
-                *p2 = '\0';
-
-                const char *stored = p1 + 1;
-
-                if (g_strcmp0(stored, basename) != 0) {
-
-                    g_string_append(new_contents, line);
-
-                }
-
-                g_free(copy);
-
-            }
-
-            fclose(f);
-
-        }
-
-        // Write back the file
-
-        GError *error = NULL;
-
-        g_file_set_contents(index_path_txt, new_contents->str, new_contents->len, &error);
-
-        if (error) {
-
-            g_printerr("Error writing index file: %s\n", error->message);
-
-            g_error_free(error);
-
-        }
-
-        g_string_free(new_contents, TRUE);
-
-    }
-
-    g_free(index_path_txt);
-
-    g_free(basename);
-
-}
-
-
-
 /* Revert confirm callback - performs the actual revert */
 
 static void on_revert_confirm_clicked(GtkButton *button, gpointer user_data) {
@@ -195,37 +44,45 @@ static void on_revert_confirm_clicked(GtkButton *button, gpointer user_data) {
     RevertData *data = (RevertData *)user_data;
     
     if (!data || !data->latest_file_path || !data->original_file_path) {
-        if (data) {
-            g_free(data->latest_file_path);
-            g_free(data->original_file_path);
-        }
-        g_free(data);
+        revert_data_free(data);
         return;
     }
 
     g_print("Reverting: copying %s to %s\n", data->latest_file_path, data->original_file_path);
 
-    /* Copy the versioned file over the original file */
+    /* Copy the versioned file over the original file; an inline version is written from the index */
     GFile *src = g_file_new_for_path(data->latest_file_path);
     GFile *dest = g_file_new_for_path(data->original_file_path);
     GError *error = NULL;
+    gchar *stored_name = g_path_get_basename(data->latest_file_path);
+    GBytes *inlined = inline_store_lookup(stored_name);
+    g_free(stored_name);
+    gboolean reverted;
+    if (inlined) {
+        gsize len;
+        const char *contents = g_bytes_get_data(inlined, &len);
+        reverted = g_file_set_contents(data->original_file_path, contents, (gssize)len, &error);
+        g_bytes_unref(inlined);
+    } else {
+        /* Default permissions: a stored version may be read-only (see checkout.h) */
+        reverted = g_file_copy(src, dest, G_FILE_COPY_OVERWRITE | G_FILE_COPY_TARGET_DEFAULT_PERMS, NULL, NULL, NULL, &error);
+    }
 
-    if (!g_file_copy(src, dest, G_FILE_COPY_OVERWRITE, NULL, NULL, NULL, &error)) {
+    if (!reverted) {
         g_printerr("Error reverting file: %s\n", error->message);
         g_error_free(error);
         
         /* Clean up and return without deleting */
         g_object_unref(src);
         g_object_unref(dest);
-        g_free(data->latest_file_path);
-        g_free(data->original_file_path);
-        g_free(data);
-        
+
         /* Optionally, show an error dialog to the user */
         GtkAlertDialog *alert_dialog = gtk_alert_dialog_new("Failed to revert file. Please check permissions.");
         gtk_alert_dialog_show(alert_dialog, data->diff_window);
         g_object_unref(alert_dialog);
-        
+
+        revert_data_free(data);
+
         return;
     }
 
@@ -245,34 +102,25 @@ static void on_revert_confirm_clicked(GtkButton *button, gpointer user_data) {
     remove(data->latest_file_path);
 #endif
 
-    /* Remove from versions index */
-    remove_version_from_index(data->latest_file_path);
+    /* Remove from versions index; the versions view drops the row on the change event */
+    gchar *stored_basename = g_path_get_basename(data->latest_file_path);
+    version_index_remove(stored_basename);
+    g_free(stored_basename);
 
     g_print("Revert completed. Updating UI.\n");
     
-    /* Remove the specific version row from the UI */
-    if (data->versions_list && GTK_IS_LIST_BOX_ROW(data->version_row)) {
-        gtk_list_box_remove(data->versions_list, GTK_WIDGET(data->version_row));
-    }
-    
     /* Close the diff window */
     if (data->diff_window) {
         gtk_window_destroy(data->diff_window);
     }
 
-    g_free(data->latest_file_path);
-    g_free(data->original_file_path);
-    g_free(data);
+    revert_data_free(data);
 }
 
 /* Revert cancel callback */
 static void on_revert_cancel_clicked(GtkButton *button, gpointer user_data) {
     RevertData *data = (RevertData *)user_data;
-    if (data) {
-        if (data->latest_file_path) g_free(data->latest_file_path);
-        if (data->original_file_path) g_free(data->original_file_path);
-        g_free(data);
-    }
+    revert_data_free(data);
 }
 
 /* Revert button clicked - show confirmation dialog */
@@ -346,7 +194,687 @@ static void on_revert_button_clicked(GtkButton *button, gpointer user_data) {
     gtk_window_present(GTK_WINDOW(dialog));
 }
 
-void create_diff_window(GtkWindow* parent, const char* file1_path, const char* file2_path, GtkListBoxRow* version_row) {
+/* Data for merging a version into the current file */
+typedef struct {
+    gchar *original_path;
+    gchar *version_path;
+    const char *base_stored;     /* newest version; interned, resolved on the main thread */
+    const char *version_stored;  /* NULL if version_path is not a stored version */
+    GBytes *merged;
+    guint conflicts;
+} MergeData;
+
+static void merge_data_free(MergeData *data) {
+    g_free(data->original_path);
+    g_free(data->version_path);
+    if (data->merged) g_bytes_unref(data->merged);
+    g_free(data);
+}
+
+static void show_alert(GtkWindow *window, const char *message) {
+    GtkAlertDialog *alert_dialog = gtk_alert_dialog_new("%s", message);
+    gtk_alert_dialog_show(alert_dialog, window);
+    g_object_unref(alert_dialog);
+}
+
+static void merge_worker(GTask *task, gpointer source, gpointer task_data, GCancellable *cancellable) {
+    MergeData *data = task_data;
+    gchar *current = NULL;
+    gsize current_len = 0;
+    GBytes *base = version_cache_get(data->base_stored);
+    GBytes *version = version_cache_load(data->version_stored, data->version_path);
+    if (base && version && g_file_get_contents(data->original_path, &current, &current_len, NULL)) {
+        gsize base_len, version_len;
+        const char *base_data = g_bytes_get_data(base, &base_len);
+        const char *version_data = g_bytes_get_data(version, &version_len);
+        gchar *label = g_path_get_basename(data->version_path);
+        data->merged = merge_three_way(base_data, base_len, current, current_len, version_data, version_len,
+                                       "current", label, &data->conflicts);
+        g_free(label);
+    }
+    g_free(current);
+    if (base) g_bytes_unref(base);
+    if (version) g_bytes_unref(version);
+    g_task_return_boolean(task, data->merged != NULL);
+}
+
+static void on_merge_choice(GObject *source, GAsyncResult *result, gpointer user_data) {
+    MergeData *data = user_data;
+    int choice = gtk_alert_dialog_choose_finish(GTK_ALERT_DIALOG(source), result, NULL);
+    if (choice == 1) {
+        gsize len;
+        const char *merged = g_bytes_get_data(data->merged, &len);
+        GError *error = NULL;
+        if (g_file_set_contents(data->original_path, merged, (gssize)len, &error)) {
+            g_print("Merged %s into %s (%u conflicts)\n", data->version_path, data->original_path, data->conflicts);
+        } else {
+            g_printerr("Error writing merged file: %s\n", error->message);
+            g_error_free(error);
+        }
+    }
+    merge_data_free(data);
+}
+
+static void on_merge_done(GObject *source, GAsyncResult *result, gpointer user_data) {
+    GtkWindow *window = GTK_WINDOW(source);
+    MergeData *data = user_data;
+    if (!g_task_propagate_boolean(G_TASK(result), NULL)) {
+        show_alert(window, "Failed to read the files to merge.");
+        merge_data_free(data);
+        return;
+    }
+
+    gchar *detail = data->conflicts == 0
+        ? g_strdup("The changes merged cleanly.")
+        : g_strdup_printf("%u conflicting region%s will be marked with <<<<<<< and >>>>>>> lines "
+                          "for you to resolve.", data->conflicts, data->conflicts == 1 ? "" : "s");
+    GtkAlertDialog *dialog = gtk_alert_dialog_new("Write the merged result to the current file?");
+    gtk_alert_dialog_set_detail(dialog, detail);
+    const char *buttons[] = { "Cancel", "Write Merged File", NULL };
+    gtk_alert_dialog_set_buttons(dialog, buttons);
+    gtk_alert_dialog_set_cancel_button(dialog, 0);
+    gtk_alert_dialog_choose(dialog, window, NULL, on_merge_choice, data);
+    g_object_unref(dialog);
+    g_free(detail);
+}
+
+/* Merge button: brings the version's changes into the current file without
+ * dropping the edits made since the newest recorded version, which is the base */
+static void on_merge_button_clicked(GtkButton *button, gpointer user_data) {
+    GtkWindow *window = GTK_WINDOW(user_data);
+    const char *original_path = g_object_get_data(G_OBJECT(button), "original-path");
+    GArray *versions = version_index_get_versions(original_path);
+    if (!versions || versions->len == 0) {
+        show_alert(window, "There is no recorded version of the current file to merge against.");
+        return;
+    }
+
+    const VersionEntry *newest = &g_array_index(versions, VersionEntry, versions->len - 1);
+    MergeData *data = g_new0(MergeData, 1);
+    data->original_path = g_strdup(original_path);
+    data->version_path = g_strdup(g_object_get_data(G_OBJECT(button), "version-path"));
+    data->base_stored = newest->stored_name;
+    data->version_stored = version_cache_stored_name_for_path(data->version_path);
+
+    /* data goes to on_merge_done, which hands it on or frees it */
+    GTask *task = g_task_new(window, NULL, on_merge_done, data);
+    g_task_set_task_data(task, data, NULL);
+    scheduler_run_task(task, merge_worker, SCHEDULER_PRIORITY_INTERACTIVE);
+    g_object_unref(task);
+}
+
+/* Bytes shown from the start of a region in a binary comparison */
+#define BINARY_PREVIEW_BYTES 16
+
+/* Batches of finished runs reach the window at most this often */
+#define DIFF_BATCH_INTERVAL_US (50 * 1000)
+/* Hunks bigger than this on either side keep line-level highlighting only */
+#define REFINE_MAX_BYTES (64 * 1024)
+/* Character tokens are many per line; their diff gets a smaller budget */
+#define REFINE_MAX_CHAR_BYTES (8 * 1024)
+
+/* A changed block: lines deleted from a and replaced by lines in b.
+ * Word-level highlighting is computed the first time it is on screen. */
+typedef struct {
+    guint a_start, a_len;
+    guint b_start, b_len;
+    gboolean refined;
+} DiffHunk;
+
+/* One compare window's diff. Shared by the window, its workers and every
+ * batch in flight; GTK objects are only touched on the main thread and are
+ * dropped when the window closes, so the last unref may happen anywhere. */
+typedef struct {
+    gint ref_count;
+    gchar *file1_path;
+    gchar *file2_path;
+    /* Interned stored names of the sides that are stored versions, else NULL;
+     * resolved on the main thread, since the version index is not thread-safe */
+    const char *stored1;
+    const char *stored2;
+    /* Set by the first worker under lock, read-only once text1 is set */
+    GMutex lock;
+    GBytes *text1;
+    GBytes *text2;
+    GArray *lines1;  /* byte offset of every line start, plus the end */
+    GArray *lines2;
+    GHashTable *hashes1;  /* DiffNormalizeFlags -> GArray of guint64 line hashes; under lock */
+    GHashTable *hashes2;
+    /* Main thread; NULL once the window is gone */
+    GCancellable *cancellable;  /* of the current run */
+    guint generation;           /* bumped by every run, so stale batches are dropped */
+    DiffNormalizeFlags flags;
+    DiffGranularity granularity;  /* of the intra-line refinement */
+    GtkTextBuffer *buffer1;
+    GtkTextBuffer *buffer2;
+    GtkWidget *progress;
+    GtkTextView *view1;
+    GtkTextView *view2;
+    GtkAdjustment *vadjustment1;
+    GtkAdjustment *vadjustment2;
+    GArray *hunks;          /* DiffHunk in file order */
+    DiffOp last_delete;     /* a deletion that may pair with the next insertion */
+    gboolean has_last_delete;
+    guint refine_source;
+} DiffJob;
+
+/* One diff of the window's texts under one set of flags; owned by its worker */
+typedef struct {
+    DiffJob *job;
+    guint generation;
+    DiffNormalizeFlags flags;
+    GArray *batch;
+    GArray *ops;    /* every run so far, for the moved-block pass */
+    guint a_done;
+    guint b_done;
+    gint64 last_send;
+} DiffRun;
+
+typedef struct {
+    DiffJob *job;
+    guint generation;
+    GArray *ops;
+    GArray *moves;  /* DiffMove; final batch only */
+    guint a_done;
+    guint b_done;
+    gboolean finished;
+} DiffBatch;
+
+static DiffJob *diff_job_ref(DiffJob *job) {
+    g_atomic_int_inc(&job->ref_count);
+    return job;
+}
+
+static void diff_job_unref(DiffJob *job) {
+    if (!g_atomic_int_dec_and_test(&job->ref_count)) return;
+    g_object_unref(job->cancellable);
+    g_free(job->file1_path);
+    g_free(job->file2_path);
+    g_mutex_clear(&job->lock);
+    if (job->text1) g_bytes_unref(job->text1);
+    if (job->text2) g_bytes_unref(job->text2);
+    if (job->lines1) g_array_unref(job->lines1);
+    if (job->lines2) g_array_unref(job->lines2);
+    g_hash_table_unref(job->hashes1);
+    g_hash_table_unref(job->hashes2);
+    g_array_unref(job->hunks);
+    g_free(job);
+}
+
+static void diff_run_free(gpointer data) {
+    DiffRun *run = data;
+    diff_job_unref(run->job);
+    g_array_unref(run->batch);
+    g_array_unref(run->ops);
+    g_free(run);
+}
+
+static void diff_batch_free(gpointer data) {
+    DiffBatch *batch = data;
+    diff_job_unref(batch->job);
+    g_array_unref(batch->ops);
+    if (batch->moves) g_array_unref(batch->moves);
+    g_free(batch);
+}
+
+/* Appends lines [first, first + count) of one side to its buffer */
+static void append_lines(GtkTextBuffer *buffer, GBytes *text, GArray *lines, guint first, guint count, const char *tag) {
+    if (count == 0) return;
+    const char *data = g_bytes_get_data(text, NULL);
+    guint start = g_array_index(lines, guint, first);
+    guint end = g_array_index(lines, guint, first + count);
+    GtkTextIter iter;
+    gtk_text_buffer_get_end_iter(buffer, &iter);
+    if (tag) gtk_text_buffer_insert_with_tags_by_name(buffer, &iter, data + start, end - start, tag, NULL);
+    else gtk_text_buffer_insert(buffer, &iter, data + start, end - start);
+}
+
+/* Finds the iter for a byte offset of one side, searching lines [lo, hi) */
+static void iter_at_byte(GtkTextBuffer *buffer, GArray *lines, guint lo, guint hi, guint byte, GtkTextIter *iter) {
+    while (hi - lo > 1) {
+        guint mid = lo + (hi - lo) / 2;
+        if (g_array_index(lines, guint, mid) <= byte) lo = mid;
+        else hi = mid;
+    }
+    gtk_text_buffer_get_iter_at_line_index(buffer, iter, (gint)lo, (gint)(byte - g_array_index(lines, guint, lo)));
+}
+
+/* Tags the words of one side that the word diff found changed */
+static void tag_words(GtkTextBuffer *buffer, GArray *lines, guint first_line, guint n_lines,
+                      guint base, GArray *offsets, guint start, guint length, const char *tag) {
+    GtkTextIter s, e;
+    iter_at_byte(buffer, lines, first_line, first_line + n_lines, base + g_array_index(offsets, guint, start), &s);
+    iter_at_byte(buffer, lines, first_line, first_line + n_lines, base + g_array_index(offsets, guint, start + length), &e);
+    gtk_text_buffer_apply_tag_by_name(buffer, tag, &s, &e);
+}
+
+/* Token-level diff of one hunk at the chosen granularity, applied as a second layer of tags */
+static void refine_hunk(DiffJob *job, DiffHunk *hunk) {
+    hunk->refined = TRUE;
+    if (job->granularity == DIFF_TOKENS_LINES) return;
+    guint a0 = g_array_index(job->lines1, guint, hunk->a_start);
+    guint a1 = g_array_index(job->lines1, guint, hunk->a_start + hunk->a_len);
+    guint b0 = g_array_index(job->lines2, guint, hunk->b_start);
+    guint b1 = g_array_index(job->lines2, guint, hunk->b_start + hunk->b_len);
+    guint max_bytes = job->granularity == DIFF_TOKENS_CHARS ? REFINE_MAX_CHAR_BYTES : REFINE_MAX_BYTES;
+    if (a1 - a0 > max_bytes || b1 - b0 > max_bytes) return;
+
+    const char *text1 = g_bytes_get_data(job->text1, NULL);
+    const char *text2 = g_bytes_get_data(job->text2, NULL);
+    DiffInterner *interner = diff_interner_new();
+    GArray *tokens1 = g_array_new(FALSE, FALSE, sizeof(guint32));
+    GArray *tokens2 = g_array_new(FALSE, FALSE, sizeof(guint32));
+    GArray *offsets1 = g_array_new(FALSE, FALSE, sizeof(guint));
+    GArray *offsets2 = g_array_new(FALSE, FALSE, sizeof(guint));
+    diff_tokenize(job->granularity, interner, text1 + a0, a1 - a0, tokens1, offsets1);
+    diff_tokenize(job->granularity, interner, text2 + b0, b1 - b0, tokens2, offsets2);
+    GArray *ops = myers_diff((const guint32 *)tokens1->data, tokens1->len,
+                             (const guint32 *)tokens2->data, tokens2->len);
+
+    for (guint i = 0; i < ops->len; ++i) {
+        const DiffOp *op = &g_array_index(ops, DiffOp, i);
+        if (op->type == DIFF_DELETE)
+            tag_words(job->buffer1, job->lines1, hunk->a_start, hunk->a_len, a0, offsets1, op->a_start, op->length, "diff-delete-word");
+        else if (op->type == DIFF_INSERT)
+            tag_words(job->buffer2, job->lines2, hunk->b_start, hunk->b_len, b0, offsets2, op->b_start, op->length, "diff-insert-word");
+    }
+
+    g_array_unref(ops);
+    g_array_unref(tokens1);
+    g_array_unref(tokens2);
+    g_array_unref(offsets1);
+    g_array_unref(offsets2);
+    diff_interner_free(interner);
+}
+
+/* Lines of a text view currently on screen */
+static void visible_lines(GtkTextView *view, gint *first, gint *last) {
+    GdkRectangle rect;
+    GtkTextIter iter;
+    gtk_text_view_get_visible_rect(view, &rect);
+    gtk_text_view_get_line_at_y(view, &iter, rect.y, NULL);
+    *first = gtk_text_iter_get_line(&iter);
+    gtk_text_view_get_line_at_y(view, &iter, rect.y + rect.height, NULL);
+    *last = gtk_text_iter_get_line(&iter);
+}
+
+/* Refines the unrefined hunks overlapping lines [first, last] of one side */
+static void refine_range(DiffJob *job, gboolean side_b, gint first, gint last) {
+    guint lo = 0, hi = job->hunks->len;
+    /* First hunk ending after the first visible line; hunks are sorted on both sides */
+    while (lo < hi) {
+        guint mid = lo + (hi - lo) / 2;
+        DiffHunk *h = &g_array_index(job->hunks, DiffHunk, mid);
+        guint end = side_b ? h->b_start + h->b_len : h->a_start + h->a_len;
+        if (end <= (guint)first) lo = mid + 1;
+        else hi = mid;
+    }
+    for (guint i = lo; i < job->hunks->len; ++i) {
+        DiffHunk *h = &g_array_index(job->hunks, DiffHunk, i);
+        if ((side_b ? h->b_start : h->a_start) > (guint)last) break;
+        if (!h->refined) refine_hunk(job, h);
+    }
+}
+
+static gboolean refine_visible(gpointer user_data) {
+    DiffJob *job = user_data;
+    job->refine_source = 0;
+    if (!job->view1 || job->hunks->len == 0) return G_SOURCE_REMOVE;
+    gint first, last;
+    visible_lines(job->view1, &first, &last);
+    refine_range(job, FALSE, first, last);
+    visible_lines(job->view2, &first, &last);
+    refine_range(job, TRUE, first, last);
+    return G_SOURCE_REMOVE;
+}
+
+/* Coalesces scroll events into one refinement pass after the frame is laid out */
+static void schedule_refine(DiffJob *job) {
+    if (job->refine_source || !job->view1) return;
+    job->refine_source = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, refine_visible, job, NULL);
+}
+
+static void on_diff_scrolled(GtkAdjustment *adjustment, gpointer user_data) {
+    schedule_refine(user_data);
+}
+
+/* A deletion directly followed by an insertion at the same place is a hunk.
+ * Runs are coalesced, so the pair may straddle two batches. */
+static void note_hunk(DiffJob *job, const DiffOp *op) {
+    if (op->type == DIFF_DELETE) {
+        job->last_delete = *op;
+        job->has_last_delete = TRUE;
+        return;
+    }
+    if (op->type == DIFF_INSERT && job->has_last_delete &&
+        job->last_delete.a_start + job->last_delete.length == op->a_start &&
+        job->last_delete.b_start == op->b_start) {
+        DiffHunk hunk = { job->last_delete.a_start, job->last_delete.length, op->b_start, op->length, FALSE };
+        g_array_append_val(job->hunks, hunk);
+    }
+    job->has_last_delete = FALSE;
+}
+
+static void tag_lines(GtkTextBuffer *buffer, guint first, guint count, const char *tag) {
+    GtkTextIter s, e;
+    gtk_text_buffer_get_iter_at_line(buffer, &s, (gint)first);
+    gtk_text_buffer_get_iter_at_line(buffer, &e, (gint)(first + count));
+    gtk_text_buffer_apply_tag_by_name(buffer, tag, &s, &e);
+}
+
+/* Each side's buffer holds only that side's lines, in order, so a line
+ * number on one side is also its buffer line */
+static void tag_moves(DiffJob *job, GArray *moves) {
+    for (guint i = 0; i < moves->len; ++i) {
+        const DiffMove *move = &g_array_index(moves, DiffMove, i);
+        tag_lines(job->buffer1, move->a_start, move->length, "diff-move");
+        tag_lines(job->buffer2, move->b_start, move->length, "diff-move");
+    }
+}
+
+static gboolean deliver_batch(gpointer data) {
+    DiffBatch *batch = data;
+    DiffJob *job = batch->job;
+    if (batch->generation != job->generation || !job->buffer1) return G_SOURCE_REMOVE;
+
+    for (guint i = 0; i < batch->ops->len; ++i) {
+        const DiffOp *op = &g_array_index(batch->ops, DiffOp, i);
+        note_hunk(job, op);
+        switch (op->type) {
+            case DIFF_EQUAL:
+                append_lines(job->buffer1, job->text1, job->lines1, op->a_start, op->length, NULL);
+                append_lines(job->buffer2, job->text2, job->lines2, op->b_start, op->length, NULL);
+                break;
+            case DIFF_DELETE:
+                append_lines(job->buffer1, job->text1, job->lines1, op->a_start, op->length, "diff-delete");
+                break;
+            case DIFF_INSERT:
+                append_lines(job->buffer2, job->text2, job->lines2, op->b_start, op->length, "diff-insert");
+                break;
+        }
+    }
+
+    if (batch->moves) tag_moves(job, batch->moves);
+    schedule_refine(job);
+    if (batch->finished) {
+        gtk_widget_set_visible(job->progress, FALSE);
+    } else {
+        guint total = (job->lines1->len - 1) + (job->lines2->len - 1);
+        gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(job->progress),
+                                      total ? (double)(batch->a_done + batch->b_done) / total : 1.0);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+/* Worker: hands the accumulated runs to the main loop */
+static void send_batch(DiffRun *run, GArray *moves, gboolean finished) {
+    DiffBatch *batch = g_new(DiffBatch, 1);
+    batch->job = diff_job_ref(run->job);
+    batch->generation = run->generation;
+    batch->ops = run->batch;
+    batch->moves = moves;
+    batch->a_done = run->a_done;
+    batch->b_done = run->b_done;
+    batch->finished = finished;
+    run->batch = g_array_new(FALSE, FALSE, sizeof(DiffOp));
+    run->last_send = g_get_monotonic_time();
+    g_main_context_invoke_full(NULL, G_PRIORITY_DEFAULT, deliver_batch, batch, diff_batch_free);
+}
+
+static void on_diff_ops(const DiffOp *ops, guint n_ops, guint a_done, guint b_done, gpointer user_data) {
+    DiffRun *run = user_data;
+    g_array_append_vals(run->batch, ops, n_ops);
+    g_array_append_vals(run->ops, ops, n_ops);
+    run->a_done = a_done;
+    run->b_done = b_done;
+    /* The first runs go out at once so the window fills right away */
+    if (g_get_monotonic_time() - run->last_send >= DIFF_BATCH_INTERVAL_US) send_batch(run, NULL, FALSE);
+}
+
+/* Reads one side as stored, or a placeholder if it cannot be read */
+static GBytes *load_side(const char *stored_name, const char *path) {
+    GBytes *bytes = version_cache_load(stored_name, path);
+    if (!bytes) {
+        g_printerr("Failed to read file: %s\n", path);
+        return g_bytes_new_static("[Error reading file]", strlen("[Error reading file]"));
+    }
+    return bytes;
+}
+
+/* Text buffers need valid UTF-8 without NULs, so anything else is repaired first */
+static GBytes *make_valid_text(GBytes *bytes) {
+    gsize len;
+    const char *data = g_bytes_get_data(bytes, &len);
+    if (g_utf8_validate_len(data, len, NULL)) return bytes;
+    gchar *valid = g_utf8_make_valid(data, len);
+    g_bytes_unref(bytes);
+    return g_bytes_new_take(valid, strlen(valid));
+}
+
+static void append_region(GString *out, char mark, gsize offset, gsize length, const guint8 *bytes) {
+    g_string_append_printf(out, "%c 0x%08" G_GSIZE_MODIFIER "x  %" G_GSIZE_FORMAT " bytes", mark, offset, length);
+    if (bytes) {
+        g_string_append(out, ": ");
+        for (gsize i = 0; i < MIN(length, BINARY_PREVIEW_BYTES); ++i) g_string_append_printf(out, "%02x ", bytes[i]);
+        if (length > BINARY_PREVIEW_BYTES) g_string_append(out, "...");
+    }
+    g_string_append_c(out, '\n');
+}
+
+static gint compare_source_offset(gconstpointer a, gconstpointer b) {
+    gsize x = ((const BinaryDeltaOp *)a)->source_offset, y = ((const BinaryDeltaOp *)b)->source_offset;
+    return x < y ? -1 : x > y;
+}
+
+/* Binary sides are compared as region listings built from a block-matching
+ * delta: a region copied from the old side gets the same line on both sides,
+ * so the line diff shows new bytes as insertions and dropped bytes as deletions. */
+static gboolean summarize_binary(DiffJob *job, GBytes *old_bytes, GBytes *new_bytes, GCancellable *cancellable) {
+    gsize old_len, new_len;
+    const guint8 *old_data = g_bytes_get_data(old_bytes, &old_len);
+    const guint8 *new_data = g_bytes_get_data(new_bytes, &new_len);
+    GArray *ops = binary_delta_compute(old_data, old_len, new_data, new_len, cancellable);
+    if (!ops) return FALSE;
+
+    GBytes *delta = binary_delta_encode(ops, new_data, new_len);
+    GString *old_text = g_string_new(NULL);
+    GString *new_text = g_string_new(NULL);
+    g_string_append_printf(old_text, "Binary file, %" G_GSIZE_FORMAT " bytes\n", old_len);
+    g_string_append_printf(new_text, "Binary file, %" G_GSIZE_FORMAT " bytes; %" G_GSIZE_FORMAT
+                           " bytes new, delta %" G_GSIZE_FORMAT " bytes\n",
+                           new_len, binary_delta_inserted_bytes(ops), g_bytes_get_size(delta));
+
+    GArray *copies = g_array_new(FALSE, FALSE, sizeof(BinaryDeltaOp));
+    for (guint i = 0; i < ops->len; ++i) {
+        const BinaryDeltaOp *op = &g_array_index(ops, BinaryDeltaOp, i);
+        if (op->type == BINARY_DELTA_COPY) {
+            append_region(new_text, '=', op->source_offset, op->length, NULL);
+            g_array_append_val(copies, *op);
+        } else {
+            append_region(new_text, '+', op->target_offset, op->length, new_data + op->target_offset);
+        }
+    }
+
+    /* The old side in its own order: copied regions, with whatever no copy uses in between */
+    g_array_sort(copies, compare_source_offset);
+    gsize covered = 0;
+    for (guint i = 0; i < copies->len; ++i) {
+        const BinaryDeltaOp *op = &g_array_index(copies, BinaryDeltaOp, i);
+        if (op->source_offset > covered) append_region(old_text, '-', covered, op->source_offset - covered, old_data + covered);
+        append_region(old_text, '=', op->source_offset, op->length, NULL);
+        covered = MAX(covered, op->source_offset + op->length);
+    }
+    if (old_len > covered) append_region(old_text, '-', covered, old_len - covered, old_data + covered);
+
+    job->text1 = g_string_free_to_bytes(old_text);
+    job->text2 = g_string_free_to_bytes(new_text);
+    g_array_unref(copies);
+    g_bytes_unref(delta);
+    g_array_unref(ops);
+    return TRUE;
+}
+
+static GArray *line_offsets(GBytes *text) {
+    gsize len;
+    const char *data = g_bytes_get_data(text, &len);
+    GArray *lines = g_array_new(FALSE, FALSE, sizeof(guint));
+    diff_line_offsets(data, len, lines);
+    return lines;
+}
+
+/* Reads both sides the first time any run needs them. Caller holds job->lock.
+ * @return FALSE if cancelled before the texts were ready. */
+static gboolean load_texts(DiffJob *job, GCancellable *cancellable) {
+    if (job->text1) return TRUE;
+    GBytes *raw1 = load_side(job->stored1, job->file1_path);
+    GBytes *raw2 = load_side(job->stored2, job->file2_path);
+    gsize len1, len2;
+    const char *data1 = g_bytes_get_data(raw1, &len1);
+    const char *data2 = g_bytes_get_data(raw2, &len2);
+    if (diff_is_binary(data1, len1) || diff_is_binary(data2, len2)) {
+        gboolean done = summarize_binary(job, raw1, raw2, cancellable);
+        g_bytes_unref(raw1);
+        g_bytes_unref(raw2);
+        if (!done) return FALSE;
+    } else {
+        job->text1 = make_valid_text(raw1);
+        job->text2 = make_valid_text(raw2);
+    }
+    job->lines1 = line_offsets(job->text1);
+    job->lines2 = line_offsets(job->text2);
+    return TRUE;
+}
+
+/* Line hashes of one side under flags, computed once per mode. Caller holds job->lock. */
+static GArray *side_hashes(GHashTable *cache, GBytes *text, GArray *lines, DiffNormalizeFlags flags) {
+    GArray *hashes = g_hash_table_lookup(cache, GUINT_TO_POINTER(flags));
+    if (!hashes) {
+        hashes = g_array_sized_new(FALSE, FALSE, sizeof(guint64), lines->len - 1);
+        diff_hash_lines(g_bytes_get_data(text, NULL), lines, flags, hashes);
+        g_hash_table_insert(cache, GUINT_TO_POINTER(flags), hashes);
+    }
+    return g_array_ref(hashes);
+}
+
+/* Turns line hashes into token ids shared by both sides */
+static GArray *intern_hashes(DiffInterner *interner, GArray *hashes) {
+    GArray *tokens = g_array_sized_new(FALSE, FALSE, sizeof(guint32), hashes->len);
+    for (guint i = 0; i < hashes->len; ++i) {
+        guint32 id = diff_interner_intern(interner, (const char *)&g_array_index(hashes, guint64, i), sizeof(guint64));
+        g_array_append_val(tokens, id);
+    }
+    return tokens;
+}
+
+static void diff_worker(GTask *task, gpointer source, gpointer task_data, GCancellable *cancellable) {
+    DiffRun *run = task_data;
+    DiffJob *job = run->job;
+
+    g_mutex_lock(&job->lock);
+    if (!load_texts(job, cancellable)) {
+        g_mutex_unlock(&job->lock);
+        g_task_return_boolean(task, FALSE);
+        return;
+    }
+    GArray *hashes1 = side_hashes(job->hashes1, job->text1, job->lines1, run->flags);
+    GArray *hashes2 = side_hashes(job->hashes2, job->text2, job->lines2, run->flags);
+    g_mutex_unlock(&job->lock);
+
+    DiffInterner *interner = diff_interner_new();
+    GArray *tokens1 = intern_hashes(interner, hashes1);
+    GArray *tokens2 = intern_hashes(interner, hashes2);
+    diff_interner_free(interner);
+    g_array_unref(hashes1);
+    g_array_unref(hashes2);
+
+    gboolean complete = myers_diff_stream((const guint32 *)tokens1->data, tokens1->len,
+                                          (const guint32 *)tokens2->data, tokens2->len,
+                                          cancellable, on_diff_ops, run);
+    if (complete) {
+        /* Moves need the whole diff, so they arrive with the last batch */
+        GArray *moves = diff_find_moves((const guint32 *)tokens1->data, tokens1->len,
+                                        (const guint32 *)tokens2->data, tokens2->len, run->ops);
+        send_batch(run, moves, TRUE);
+    }
+    g_array_unref(tokens1);
+    g_array_unref(tokens2);
+    g_task_return_boolean(task, complete);
+}
+
+/* Starts a diff under job->flags; batches of any earlier run are ignored from now on */
+static void start_run(DiffJob *job) {
+    if (job->cancellable) {
+        g_cancellable_cancel(job->cancellable);
+        g_object_unref(job->cancellable);
+    }
+    job->cancellable = g_cancellable_new();
+
+    DiffRun *run = g_new0(DiffRun, 1);
+    run->job = diff_job_ref(job);
+    run->generation = ++job->generation;
+    run->flags = job->flags;
+    run->batch = g_array_new(FALSE, FALSE, sizeof(DiffOp));
+    run->ops = g_array_new(FALSE, FALSE, sizeof(DiffOp));
+
+    GTask *task = g_task_new(NULL, job->cancellable, NULL, NULL);
+    g_task_set_task_data(task, run, diff_run_free);
+    scheduler_run_task(task, diff_worker, SCHEDULER_PRIORITY_INTERACTIVE);
+    g_object_unref(task);
+}
+
+static void clear_tag(GtkTextBuffer *buffer, const char *tag) {
+    GtkTextIter start, end;
+    gtk_text_buffer_get_bounds(buffer, &start, &end);
+    gtk_text_buffer_remove_tag_by_name(buffer, tag, &start, &end);
+}
+
+/* The line diff stays; only the highlighting inside changed lines is redone,
+ * starting with what is on screen */
+static void on_granularity_changed(GtkDropDown *dropdown, GParamSpec *pspec, gpointer user_data) {
+    DiffJob *job = user_data;
+    job->granularity = (DiffGranularity)gtk_drop_down_get_selected(dropdown);
+    clear_tag(job->buffer1, "diff-delete-word");
+    clear_tag(job->buffer2, "diff-insert-word");
+    for (guint i = 0; i < job->hunks->len; ++i) g_array_index(job->hunks, DiffHunk, i).refined = FALSE;
+    schedule_refine(job);
+}
+
+/* A comparison mode was switched: clear the panes and diff again. The texts
+ * and the line hashes of modes already used are kept, so only the matching reruns. */
+static void on_mode_toggled(GtkCheckButton *button, gpointer user_data) {
+    DiffJob *job = user_data;
+    DiffNormalizeFlags flag = GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(button), "diff-flag"));
+    if (gtk_check_button_get_active(button)) job->flags |= flag;
+    else job->flags &= ~flag;
+
+    if (job->refine_source) g_source_remove(job->refine_source);
+    job->refine_source = 0;
+    g_array_set_size(job->hunks, 0);
+    job->has_last_delete = FALSE;
+    gtk_text_buffer_set_text(job->buffer1, "", 0);
+    gtk_text_buffer_set_text(job->buffer2, "", 0);
+    gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(job->progress), 0.0);
+    gtk_widget_set_visible(job->progress, TRUE);
+    start_run(job);
+}
+
+/* Closing the window stops the worker; its buffers go with the window */
+static void on_diff_window_destroy(GtkWidget *window, gpointer user_data) {
+    DiffJob *job = user_data;
+    g_cancellable_cancel(job->cancellable);
+    if (job->refine_source) g_source_remove(job->refine_source);
+    job->refine_source = 0;
+    g_clear_object(&job->buffer1);
+    g_clear_object(&job->buffer2);
+    job->progress = NULL;
+    job->view1 = NULL;
+    job->view2 = NULL;
+    g_signal_handlers_disconnect_by_data(job->vadjustment1, job);
+    g_signal_handlers_disconnect_by_data(job->vadjustment2, job);
+    diff_job_unref(job);
+}
+
+void create_diff_window(GtkWindow* parent, const char* file1_path, const char* file2_path) {
     GtkWidget *window, *main_box, *grid, *scrolled_window1, *scrolled_window2, *view1, *view2, *gutter;
     GtkWidget *label1, *label2, *header_box, *revert_button;
     GtkTextBuffer *buffer1, *buffer2;
@@ -368,6 +896,10 @@ void create_diff_window(GtkWindow* parent, const char* file1_path, const char* f
     gtk_widget_set_margin_start(header_box, 10);
     gtk_widget_set_margin_end(header_box, 10);
 
+    GtkWidget *merge_button = gtk_button_new_with_label("Merge into Current File");
+    gtk_widget_set_tooltip_text(merge_button, "Apply this version's changes while keeping edits made since the last recorded version");
+    gtk_box_append(GTK_BOX(header_box), merge_button);
+
     revert_button = gtk_button_new_with_label("Revert to this Version");
     gtk_widget_set_halign(revert_button, GTK_ALIGN_END);
     gtk_box_append(GTK_BOX(header_box), revert_button);
@@ -436,161 +968,92 @@ void create_diff_window(GtkWindow* parent, const char* file1_path, const char* f
     g_object_unref(provider);
 
     // Create tags for highlighting differences
-    // Red background for deleted words (in file1)
+    // Red background for deleted lines (in file1)
     gtk_text_buffer_create_tag(buffer1, "diff-delete",
                               "background", "#ffcccc",
                               "foreground", "#8b0000",
                               NULL);
     
-    // Green background for added words (in file2)
+    // Green background for added lines (in file2)
     gtk_text_buffer_create_tag(buffer2, "diff-insert",
                               "background", "#ccffcc",
                               "foreground", "#006400",
                               NULL);
 
-    // Read file contents
-    gchar *contents1 = NULL, *contents2 = NULL;
-    gsize length1, length2;
-    
-    if (!g_file_get_contents(file1_path, &contents1, &length1, NULL)) {
-        g_printerr("Failed to read file: %s\n", file1_path);
-        contents1 = g_strdup("[Error reading file]");
-    }
-    
-    if (!g_file_get_contents(file2_path, &contents2, &length2, NULL)) {
-        g_printerr("Failed to read file: %s\n", file2_path);
-        contents2 = g_strdup("[Error reading file]");
-    }
-
-    // Populate buffers with full file contents first
-    gtk_text_buffer_set_text(buffer1, contents1 ? contents1 : "", -1);
-    gtk_text_buffer_set_text(buffer2, contents2 ? contents2 : "", -1);
-
-    // Highlight differences using word-level comparison
-    const gchar *p1 = contents1 ? contents1 : "";
-    const gchar *p2 = contents2 ? contents2 : "";
-
-    // Tokenize both files into words array (words are non-whitespace runs)
-    GPtrArray *words1 = g_ptr_array_new_with_free_func(g_free);
-    GPtrArray *words2 = g_ptr_array_new_with_free_func(g_free);
-    
-    // Extract words from file1
-    const gchar *q = p1;
-    while (*q) {
-        gunichar c = g_utf8_get_char(q);
-        if (g_unichar_isspace(c)) { q = g_utf8_next_char(q); continue; }
-        const gchar *start = q;
-        while (*q) {
-            gunichar n = g_utf8_get_char(q);
-            if (g_unichar_isspace(n)) break;
-            q = g_utf8_next_char(q);
-        }
-        gchar *w = g_strndup(start, q - start);
-        g_ptr_array_add(words1, w);
-    }
-    
-    // Extract words from file2
-    const gchar *r = p2;
-    while (*r) {
-        gunichar c = g_utf8_get_char(r);
-        if (g_unichar_isspace(c)) { r = g_utf8_next_char(r); continue; }
-        const gchar *start = r;
-        while (*r) {
-            gunichar n = g_utf8_get_char(r);
-            if (g_unichar_isspace(n)) break;
-            r = g_utf8_next_char(r);
-        }
-        gchar *w = g_strndup(start, r - start);
-        g_ptr_array_add(words2, w);
-    }
-
-    /* Use LCS-based approach to identify matched word positions */
-    gint n1 = words1->len;
-    gint n2 = words2->len;
-    
-    /* Create matching arrays: matched1[i] = j means word1[i] matches word2[j], or -1 if unmatched */
-    gint *matched1 = g_new0(gint, n1);
-    gint *matched2 = g_new0(gint, n2);
-    
-    for (gint i = 0; i < n1; i++) matched1[i] = -1;
-    for (gint i = 0; i < n2; i++) matched2[i] = -1;
-    
-    /* Simple greedy matching: go through each word in file1 and find first matching word in file2 */
-    for (gint i = 0; i < n1; i++) {
-        gchar *w1 = g_ptr_array_index(words1, i);
-        
-        for (gint j = 0; j < n2; j++) {
-            if (matched2[j] == -1) {  /* word2[j] not yet matched */
-                gchar *w2 = g_ptr_array_index(words2, j);
-                if (g_strcmp0(w1, w2) == 0) {
-                    matched1[i] = j;
-                    matched2[j] = i;
-                    break;  /* Match this word and move to next word1 */
-                }
-            }
-        }
-    }
+    // Stronger shades for the changed words inside a changed line; created
+    // last so they win over the line tags
+    gtk_text_buffer_create_tag(buffer1, "diff-delete-word",
+                              "background", "#ff8f8f",
+                              NULL);
+    gtk_text_buffer_create_tag(buffer2, "diff-insert-word",
+                              "background", "#8fe88f",
+                              NULL);
 
-    /* Mark unmatched words in file1 as deleted (red) */
-    gint offset1 = 0;
-    q = p1;
-    for (gint i = 0; i < n1; i++) {
-        gchar *w1 = g_ptr_array_index(words1, i);
-        
-        /* Skip whitespace to find the word position */
-        while (*q && g_unichar_isspace(g_utf8_get_char(q))) {
-            q = g_utf8_next_char(q);
-            offset1++;
-        }
-        
-        gint wchars = g_utf8_strlen(w1, -1);
-        
-        /* If this word is not matched to any word in file2, mark as deleted */
-        if (matched1[i] == -1 && wchars > 0) {
-            GtkTextIter s, e;
-            gtk_text_buffer_get_iter_at_offset(buffer1, &s, offset1);
-            gtk_text_buffer_get_iter_at_offset(buffer1, &e, offset1 + wchars);
-            gtk_text_buffer_apply_tag_by_name(buffer1, "diff-delete", &s, &e);
-        }
-        
-        offset1 += wchars;
-        q = g_utf8_offset_to_pointer(q, wchars);
-    }
+    // Blue for lines that only moved; same color on both sides so a block
+    // can be matched up with where it went
+    gtk_text_buffer_create_tag(buffer1, "diff-move",
+                              "background", "#cce0ff",
+                              "foreground", "#003c8f",
+                              NULL);
+    gtk_text_buffer_create_tag(buffer2, "diff-move",
+                              "background", "#cce0ff",
+                              "foreground", "#003c8f",
+                              NULL);
 
-    /* Mark unmatched words in file2 as added (green) */
-    gint offset2 = 0;
-    r = p2;
-    for (gint i = 0; i < n2; i++) {
-        gchar *w2 = g_ptr_array_index(words2, i);
-        
-        /* Skip whitespace to find the word position */
-        while (*r && g_unichar_isspace(g_utf8_get_char(r))) {
-            r = g_utf8_next_char(r);
-            offset2++;
-        }
-        
-        gint wchars = g_utf8_strlen(w2, -1);
-        
-        /* If this word is not matched to any word in file1, mark as added */
-        if (matched2[i] == -1 && wchars > 0) {
-            GtkTextIter s, e;
-            gtk_text_buffer_get_iter_at_offset(buffer2, &s, offset2);
-            gtk_text_buffer_get_iter_at_offset(buffer2, &e, offset2 + wchars);
-            gtk_text_buffer_apply_tag_by_name(buffer2, "diff-insert", &s, &e);
-        }
-        
-        offset2 += wchars;
-        r = g_utf8_offset_to_pointer(r, wchars);
+    /* The diff runs on a worker and fills the buffers as hunks are found */
+    GtkWidget *progress = gtk_progress_bar_new();
+    gtk_widget_set_hexpand(progress, TRUE);
+    gtk_widget_set_valign(progress, GTK_ALIGN_CENTER);
+    gtk_box_prepend(GTK_BOX(header_box), progress);
+
+    DiffJob *job = g_new0(DiffJob, 1);
+    job->ref_count = 1;
+    job->file1_path = g_strdup(file1_path);
+    job->file2_path = g_strdup(file2_path);
+    job->stored1 = version_cache_stored_name_for_path(file1_path);
+    job->stored2 = version_cache_stored_name_for_path(file2_path);
+    g_mutex_init(&job->lock);
+    job->hashes1 = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)g_array_unref);
+    job->hashes2 = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)g_array_unref);
+    job->buffer1 = g_object_ref(buffer1);
+    job->buffer2 = g_object_ref(buffer2);
+    job->progress = progress;
+    job->view1 = GTK_TEXT_VIEW(view1);
+    job->view2 = GTK_TEXT_VIEW(view2);
+    job->hunks = g_array_new(FALSE, FALSE, sizeof(DiffHunk));
+    g_signal_connect(window, "destroy", G_CALLBACK(on_diff_window_destroy), job);
+    /* Word-level highlighting follows the scroll position */
+    job->vadjustment1 = gtk_scrolled_window_get_vadjustment(GTK_SCROLLED_WINDOW(scrolled_window1));
+    job->vadjustment2 = gtk_scrolled_window_get_vadjustment(GTK_SCROLLED_WINDOW(scrolled_window2));
+    g_signal_connect(job->vadjustment1, "value-changed", G_CALLBACK(on_diff_scrolled), job);
+    g_signal_connect(job->vadjustment2, "value-changed", G_CALLBACK(on_diff_scrolled), job);
+
+    /* Token granularity for changed lines, in DiffGranularity order */
+    static const char *const granularities[] = { "Lines", "Words", "Characters", "Code", NULL };
+    GtkWidget *granularity = gtk_drop_down_new_from_strings(granularities);
+    job->granularity = DIFF_TOKENS_CODE;
+    gtk_drop_down_set_selected(GTK_DROP_DOWN(granularity), job->granularity);
+    gtk_widget_set_tooltip_text(granularity, "How changed lines are split for highlighting");
+    g_signal_connect(granularity, "notify::selected", G_CALLBACK(on_granularity_changed), job);
+    gtk_box_insert_child_after(GTK_BOX(header_box), granularity, progress);
+
+    /* Comparison modes; each toggle reruns the diff */
+    static const struct { const char *label; DiffNormalizeFlags flag; } modes[] = {
+        { "Ignore whitespace", DIFF_IGNORE_ALL_SPACE },
+        { "Ignore trailing whitespace", DIFF_IGNORE_TRAILING_SPACE },
+        { "Ignore case", DIFF_IGNORE_CASE },
+        { "Ignore line endings", DIFF_IGNORE_LINE_ENDINGS },
+    };
+    GtkWidget *after = gtk_widget_get_prev_sibling(merge_button);
+    for (guint i = 0; i < G_N_ELEMENTS(modes); ++i) {
+        GtkWidget *check = gtk_check_button_new_with_label(modes[i].label);
+        g_object_set_data(G_OBJECT(check), "diff-flag", GUINT_TO_POINTER(modes[i].flag));
+        g_signal_connect(check, "toggled", G_CALLBACK(on_mode_toggled), job);
+        gtk_box_insert_child_after(GTK_BOX(header_box), check, after);
+        after = check;
     }
 
-    g_free(matched1);
-    g_free(matched2);
-
-    g_ptr_array_free(words1, TRUE);
-    g_ptr_array_free(words2, TRUE);
-
-    g_free(contents1);
-    g_free(contents2);
+    start_run(job);
 
     /* Connect revert button signal */
     RevertData *revert_data = g_new(RevertData, 1);
@@ -600,18 +1063,11 @@ void create_diff_window(GtkWindow* parent, const char* file1_path, const char* f
     revert_data->original_file_path = g_strdup(orig_path ? orig_path : "");
     revert_data->parent_window = parent;
     
-    /* Try to get the versions list from the parent window */
-    revert_data->versions_list = NULL;
-    revert_data->version_row = version_row;  /* Store the version row to remove from UI */
-    if (parent) {
-        GtkWidget *toplevel = GTK_WIDGET(parent);
-        GtkWidget *versions_list_widget = g_object_get_data(G_OBJECT(toplevel), "versions-list");
-        if (versions_list_widget && GTK_IS_LIST_BOX(versions_list_widget)) {
-            revert_data->versions_list = GTK_LIST_BOX(versions_list_widget);
-        }
-    }
 
     g_signal_connect(revert_button, "clicked", G_CALLBACK(on_revert_button_clicked), revert_data);
+    g_object_set_data_full(G_OBJECT(merge_button), "original-path", g_strdup(revert_data->original_file_path), g_free);
+    g_object_set_data_full(G_OBJECT(merge_button), "version-path", g_strdup(file2_path), g_free);
+    g_signal_connect(merge_button, "clicked", G_CALLBACK(on_merge_button_clicked), window);
 
     gtk_window_present(GTK_WINDOW(window));
 }
\ No newline at end of file
@@ -0,0 +1,237 @@
+#include "inline_store.h"
+#include "version_index.h"
+#include <gtk/gtk.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DATA_DIR "data"
+/* Dead records are only worth a rewrite once there is this much of them */
+#define COMPACT_MIN_DEAD_BYTES (64 * 1024)
+
+/* Where an inline version's contents sit in the pack */
+typedef struct {
+    gsize offset;
+    gsize len;
+} Slot;
+
+static GMutex lock;
+static GHashTable *slots = NULL;   /* stored name (owned) -> Slot (owned) */
+static GMappedFile *map = NULL;    /* NULL while the pack is empty or missing */
+static gsize pack_size = 0;        /* bytes of valid records */
+static gsize max_bytes = INLINE_STORE_DEFAULT_MAX_BYTES;
+static gchar *pack_path = NULL;
+
+/* Called with lock held: maps the pack as it is on disk now */
+static void remap(void) {
+    if (map) g_mapped_file_unref(map);
+    map = NULL;
+    if (pack_size == 0) return;
+    GError *error = NULL;
+    map = g_mapped_file_new(pack_path, FALSE, &error);
+    if (!map) {
+        g_printerr("inline_store: cannot map %s: %s\n", pack_path, error ? error->message : "unknown");
+        g_clear_error(&error);
+    }
+}
+
+/* ftell() returns a long, which is 32 bits on Windows and would stop the pack at 2 GiB */
+static gint64 file_offset(FILE *f) {
+#if defined(_WIN32) || defined(__MINGW32__)
+    return _ftelli64(f);
+#else
+    return (gint64)ftello(f);
+#endif
+}
+
+static void add_slot(const char *stored_name, gsize offset, gsize len) {
+    Slot *slot = g_new(Slot, 1);
+    slot->offset = offset;
+    slot->len = len;
+    g_hash_table_replace(slots, g_strdup(stored_name), slot);
+}
+
+/* Appends one record to out; returns the offset of its contents within out */
+static gsize format_record(GString *out, const char *stored_name, const void *data, gsize len) {
+    g_string_append_printf(out, "@%s|%" G_GSIZE_FORMAT "\n", stored_name, len);
+    gsize offset = out->len;
+    g_string_append_len(out, data, (gssize)len);
+    g_string_append_c(out, '\0');
+    return offset;
+}
+
+/* Reads every record of the mapped pack into slots. Returns the bytes of
+ * records whose version is gone; a torn tail counts as dead too. */
+static gsize load_records(void) {
+    if (!map) return 0;
+    const char *data = g_mapped_file_get_contents(map);
+    gsize size = g_mapped_file_get_length(map);
+    gsize pos = 0;
+    gsize dead = 0;
+    while (pos < size) {
+        const char *nl = memchr(data + pos, '\n', size - pos);
+        const char *bar = nl ? g_strrstr_len(data + pos, nl - (data + pos), "|") : NULL;
+        if (data[pos] != '@' || !bar) break;
+        gsize len = (gsize)g_ascii_strtoull(bar + 1, NULL, 10);
+        gsize offset = (gsize)(nl + 1 - data);
+        if (offset + len >= size || data[offset + len] != '\0') break;
+
+        gchar *name = g_strndup(data + pos + 1, bar - (data + pos + 1));
+        gsize record_bytes = offset + len + 1 - pos;
+        if (version_index_lookup_stored(name, NULL)) add_slot(name, offset, len);
+        else dead += record_bytes;
+        g_free(name);
+        pos += record_bytes;
+    }
+    pack_size = pos;
+    return dead + (size - pos);
+}
+
+/* Called with lock held: rewrites the pack with only the records in slots */
+static gboolean compact(void) {
+    /* Without a mapping the live records' bytes cannot be read back */
+    if (!map && g_hash_table_size(slots) > 0) {
+        g_printerr("inline_store: cannot compact %s, it is not mapped\n", pack_path);
+        return FALSE;
+    }
+    const char *data = map ? g_mapped_file_get_contents(map) : NULL;
+    GString *out = g_string_new(NULL);
+    GHashTable *fresh = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, slots);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        const Slot *old = value;
+        Slot *slot = g_new(Slot, 1);
+        slot->offset = format_record(out, key, data + old->offset, old->len);
+        slot->len = old->len;
+        g_hash_table_insert(fresh, g_strdup(key), slot);
+    }
+
+    /* Unmapped first: Windows cannot replace a mapped file */
+    if (map) g_mapped_file_unref(map);
+    map = NULL;
+    GError *error = NULL;
+    gboolean ok = g_file_set_contents(pack_path, out->str, (gssize)out->len, &error);
+    if (ok) {
+        g_hash_table_unref(slots);
+        slots = fresh;
+        pack_size = out->len;
+    } else {
+        g_printerr("inline_store: failed to rewrite %s: %s\n", pack_path, error ? error->message : "unknown");
+        g_clear_error(&error);
+        g_hash_table_unref(fresh);
+    }
+    remap();
+    g_string_free(out, TRUE);
+    return ok;
+}
+
+static void on_index_changed(VersionIndexChange change, const VersionEntry *entry, guint position, gpointer user_data) {
+    if (change != VERSION_INDEX_REMOVED) return;
+    g_mutex_lock(&lock);
+    /* The record stays in the pack until the next compaction */
+    g_hash_table_remove(slots, entry->stored_name);
+    g_mutex_unlock(&lock);
+}
+
+void inline_store_init(void) {
+    static gboolean initialized = FALSE;
+    if (initialized) return;
+    initialized = TRUE;
+
+    gchar *ini_path = g_build_filename(DATA_DIR, "storage.ini", NULL);
+    GKeyFile *kf = g_key_file_new();
+    if (g_key_file_load_from_file(kf, ini_path, G_KEY_FILE_NONE, NULL)) {
+        GError *error = NULL;
+        guint64 value = g_key_file_get_uint64(kf, "storage", "inline_max_bytes", &error);
+        if (!error) max_bytes = (gsize)value;
+        g_clear_error(&error);
+    }
+    g_key_file_free(kf);
+    g_free(ini_path);
+
+    g_mutex_lock(&lock);
+    slots = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    pack_path = g_build_filename(DATA_DIR, "inline_versions.pack", NULL);
+    GStatBuf st;
+    if (g_stat(pack_path, &st) == 0 && st.st_size > 0) {
+        pack_size = (gsize)st.st_size;
+        remap();
+    }
+    gsize size = pack_size;
+    gsize dead = load_records();
+    if (dead > 0 && (pack_size < size || (dead >= COMPACT_MIN_DEAD_BYTES && dead * 2 > size))) {
+        g_print("inline_store: compacting %s, %" G_GSIZE_FORMAT " of %" G_GSIZE_FORMAT " bytes dead\n",
+                pack_path, dead, size);
+        compact();
+    }
+    g_mutex_unlock(&lock);
+
+    version_index_watch(on_index_changed, NULL);
+}
+
+gsize inline_store_max_bytes(void) {
+    return max_bytes;
+}
+
+gboolean inline_store_add(const char *stored_name, const void *data, gsize len) {
+    if (!slots) return FALSE;
+    GString *record = g_string_new(NULL);
+    gsize offset = format_record(record, stored_name, data, len);
+
+    g_mutex_lock(&lock);
+    /* A second record under the same name would take over the first one's slot */
+    if (g_hash_table_contains(slots, stored_name)) {
+        g_mutex_unlock(&lock);
+        g_printerr("inline_store: %s is already stored\n", stored_name);
+        g_string_free(record, TRUE);
+        return FALSE;
+    }
+    g_mkdir_with_parents(DATA_DIR, 0755);
+    FILE *f = g_fopen(pack_path, "ab");
+    /* Offsets come from pack_size, so a pack with a torn tail that could not be compacted takes no more records */
+    gboolean ok = f && fseek(f, 0, SEEK_END) == 0 && file_offset(f) == (gint64)pack_size &&
+                  fwrite(record->str, 1, record->len, f) == record->len;
+    if (f && fclose(f) != 0) ok = FALSE;
+    if (ok) {
+        /* The record is durable from here on; if the remap fails, lookups retry it */
+        add_slot(stored_name, pack_size + offset, len);
+        pack_size += record->len;
+        remap();
+    } else {
+        g_printerr("inline_store: failed to append to %s\n", pack_path);
+        /* A partial record would hide every later one; rewrite the pack from what is known */
+        if (f) compact();
+    }
+    g_mutex_unlock(&lock);
+    g_string_free(record, TRUE);
+    return ok;
+}
+
+GBytes *inline_store_lookup(const char *stored_name) {
+    if (!stored_name) return NULL;
+    GBytes *bytes = NULL;
+    g_mutex_lock(&lock);
+    const Slot *slot = slots ? g_hash_table_lookup(slots, stored_name) : NULL;
+    if (slot && !map) remap();
+    if (slot && map) {
+        /* Copied out: a reference to the mapping would keep every generation
+         * of the pack mapped for as long as the version cache holds it */
+        gchar *copy = g_malloc(slot->len + 1);
+        memcpy(copy, g_mapped_file_get_contents(map) + slot->offset, slot->len);
+        copy[slot->len] = '\0';
+        bytes = g_bytes_new_take(copy, slot->len);
+    }
+    g_mutex_unlock(&lock);
+    return bytes;
+}
+
+gboolean inline_store_contains(const char *stored_name) {
+    if (!stored_name) return FALSE;
+    g_mutex_lock(&lock);
+    gboolean found = slots && g_hash_table_contains(slots, stored_name);
+    g_mutex_unlock(&lock);
+    return found;
+}
@@ -0,0 +1,128 @@
+#include "list_items.h"
+#include <gtk/gtk.h>
+#include <string.h>
+
+// ---
+// --- DeltaFileItem
+// ---
+
+struct _DeltaFileItem {
+    GObject parent_instance;
+    gchar *path;
+};
+
+G_DEFINE_FINAL_TYPE(DeltaFileItem, delta_file_item, G_TYPE_OBJECT)
+
+static void delta_file_item_finalize(GObject *object) {
+    DeltaFileItem *self = DELTA_FILE_ITEM(object);
+    g_free(self->path);
+    G_OBJECT_CLASS(delta_file_item_parent_class)->finalize(object);
+}
+
+static void delta_file_item_class_init(DeltaFileItemClass *klass) {
+    G_OBJECT_CLASS(klass)->finalize = delta_file_item_finalize;
+}
+
+static void delta_file_item_init(DeltaFileItem *self) {
+}
+
+DeltaFileItem *delta_file_item_new(const char *path) {
+    DeltaFileItem *self = g_object_new(DELTA_TYPE_FILE_ITEM, NULL);
+    self->path = g_strdup(path);
+    return self;
+}
+
+const char *delta_file_item_get_path(DeltaFileItem *self) {
+    return self->path;
+}
+
+void delta_file_item_set_path(DeltaFileItem *self, const char *path) {
+    gchar *old = self->path;
+    self->path = g_strdup(path);
+    g_free(old);
+}
+
+// ---
+// --- DeltaVersionItem
+// ---
+
+struct _DeltaVersionItem {
+    GObject parent_instance;
+    guint32 file_id;
+    const char *stored_name; /* interned by the version catalog */
+    char timestamp[16];
+    gboolean compare_selected;
+    guint hits;
+    gboolean has_stats;
+    guint added, removed, changed;
+};
+
+G_DEFINE_FINAL_TYPE(DeltaVersionItem, delta_version_item, G_TYPE_OBJECT)
+
+static void delta_version_item_class_init(DeltaVersionItemClass *klass) {
+}
+
+static void delta_version_item_init(DeltaVersionItem *self) {
+}
+
+DeltaVersionItem *delta_version_item_new(guint32 file_id, const char *stored_name, const char *timestamp) {
+    DeltaVersionItem *self = g_object_new(DELTA_TYPE_VERSION_ITEM, NULL);
+    self->file_id = file_id;
+    self->stored_name = stored_name;
+    g_strlcpy(self->timestamp, timestamp ? timestamp : "", sizeof(self->timestamp));
+    return self;
+}
+
+guint32 delta_version_item_get_file_id(DeltaVersionItem *self) {
+    return self->file_id;
+}
+
+const char *delta_version_item_get_stored_name(DeltaVersionItem *self) {
+    return self->stored_name;
+}
+
+const char *delta_version_item_get_timestamp(DeltaVersionItem *self) {
+    return self->timestamp;
+}
+
+gchar *delta_version_item_dup_path(DeltaVersionItem *self) {
+    return g_build_filename("data", "versions", self->stored_name, NULL);
+}
+
+gboolean delta_version_item_get_compare_selected(DeltaVersionItem *self) {
+    return self->compare_selected;
+}
+
+void delta_version_item_set_compare_selected(DeltaVersionItem *self, gboolean selected) {
+    self->compare_selected = selected;
+}
+
+guint delta_version_item_get_hits(DeltaVersionItem *self) {
+    return self->hits;
+}
+
+void delta_version_item_set_hits(DeltaVersionItem *self, guint hits) {
+    self->hits = hits;
+}
+
+gboolean delta_version_item_get_stats(DeltaVersionItem *self, guint *added, guint *removed, guint *changed) {
+    if (!self->has_stats) return FALSE;
+    *added = self->added;
+    *removed = self->removed;
+    *changed = self->changed;
+    return TRUE;
+}
+
+void delta_version_item_set_stats(DeltaVersionItem *self, guint added, guint removed, guint changed) {
+    self->has_stats = TRUE;
+    self->added = added;
+    self->removed = removed;
+    self->changed = changed;
+}
+
+void delta_list_store_refresh(GListStore *store, gpointer item) {
+    guint pos;
+    if (!store || !g_list_store_find(store, item, &pos)) return;
+    /* Replacing the item with itself emits items-changed for just that row */
+    g_list_store_splice(store, pos, 1, &item, 1);
+}
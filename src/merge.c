@@ -0,0 +1,125 @@
+#include "merge.h"
+#include "diff_logic.h"
+#include <gtk/gtk.h>
+#include <string.h>
+
+#define UNMATCHED G_MAXUINT
+
+/* One text as lines: interned ids plus the byte offsets behind them */
+typedef struct {
+    const char *text;
+    const guint32 *ids;
+    GArray *tokens;
+    GArray *offsets;
+} MergeSide;
+
+static void side_init(MergeSide *side, DiffInterner *interner, const char *text, gsize len) {
+    side->text = text;
+    side->tokens = g_array_new(FALSE, FALSE, sizeof(guint32));
+    side->offsets = g_array_new(FALSE, FALSE, sizeof(guint));
+    diff_tokenize_lines(interner, text, len, side->tokens, side->offsets);
+    side->ids = (const guint32 *)side->tokens->data;
+}
+
+static void side_clear(MergeSide *side) {
+    g_array_unref(side->tokens);
+    g_array_unref(side->offsets);
+}
+
+/* For every base line, the line of other it is matched with, or UNMATCHED */
+static guint *match_base(const MergeSide *base, const MergeSide *other) {
+    guint n = base->tokens->len;
+    guint *match = g_new(guint, n + 1);
+    for (guint i = 0; i < n; ++i) match[i] = UNMATCHED;
+    GArray *ops = myers_diff(base->ids, n, other->ids, other->tokens->len);
+    for (guint i = 0; i < ops->len; ++i) {
+        const DiffOp *op = &g_array_index(ops, DiffOp, i);
+        if (op->type != DIFF_EQUAL) continue;
+        for (guint t = 0; t < op->length; ++t) match[op->a_start + t] = op->b_start + t;
+    }
+    g_array_unref(ops);
+    return match;
+}
+
+static gboolean same_lines(const MergeSide *a, guint a_start, guint a_end,
+                           const MergeSide *b, guint b_start, guint b_end) {
+    return a_end - a_start == b_end - b_start &&
+           memcmp(a->ids + a_start, b->ids + b_start, (a_end - a_start) * sizeof(guint32)) == 0;
+}
+
+static void emit_lines(GString *out, const MergeSide *side, guint start, guint end) {
+    if (start == end) return;
+    guint from = g_array_index(side->offsets, guint, start);
+    guint to = g_array_index(side->offsets, guint, end);
+    g_string_append_len(out, side->text + from, to - from);
+}
+
+/* Markers start a line even when the text before them had no final newline */
+static void emit_marker(GString *out, const char *marker, const char *label) {
+    if (out->len > 0 && out->str[out->len - 1] != '\n') g_string_append_c(out, '\n');
+    g_string_append(out, marker);
+    if (label) {
+        g_string_append_c(out, ' ');
+        g_string_append(out, label);
+    }
+    g_string_append_c(out, '\n');
+}
+
+GBytes *merge_three_way(const char *base, gsize base_len,
+                        const char *ours, gsize ours_len,
+                        const char *theirs, gsize theirs_len,
+                        const char *ours_label, const char *theirs_label,
+                        guint *conflicts) {
+    DiffInterner *interner = diff_interner_new();
+    MergeSide b, o, t;
+    side_init(&b, interner, base, base_len);
+    side_init(&o, interner, ours, ours_len);
+    side_init(&t, interner, theirs, theirs_len);
+    diff_interner_free(interner);
+
+    guint *match_ours = match_base(&b, &o);
+    guint *match_theirs = match_base(&b, &t);
+    guint n = b.tokens->len, n_ours = o.tokens->len, n_theirs = t.tokens->len;
+    GString *out = g_string_sized_new(MAX(ours_len, theirs_len));
+    guint found = 0;
+
+    guint i = 0, j = 0, k = 0;
+    while (i < n || j < n_ours || k < n_theirs) {
+        /* Stable line: unchanged on both sides */
+        if (i < n && match_ours[i] == j && match_theirs[i] == k) {
+            emit_lines(out, &o, j, j + 1);
+            i++, j++, k++;
+            continue;
+        }
+
+        /* The unstable region runs up to the next base line both sides kept */
+        guint l = i;
+        while (l < n && (match_ours[l] == UNMATCHED || match_theirs[l] == UNMATCHED)) l++;
+        guint j_end = l < n ? match_ours[l] : n_ours;
+        guint k_end = l < n ? match_theirs[l] : n_theirs;
+
+        if (same_lines(&b, i, l, &o, j, j_end)) {
+            emit_lines(out, &t, k, k_end);          /* only theirs changed */
+        } else if (same_lines(&b, i, l, &t, k, k_end) || same_lines(&o, j, j_end, &t, k, k_end)) {
+            emit_lines(out, &o, j, j_end);          /* only ours changed, or both the same way */
+        } else {
+            emit_marker(out, "<<<<<<<", ours_label);
+            emit_lines(out, &o, j, j_end);
+            emit_marker(out, "|||||||", "base");
+            emit_lines(out, &b, i, l);
+            emit_marker(out, "=======", NULL);
+            emit_lines(out, &t, k, k_end);
+            emit_marker(out, ">>>>>>>", theirs_label);
+            found++;
+        }
+        i = l, j = j_end, k = k_end;
+    }
+
+    g_free(match_ours);
+    g_free(match_theirs);
+    side_clear(&b);
+    side_clear(&o);
+    side_clear(&t);
+    if (conflicts) *conflicts = found;
+    return g_string_free_to_bytes(out);
+}
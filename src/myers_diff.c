@@ -0,0 +1,201 @@
+#include "diff_logic.h"
+#include <gtk/gtk.h>
+#include <string.h>
+
+/* Per-token change marks: the recursion only flags deletions in a and
+ * insertions in b. Ranges are settled left to right, so whenever a range
+ * is finished every mark before its end is final and the runs up to there
+ * can be handed out. */
+typedef struct {
+    const guint32 *a;
+    const guint32 *b;
+    guint8 *a_changed;
+    guint8 *b_changed;
+    /* Streaming state */
+    GCancellable *cancellable;
+    gboolean cancelled;
+    DiffOpFunc func;
+    gpointer user_data;
+    guint emit_a, emit_b;  /* the merge walk has emitted everything before these */
+    DiffOp pending;        /* last run, held back in case the next flush extends it */
+    gboolean has_pending;
+    GArray *batch;
+} MyersContext;
+
+static void emit_op(MyersContext *ctx, DiffOpType type, guint a_start, guint b_start, guint length) {
+    if (length == 0) return;
+    DiffOp *p = &ctx->pending;
+    if (ctx->has_pending && p->type == type &&
+        (type == DIFF_INSERT ? p->b_start + p->length == b_start : p->a_start + p->length == a_start)) {
+        p->length += length;
+        return;
+    }
+    if (ctx->has_pending) g_array_append_val(ctx->batch, *p);
+    DiffOp op = { type, a_start, b_start, length };
+    ctx->pending = op;
+    ctx->has_pending = TRUE;
+}
+
+/* Emits the runs between the last flush and (a_end, b_end), a point on the final path */
+static void flush(MyersContext *ctx, guint a_end, guint b_end, gboolean last) {
+    guint i = ctx->emit_a, j = ctx->emit_b;
+    while (i < a_end || j < b_end) {
+        guint si = i, sj = j;
+        while (i < a_end && j < b_end && !ctx->a_changed[i] && !ctx->b_changed[j]) { i++; j++; }
+        emit_op(ctx, DIFF_EQUAL, si, sj, i - si);
+        guint di = i;
+        while (i < a_end && ctx->a_changed[i]) i++;
+        emit_op(ctx, DIFF_DELETE, di, j, i - di);
+        guint dj = j;
+        while (j < b_end && ctx->b_changed[j]) j++;
+        emit_op(ctx, DIFF_INSERT, i, dj, j - dj);
+        if (i == si && j == sj) break;
+    }
+    ctx->emit_a = i;
+    ctx->emit_b = j;
+    if (last && ctx->has_pending) {
+        g_array_append_val(ctx->batch, ctx->pending);
+        ctx->has_pending = FALSE;
+    }
+    if (ctx->batch->len > 0 && ctx->func) {
+        ctx->func((const DiffOp *)ctx->batch->data, ctx->batch->len, i, j, ctx->user_data);
+        g_array_set_size(ctx->batch, 0);
+    }
+}
+
+static void diff_range(MyersContext *ctx, guint a0, guint n, guint b0, guint m);
+
+/* Finds the middle snake of a[a0..a0+n) x b[b0..b0+m) and splits the problem
+ * there. Both halves are strictly smaller, so the recursion terminates. */
+static void bisect(MyersContext *ctx, guint a0, guint n, guint b0, guint m) {
+    const guint32 *a = ctx->a + a0;
+    const guint32 *b = ctx->b + b0;
+    gint N = (gint)n, M = (gint)m;
+    gint max_d = (N + M + 1) / 2;
+    gint v_offset = max_d;
+    gint v_length = 2 * max_d + 2;
+    gint *v1 = g_new(gint, v_length);
+    gint *v2 = g_new(gint, v_length);
+    for (gint i = 0; i < v_length; i++) v1[i] = v2[i] = -1;
+    v1[v_offset + 1] = 0;
+    v2[v_offset + 1] = 0;
+    gint delta = N - M;
+    /* With an odd delta the paths meet while extending forward, otherwise backward */
+    gboolean front = (delta % 2 != 0);
+    gint k1start = 0, k1end = 0, k2start = 0, k2end = 0;
+
+    for (gint d = 0; d < max_d; d++) {
+        if (ctx->cancellable && g_cancellable_is_cancelled(ctx->cancellable)) {
+            ctx->cancelled = TRUE;
+            g_free(v1);
+            g_free(v2);
+            return;
+        }
+        for (gint k1 = -d + k1start; k1 <= d - k1end; k1 += 2) {
+            gint k1_offset = v_offset + k1;
+            gint x1;
+            if (k1 == -d || (k1 != d && v1[k1_offset - 1] < v1[k1_offset + 1])) x1 = v1[k1_offset + 1];
+            else x1 = v1[k1_offset - 1] + 1;
+            gint y1 = x1 - k1;
+            while (x1 < N && y1 < M && a[x1] == b[y1]) { x1++; y1++; }
+            v1[k1_offset] = x1;
+            if (x1 > N) {
+                k1end += 2;
+            } else if (y1 > M) {
+                k1start += 2;
+            } else if (front) {
+                gint k2_offset = v_offset + delta - k1;
+                if (k2_offset >= 0 && k2_offset < v_length && v2[k2_offset] != -1) {
+                    gint x2 = N - v2[k2_offset];
+                    if (x1 >= x2) {
+                        g_free(v1); g_free(v2);
+                        diff_range(ctx, a0, (guint)x1, b0, (guint)y1);
+                        diff_range(ctx, a0 + (guint)x1, (guint)(N - x1), b0 + (guint)y1, (guint)(M - y1));
+                        return;
+                    }
+                }
+            }
+        }
+        for (gint k2 = -d + k2start; k2 <= d - k2end; k2 += 2) {
+            gint k2_offset = v_offset + k2;
+            gint x2;
+            if (k2 == -d || (k2 != d && v2[k2_offset - 1] < v2[k2_offset + 1])) x2 = v2[k2_offset + 1];
+            else x2 = v2[k2_offset - 1] + 1;
+            gint y2 = x2 - k2;
+            while (x2 < N && y2 < M && a[N - x2 - 1] == b[M - y2 - 1]) { x2++; y2++; }
+            v2[k2_offset] = x2;
+            if (x2 > N) {
+                k2end += 2;
+            } else if (y2 > M) {
+                k2start += 2;
+            } else if (!front) {
+                gint k1_offset = v_offset + delta - k2;
+                if (k1_offset >= 0 && k1_offset < v_length && v1[k1_offset] != -1) {
+                    gint x1 = v1[k1_offset];
+                    gint y1 = v_offset + x1 - k1_offset;
+                    if (x1 >= N - x2) {
+                        g_free(v1); g_free(v2);
+                        diff_range(ctx, a0, (guint)x1, b0, (guint)y1);
+                        diff_range(ctx, a0 + (guint)x1, (guint)(N - x1), b0 + (guint)y1, (guint)(M - y1));
+                        return;
+                    }
+                }
+            }
+        }
+    }
+    g_free(v1);
+    g_free(v2);
+    /* No common token at all */
+    memset(ctx->a_changed + a0, 1, n);
+    memset(ctx->b_changed + b0, 1, m);
+}
+
+static void diff_range(MyersContext *ctx, guint a0, guint n, guint b0, guint m) {
+    if (ctx->cancelled) return;
+    guint a_end = a0 + n, b_end = b0 + m;
+    guint a_start = a0;
+    /* Common prefix and suffix never need the O(ND) search */
+    while (n > 0 && m > 0 && ctx->a[a0] == ctx->b[b0]) { a0++; b0++; n--; m--; }
+    /* The prefix is settled already; hand it out before the search below,
+     * which on a large divergent range takes a while. A change follows it,
+     * so its run is complete and need not be held back. */
+    if (ctx->func && a0 > a_start && (n > 0 || m > 0)) flush(ctx, a0, b0, TRUE);
+    while (n > 0 && m > 0 && ctx->a[a0 + n - 1] == ctx->b[b0 + m - 1]) { n--; m--; }
+    if (n == 0) memset(ctx->b_changed + b0, 1, m);
+    else if (m == 0) memset(ctx->a_changed + a0, 1, n);
+    else bisect(ctx, a0, n, b0, m);
+    /* Everything up to the end of this range is settled */
+    if (ctx->func && !ctx->cancelled) flush(ctx, a_end, b_end, FALSE);
+}
+
+gboolean myers_diff_stream(const guint32 *a, guint n, const guint32 *b, guint m,
+                           GCancellable *cancellable, DiffOpFunc func, gpointer user_data) {
+    MyersContext ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.a = a;
+    ctx.b = b;
+    ctx.a_changed = g_malloc0(n + 1);
+    ctx.b_changed = g_malloc0(m + 1);
+    ctx.cancellable = cancellable;
+    ctx.func = func;
+    ctx.user_data = user_data;
+    ctx.batch = g_array_new(FALSE, FALSE, sizeof(DiffOp));
+
+    diff_range(&ctx, 0, n, 0, m);
+    if (!ctx.cancelled) flush(&ctx, n, m, TRUE);
+
+    g_array_unref(ctx.batch);
+    g_free(ctx.a_changed);
+    g_free(ctx.b_changed);
+    return !ctx.cancelled;
+}
+
+static void collect_ops(const DiffOp *ops, guint n_ops, guint a_done, guint b_done, gpointer user_data) {
+    g_array_append_vals((GArray *)user_data, ops, n_ops);
+}
+
+GArray *myers_diff(const guint32 *a, guint n, const guint32 *b, guint m) {
+    GArray *ops = g_array_new(FALSE, FALSE, sizeof(DiffOp));
+    myers_diff_stream(a, n, b, m, NULL, collect_ops, ops);
+    return ops;
+}
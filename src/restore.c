@@ -0,0 +1,230 @@
+#include "restore.h"
+#include "version_index.h"
+#include "checkout.h"
+#include "batch_io.h"
+#include "inline_store.h"
+#include "scheduler.h"
+#include <gtk/gtk.h>
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <string.h>
+
+typedef struct {
+    const char *stored_name;   /* interned by the catalog */
+    gchar *target_path;
+    gboolean placed;           /* written; set by the one thread that handled it */
+    gboolean inlined;          /* stored in the inline pack rather than data/versions */
+} RestoreItem;
+
+typedef struct {
+    gchar *timestamp;
+    gchar *target_dir;
+    GArray *items;             /* RestoreItem */
+    gboolean linked;
+    guint skipped;
+    gint restored;
+    gint failed;
+    gint placed[CHECKOUT_COPY + 1];  /* atomic, per CheckoutMethod */
+    GCancellable *cancellable;
+    RestoreDoneFunc func;
+    gpointer user_data;
+} RestoreJob;
+
+static void restore_job_free(RestoreJob *job) {
+    for (guint i = 0; i < job->items->len; ++i) g_free(g_array_index(job->items, RestoreItem, i).target_path);
+    g_array_unref(job->items);
+    g_free(job->timestamp);
+    g_free(job->target_dir);
+    if (job->cancellable) g_object_unref(job->cancellable);
+    g_free(job);
+}
+
+gchar *restore_parse_time(const char *text) {
+    GString *digits = g_string_new(NULL);
+    for (const char *p = text; p && *p; ++p) {
+        if (g_ascii_isdigit(*p)) g_string_append_c(digits, *p);
+    }
+    /* Needs at least a date, and whole fields after it */
+    if (digits->len < 8 || digits->len > 14 || digits->len % 2 != 0) {
+        g_string_free(digits, TRUE);
+        return NULL;
+    }
+    /* "99" sorts after any real value, so a missing field means "to the end of it" */
+    while (digits->len < 14) g_string_append(digits, "99");
+    return g_string_free(digits, FALSE);
+}
+
+// ---
+// --- Plan: main thread, catalog only
+// ---
+
+typedef struct {
+    RestoreJob *job;
+    GPtrArray *paths;          /* original path of each item */
+} PlanData;
+
+static void plan_file(const char *path, gpointer user_data) {
+    PlanData *plan = user_data;
+    VersionEntry entry;
+    if (!version_index_version_at(version_index_lookup_path(path), plan->job->timestamp, &entry)) {
+        plan->job->skipped++;
+        return;
+    }
+    RestoreItem item = { entry.stored_name, NULL };
+    g_array_append_val(plan->job->items, item);
+    g_ptr_array_add(plan->paths, (gpointer)path);
+}
+
+/* Deepest directory containing every path, or NULL if they share none but the root */
+static gchar *common_dir(GPtrArray *paths) {
+    if (paths->len == 0) return NULL;
+    gchar *dir = g_path_get_dirname(g_ptr_array_index(paths, 0));
+    for (guint i = 1; i < paths->len && dir; ++i) {
+        const char *path = g_ptr_array_index(paths, i);
+        gsize n = strlen(dir);
+        while (dir && !(strncmp(path, dir, n) == 0 && G_IS_DIR_SEPARATOR(path[n]))) {
+            gchar *parent = g_path_get_dirname(dir);
+            if (strcmp(parent, dir) == 0 || strcmp(parent, ".") == 0) {
+                g_free(parent);
+                g_clear_pointer(&dir, g_free);
+                break;
+            }
+            g_free(dir);
+            dir = parent;
+            n = strlen(dir);
+        }
+    }
+    return dir;
+}
+
+static void plan_targets(RestoreJob *job, GPtrArray *paths) {
+    gchar *base = common_dir(paths);
+    gsize skip = base ? strlen(base) : 0;
+    for (guint i = 0; i < job->items->len; ++i) {
+        const char *path = g_ptr_array_index(paths, i);
+        const char *relative = path + skip;
+        if (!base) relative = g_path_skip_root(path) ? g_path_skip_root(path) : path;
+        while (G_IS_DIR_SEPARATOR(*relative)) relative++;
+        g_array_index(job->items, RestoreItem, i).target_path = g_build_filename(job->target_dir, relative, NULL);
+    }
+    g_free(base);
+}
+
+// ---
+// --- Copy: worker threads
+// ---
+
+/* Reflinks or hard-links one version; whatever cannot be linked is left for the batch copy */
+static void link_one(guint index, gpointer user_data) {
+    RestoreJob *job = user_data;
+    RestoreItem *item = &g_array_index(job->items, RestoreItem, index);
+    if (item->placed || item->inlined || g_cancellable_is_cancelled(job->cancellable)) return;
+    CheckoutMethod method = checkout_link(item->stored_name, item->target_path, job->linked);
+    if (method == CHECKOUT_FAILED) return;
+    item->placed = TRUE;
+    g_atomic_int_inc(&job->placed[method]);
+}
+
+/* Writes one version stored inline in the index straight from the mapped pack */
+static void write_inline(guint index, gpointer user_data) {
+    RestoreJob *job = user_data;
+    RestoreItem *item = &g_array_index(job->items, RestoreItem, index);
+    if (!item->inlined || g_cancellable_is_cancelled(job->cancellable)) return;
+    GError *error = NULL;
+    if (checkout_version(item->stored_name, item->target_path, FALSE, &error) != CHECKOUT_FAILED) {
+        item->placed = TRUE;
+        g_atomic_int_inc(&job->placed[CHECKOUT_COPY]);
+    } else {
+        g_printerr("Restore: failed to write %s: %s\n", item->target_path, error ? error->message : "unknown error");
+        g_clear_error(&error);
+    }
+}
+
+/* Copies every file-backed version that was not linked, in one batch */
+static void copy_rest(RestoreJob *job) {
+    GArray *copies = g_array_new(FALSE, FALSE, sizeof(BatchIoCopy));
+    GPtrArray *sources = g_ptr_array_new_with_free_func(g_free);
+    for (guint i = 0; i < job->items->len; ++i) {
+        const RestoreItem *item = &g_array_index(job->items, RestoreItem, i);
+        if (item->placed || item->inlined) continue;
+        gchar *source = g_build_filename("data", "versions", item->stored_name, NULL);
+        g_ptr_array_add(sources, source);
+        BatchIoCopy copy = { source, item->target_path, FALSE, 0 };
+        g_array_append_val(copies, copy);
+    }
+
+    guint copied = batch_io_copy((BatchIoCopy *)copies->data, copies->len, 0, job->cancellable);
+    job->placed[CHECKOUT_COPY] += (gint)copied;
+    for (guint i = 0; i < copies->len; ++i) {
+        const BatchIoCopy *copy = &g_array_index(copies, BatchIoCopy, i);
+        if (!copy->ok && copy->error != ECANCELED)
+            g_printerr("Restore: failed to write %s: %s\n", copy->target, g_strerror(copy->error));
+    }
+    g_ptr_array_unref(sources);
+    g_array_unref(copies);
+}
+
+static void restore_worker(GTask *task, gpointer source, gpointer task_data, GCancellable *cancellable) {
+    RestoreJob *job = task_data;
+
+    /* Directories first, each once, so the copies never race to create them */
+    GHashTable *dirs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    guint probe = job->items->len;
+    for (guint i = 0; i < job->items->len; ++i) {
+        RestoreItem *item = &g_array_index(job->items, RestoreItem, i);
+        item->inlined = inline_store_contains(item->stored_name);
+        if (!item->inlined && probe == job->items->len) probe = i;
+        gchar *dir = g_path_get_dirname(item->target_path);
+        if (!g_hash_table_add(dirs, dir)) continue;
+        if (g_mkdir_with_parents(dir, 0755) != 0) g_printerr("Restore: cannot create %s\n", dir);
+    }
+    g_hash_table_unref(dirs);
+
+    /* Every file-backed version is in data/versions and every target is under target_dir, so
+     * the first one tells whether linking works at all. If it does not, skip straight to copying. */
+    if (probe < job->items->len) {
+        link_one(probe, job);
+        if (g_array_index(job->items, RestoreItem, probe).placed)
+            scheduler_parallel_for(job->items->len, SCHEDULER_PRIORITY_DEFAULT, link_one, job);
+    }
+    scheduler_parallel_for(job->items->len, SCHEDULER_PRIORITY_DEFAULT, write_inline, job);
+    copy_rest(job);
+    job->restored = job->placed[CHECKOUT_REFLINK] + job->placed[CHECKOUT_HARDLINK] + job->placed[CHECKOUT_COPY];
+    job->failed = (gint)job->items->len - job->restored;
+    g_task_return_boolean(task, TRUE);
+}
+
+static void on_restore_done(GObject *source, GAsyncResult *result, gpointer user_data) {
+    RestoreJob *job = user_data;
+    /* Cancelled before the worker started: nothing was placed */
+    if (!g_task_propagate_boolean(G_TASK(result), NULL)) job->failed = (gint)job->items->len;
+    g_print("Restore as of %s into %s: %d restored (%d reflinked, %d hard-linked, %d copied), "
+            "%d failed, %u had no version yet\n",
+            job->timestamp, job->target_dir, job->restored, job->placed[CHECKOUT_REFLINK],
+            job->placed[CHECKOUT_HARDLINK], job->placed[CHECKOUT_COPY], job->failed, job->skipped);
+    if (job->func) job->func((guint)job->restored, (guint)job->failed, job->skipped, job->target_dir, job->user_data);
+    restore_job_free(job);
+}
+
+void restore_snapshot(const char *timestamp, const char *target_dir, gboolean linked,
+                      GCancellable *cancellable, RestoreDoneFunc func, gpointer user_data) {
+    RestoreJob *job = g_new0(RestoreJob, 1);
+    job->timestamp = g_strdup(timestamp);
+    job->target_dir = g_strdup(target_dir);
+    job->linked = linked;
+    job->items = g_array_new(FALSE, FALSE, sizeof(RestoreItem));
+    job->cancellable = cancellable ? g_object_ref(cancellable) : g_cancellable_new();
+    job->func = func;
+    job->user_data = user_data;
+
+    PlanData plan = { job, g_ptr_array_new() };
+    files_index_foreach(plan_file, &plan);
+    plan_targets(job, plan.paths);
+    g_ptr_array_unref(plan.paths);
+
+    /* job goes to on_restore_done, which frees it */
+    GTask *task = g_task_new(NULL, job->cancellable, on_restore_done, job);
+    g_task_set_task_data(task, job, NULL);
+    scheduler_run_task(task, restore_worker, SCHEDULER_PRIORITY_DEFAULT);
+    g_object_unref(task);
+}
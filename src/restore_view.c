@@ -0,0 +1,151 @@
+#include "restore_view.h"
+#include "restore.h"
+#include <gtk/gtk.h>
+#include <string.h>
+
+/* Shared by the panel and a restore in progress; main thread only */
+typedef struct {
+    gint ref_count;
+    GtkWidget *time_entry;     // NULL once the panel is closed
+    GtkWidget *dir_entry;
+    GtkWidget *status_label;
+    GtkWidget *link_check;
+    GtkWidget *restore_button;
+    GCancellable *running;
+} RestoreViewData;
+
+static void restore_view_data_unref(RestoreViewData *data) {
+    if (--data->ref_count > 0) return;
+    if (data->running) g_object_unref(data->running);
+    g_free(data);
+}
+
+static void on_restore_window_destroy(GtkWidget *widget, gpointer user_data) {
+    RestoreViewData *data = (RestoreViewData *)user_data;
+    if (data->running) g_cancellable_cancel(data->running);
+    data->time_entry = NULL;
+    restore_view_data_unref(data);
+}
+
+static void on_restore_finished(guint restored, guint failed, guint skipped, const char *target_dir, gpointer user_data) {
+    RestoreViewData *data = (RestoreViewData *)user_data;
+    g_clear_object(&data->running);
+    if (data->time_entry) {
+        GString *status = g_string_new(NULL);
+        g_string_printf(status, "Restored %u files into %s", restored, target_dir);
+        if (failed) g_string_append_printf(status, "; %u failed or were cancelled", failed);
+        if (skipped) g_string_append_printf(status, "; %u had no version yet", skipped);
+        gtk_label_set_text(GTK_LABEL(data->status_label), status->str);
+        gtk_button_set_label(GTK_BUTTON(data->restore_button), "Restore");
+        g_string_free(status, TRUE);
+    }
+    restore_view_data_unref(data);
+}
+
+static void on_restore_clicked(GtkButton *button, gpointer user_data) {
+    RestoreViewData *data = (RestoreViewData *)user_data;
+    if (data->running) {
+        g_cancellable_cancel(data->running);
+        return;
+    }
+
+    gchar *timestamp = restore_parse_time(gtk_editable_get_text(GTK_EDITABLE(data->time_entry)));
+    const char *target_dir = gtk_editable_get_text(GTK_EDITABLE(data->dir_entry));
+    if (!timestamp) {
+        gtk_label_set_text(GTK_LABEL(data->status_label), "Enter a time like 2024-03-01 14:00");
+        return;
+    }
+    if (!target_dir || !*target_dir) {
+        gtk_label_set_text(GTK_LABEL(data->status_label), "Choose a directory to restore into");
+        g_free(timestamp);
+        return;
+    }
+
+    data->running = g_cancellable_new();
+    data->ref_count++;
+    gtk_label_set_text(GTK_LABEL(data->status_label), "Restoring...");
+    gtk_button_set_label(button, "Cancel");
+    restore_snapshot(timestamp, target_dir, gtk_check_button_get_active(GTK_CHECK_BUTTON(data->link_check)),
+                     data->running, on_restore_finished, data);
+    g_free(timestamp);
+}
+
+static void on_folder_chosen(GObject *source, GAsyncResult *result, gpointer user_data) {
+    GtkWidget *dir_entry = GTK_WIDGET(user_data);
+    GFile *folder = gtk_file_dialog_select_folder_finish(GTK_FILE_DIALOG(source), result, NULL);
+    if (folder) {
+        gchar *path = g_file_get_path(folder);
+        if (path) gtk_editable_set_text(GTK_EDITABLE(dir_entry), path);
+        g_free(path);
+        g_object_unref(folder);
+    }
+    g_object_unref(dir_entry);
+}
+
+static void on_choose_clicked(GtkButton *button, gpointer user_data) {
+    GtkFileDialog *dialog = gtk_file_dialog_new();
+    gtk_file_dialog_set_title(dialog, "Restore Into");
+    gtk_file_dialog_select_folder(dialog, GTK_WINDOW(gtk_widget_get_root(GTK_WIDGET(button))), NULL,
+                                  on_folder_chosen, g_object_ref(user_data));
+    g_object_unref(dialog);
+}
+
+void create_restore_window(GtkWindow *parent) {
+    GtkWidget *window = gtk_window_new();
+    gtk_window_set_title(GTK_WINDOW(window), "Restore Snapshot");
+    gtk_window_set_transient_for(GTK_WINDOW(window), parent);
+    gtk_window_set_default_size(GTK_WINDOW(window), 520, -1);
+
+    GtkWidget *grid = gtk_grid_new();
+    gtk_grid_set_row_spacing(GTK_GRID(grid), 6);
+    gtk_grid_set_column_spacing(GTK_GRID(grid), 8);
+    gtk_widget_set_margin_top(grid, 10);
+    gtk_widget_set_margin_bottom(grid, 10);
+    gtk_widget_set_margin_start(grid, 10);
+    gtk_widget_set_margin_end(grid, 10);
+
+    /* Defaults: now, into a new directory named after it */
+    GDateTime *now = g_date_time_new_now_local();
+    gchar *now_text = g_date_time_format(now, "%Y-%m-%d %H:%M:%S");
+    gchar *dir_name = g_date_time_format(now, "restore-%Y%m%d-%H%M%S");
+    gchar *cwd = g_get_current_dir();
+    gchar *default_dir = g_build_filename(cwd, dir_name, NULL);
+
+    RestoreViewData *data = g_new0(RestoreViewData, 1);
+    data->ref_count = 1;
+    data->time_entry = gtk_entry_new();
+    gtk_editable_set_text(GTK_EDITABLE(data->time_entry), now_text);
+    gtk_widget_set_hexpand(data->time_entry, TRUE);
+    data->dir_entry = gtk_entry_new();
+    gtk_editable_set_text(GTK_EDITABLE(data->dir_entry), default_dir);
+    data->status_label = gtk_label_new("Every tracked file is restored as its newest version at that time.");
+    gtk_label_set_xalign(GTK_LABEL(data->status_label), 0.0);
+    gtk_label_set_wrap(GTK_LABEL(data->status_label), TRUE);
+    data->link_check = gtk_check_button_new_with_label("Link to stored versions instead of copying (read-only files)");
+    gtk_widget_set_tooltip_text(data->link_check, "Nearly instant and takes no extra space; for building or testing an old state");
+    data->restore_button = gtk_button_new_with_label("Restore");
+    gtk_widget_set_halign(data->restore_button, GTK_ALIGN_END);
+    GtkWidget *choose_button = gtk_button_new_with_label("Choose...");
+
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("As of"), 0, 0, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), data->time_entry, 1, 0, 2, 1);
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Into"), 0, 1, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), data->dir_entry, 1, 1, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), choose_button, 2, 1, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), data->link_check, 0, 2, 3, 1);
+    gtk_grid_attach(GTK_GRID(grid), data->status_label, 0, 3, 3, 1);
+    gtk_grid_attach(GTK_GRID(grid), data->restore_button, 0, 4, 3, 1);
+    gtk_window_set_child(GTK_WINDOW(window), grid);
+
+    g_signal_connect(choose_button, "clicked", G_CALLBACK(on_choose_clicked), data->dir_entry);
+    g_signal_connect(data->restore_button, "clicked", G_CALLBACK(on_restore_clicked), data);
+    g_signal_connect(window, "destroy", G_CALLBACK(on_restore_window_destroy), data);
+
+    g_free(default_dir);
+    g_free(cwd);
+    g_free(dir_name);
+    g_free(now_text);
+    g_date_time_unref(now);
+
+    gtk_window_present(GTK_WINDOW(window));
+}
@@ -0,0 +1,336 @@
+#include "retention.h"
+#include "version_index.h"
+#include <gtk/gtk.h>
+#include <glib/gstdio.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define DATA_DIR "data"
+
+/* GC deletes at most GC_BATCH_FILES snapshots every GC_TICK_MS, so even a
+ * large backlog trickles out instead of saturating the disk. */
+#define GC_TICK_MS 250
+#define GC_BATCH_FILES 8
+/* Full re-evaluation of every tracked file, for versions that aged out
+ * without anything new being recorded. */
+#define RETENTION_SWEEP_SECONDS (10 * 60)
+/* Directory entries examined per tick when looking for orphaned snapshots */
+#define ORPHAN_SCAN_CHUNK 64
+/* Snapshot files created less than this long ago are never treated as orphans.
+ * Creation, not modification: a recorded copy keeps its source's mtime. */
+#define ORPHAN_MIN_AGE_SECONDS (60 * 60)
+
+typedef struct {
+    gint64 max_age;  /* seconds; -1 means forever */
+    gint prefix_len; /* timestamp characters forming the bucket; 14 keeps all */
+} RetentionRule;
+
+typedef struct {
+    gchar *original; /* NULL for orphaned files that have no index entry */
+    gchar *stored;
+} GcItem;
+
+static GArray *rules = NULL;
+static RetentionCollectedFunc collected_func = NULL;
+static gpointer collected_data = NULL;
+
+static GQueue gc_queue = G_QUEUE_INIT;
+static GHashTable *gc_pending = NULL; /* stored names already queued */
+static guint gc_source = 0;
+
+/* State of the periodic sweep */
+static GPtrArray *sweep_paths = NULL;
+static guint sweep_next = 0;
+static GDir *orphan_dir = NULL;
+static GHashTable *orphan_live = NULL;
+
+static void gc_item_free(GcItem *item) {
+    g_free(item->original);
+    g_free(item->stored);
+    g_free(item);
+}
+
+/* "30m", "12h", "7d", "2w" -> seconds; "forever" -> -1; 0 on error */
+static gint64 parse_age(const char *s) {
+    if (g_strcmp0(s, "forever") == 0) return -1;
+    char *end = NULL;
+    gint64 n = g_ascii_strtoll(s, &end, 10);
+    if (end == s || n <= 0) return 0;
+    switch (*end) {
+        case 'm': return n * 60;
+        case 'h': return n * 60 * 60;
+        case 'd': return n * 24 * 60 * 60;
+        case 'w': return n * 7 * 24 * 60 * 60;
+        default: return 0;
+    }
+}
+
+/* Granularity name -> length of the YYYYMMDDHHMMSS prefix that identifies a bucket */
+static gint parse_granularity(const char *s) {
+    if (g_strcmp0(s, "all") == 0) return 14;
+    if (g_strcmp0(s, "minute") == 0) return 12;
+    if (g_strcmp0(s, "hourly") == 0) return 10;
+    if (g_strcmp0(s, "daily") == 0) return 8;
+    if (g_strcmp0(s, "monthly") == 0) return 6;
+    if (g_strcmp0(s, "yearly") == 0) return 4;
+    return 0;
+}
+
+static void load_rules(void) {
+    rules = g_array_new(FALSE, FALSE, sizeof(RetentionRule));
+    gchar *ini_path = g_build_filename(DATA_DIR, "retention.ini", NULL);
+    GKeyFile *kf = g_key_file_new();
+    if (g_key_file_load_from_file(kf, ini_path, G_KEY_FILE_NONE, NULL)) {
+        gchar *spec = g_key_file_get_string(kf, "retention", "rules", NULL);
+        gchar **parts = spec ? g_strsplit(spec, ";", -1) : NULL;
+        for (gchar **p = parts; p && *p; ++p) {
+            gchar *rule_text = g_strstrip(*p);
+            if (*rule_text == '\0') continue;
+            gchar **kv = g_strsplit(rule_text, ":", 2);
+            RetentionRule rule = { 0, 0 };
+            if (kv[0] && kv[1]) {
+                rule.max_age = parse_age(g_strstrip(kv[0]));
+                rule.prefix_len = parse_granularity(g_strstrip(kv[1]));
+            }
+            if (rule.max_age != 0 && rule.prefix_len != 0) {
+                g_array_append_val(rules, rule);
+            } else {
+                g_printerr("retention: ignoring invalid rule '%s'\n", rule_text);
+            }
+            g_strfreev(kv);
+        }
+        g_strfreev(parts);
+        g_free(spec);
+    }
+    g_key_file_free(kf);
+    g_free(ini_path);
+}
+
+static gint64 timestamp_to_unix(const char *ts) {
+    if (!ts || strlen(ts) < 14) return 0;
+    char buf[5];
+    int f[6];
+    static const int off[6] = { 0, 4, 6, 8, 10, 12 };
+    static const int len[6] = { 4, 2, 2, 2, 2, 2 };
+    for (int i = 0; i < 6; ++i) {
+        memcpy(buf, ts + off[i], len[i]);
+        buf[len[i]] = '\0';
+        f[i] = atoi(buf);
+    }
+    GDateTime *dt = g_date_time_new_local(f[0], f[1], f[2], f[3], f[4], (gdouble)f[5]);
+    if (!dt) return 0;
+    gint64 unix_time = g_date_time_to_unix(dt);
+    g_date_time_unref(dt);
+    return unix_time;
+}
+
+// ---
+// --- Throttled garbage collection
+// ---
+
+static gboolean gc_step(gpointer user_data) {
+    const char *names[GC_BATCH_FILES];
+    GcItem *items[GC_BATCH_FILES];
+    guint n_names = 0, n_items = 0;
+
+    while (n_items < GC_BATCH_FILES && !g_queue_is_empty(&gc_queue)) {
+        GcItem *item = g_queue_pop_head(&gc_queue);
+        items[n_items++] = item;
+        /* An orphan may have been recorded since the sweep saw it; never unlink a live version */
+        if (!item->original && version_index_lookup_stored(item->stored, NULL)) continue;
+        gchar *path = g_build_filename(DATA_DIR, "versions", item->stored, NULL);
+        if (g_remove(path) != 0 && g_file_test(path, G_FILE_TEST_EXISTS)) {
+            g_printerr("retention: failed to remove %s\n", path);
+            g_free(path);
+            continue;
+        }
+        g_free(path);
+        if (item->original) names[n_names++] = item->stored;
+    }
+
+    /* One index append for the whole batch */
+    if (n_names > 0) version_index_remove_batch(names, n_names);
+
+    for (guint i = 0; i < n_items; ++i) {
+        GcItem *item = items[i];
+        gboolean notify = item->original != NULL;
+        /* Report each affected file once per batch */
+        for (guint j = 0; notify && j < i; ++j) {
+            if (g_strcmp0(items[j]->original, item->original) == 0) notify = FALSE;
+        }
+        if (notify && collected_func) collected_func(item->original, collected_data);
+    }
+    for (guint i = 0; i < n_items; ++i) {
+        g_hash_table_remove(gc_pending, items[i]->stored);
+        gc_item_free(items[i]);
+    }
+
+    if (g_queue_is_empty(&gc_queue)) {
+        gc_source = 0;
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static void gc_enqueue(const char *original, const char *stored) {
+    if (g_hash_table_contains(gc_pending, stored)) return;
+    GcItem *item = g_new0(GcItem, 1);
+    item->original = g_strdup(original);
+    item->stored = g_strdup(stored);
+    g_hash_table_add(gc_pending, g_strdup(stored));
+    g_queue_push_tail(&gc_queue, item);
+    if (gc_source == 0) {
+        gc_source = g_timeout_add_full(G_PRIORITY_LOW, GC_TICK_MS, gc_step, NULL, NULL);
+    }
+}
+
+// ---
+// --- Rule evaluation
+// ---
+
+typedef struct {
+    gchar *stored;
+    gchar *timestamp;
+} FileVersion;
+
+static void file_version_free(gpointer p) {
+    FileVersion *v = p;
+    g_free(v->stored);
+    g_free(v->timestamp);
+    g_free(v);
+}
+
+static void collect_version(const char *original_path, const char *stored, const char *ts, gpointer user_data) {
+    FileVersion *v = g_new0(FileVersion, 1);
+    v->stored = g_strdup(stored);
+    v->timestamp = g_strdup(ts);
+    g_ptr_array_add((GPtrArray *)user_data, v);
+}
+
+static gint compare_newest_first(gconstpointer a, gconstpointer b) {
+    const FileVersion *va = *(FileVersion * const *)a;
+    const FileVersion *vb = *(FileVersion * const *)b;
+    return g_strcmp0(vb->timestamp, va->timestamp);
+}
+
+/* Queues every version of original_path that no rule wants to keep */
+static void evaluate_file(const char *original_path) {
+    if (!rules || rules->len == 0) return;
+
+    GPtrArray *versions = g_ptr_array_new_with_free_func(file_version_free);
+    version_index_foreach_for_path(original_path, collect_version, versions);
+    g_ptr_array_sort(versions, compare_newest_first);
+
+    gint64 now = g_get_real_time() / G_USEC_PER_SEC;
+    GHashTable *buckets = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    for (guint i = 0; i < versions->len; ++i) {
+        FileVersion *v = g_ptr_array_index(versions, i);
+        gint64 age = now - timestamp_to_unix(v->timestamp);
+
+        const RetentionRule *rule = NULL;
+        guint r;
+        for (r = 0; r < rules->len; ++r) {
+            const RetentionRule *candidate = &g_array_index(rules, RetentionRule, r);
+            if (candidate->max_age < 0 || age <= candidate->max_age) { rule = candidate; break; }
+        }
+
+        gboolean keep = FALSE;
+        if (rule && rule->prefix_len >= 14) {
+            keep = TRUE;
+        } else if (rule) {
+            /* Newest-first order: the first version seen in a bucket is the one kept */
+            gchar *bucket = g_strdup_printf("%u:%.*s", r, rule->prefix_len, v->timestamp);
+            if (!g_hash_table_contains(buckets, bucket)) {
+                g_hash_table_add(buckets, bucket);
+                keep = TRUE;
+            } else {
+                g_free(bucket);
+            }
+        }
+        if (i == 0) keep = TRUE; /* never drop the newest version */
+
+        if (!keep) gc_enqueue(original_path, v->stored);
+    }
+
+    g_hash_table_destroy(buckets);
+    g_ptr_array_free(versions, TRUE);
+}
+
+void retention_note_recorded(const char *original_path) {
+    if (!original_path || !rules) return;
+    evaluate_file(original_path);
+}
+
+// ---
+// --- Periodic sweep: every tracked file, then orphaned snapshot files
+// ---
+
+static void collect_live_stored(const char *original_path, const char *stored, const char *ts, gpointer user_data) {
+    g_hash_table_add((GHashTable *)user_data, g_strdup(stored));
+}
+
+static void collect_path(const char *path, gpointer user_data) {
+    g_ptr_array_add((GPtrArray *)user_data, g_strdup(path));
+}
+
+static void sweep_reset(void) {
+    g_clear_pointer(&sweep_paths, g_ptr_array_unref);
+    g_clear_pointer(&orphan_dir, g_dir_close);
+    g_clear_pointer(&orphan_live, g_hash_table_unref);
+    sweep_next = 0;
+}
+
+/* One file per tick, then ORPHAN_SCAN_CHUNK directory entries per tick */
+static gboolean sweep_step(gpointer user_data) {
+    if (sweep_paths && sweep_next < sweep_paths->len) {
+        evaluate_file(g_ptr_array_index(sweep_paths, sweep_next++));
+        return G_SOURCE_CONTINUE;
+    }
+
+    if (!orphan_dir) {
+        gchar *versions_dir = g_build_filename(DATA_DIR, "versions", NULL);
+        orphan_dir = g_dir_open(versions_dir, 0, NULL);
+        g_free(versions_dir);
+        if (!orphan_dir) { sweep_reset(); return G_SOURCE_REMOVE; }
+        orphan_live = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+        version_index_foreach(collect_live_stored, orphan_live);
+    }
+
+    gint64 now = g_get_real_time() / G_USEC_PER_SEC;
+    for (guint n = 0; n < ORPHAN_SCAN_CHUNK; ++n) {
+        const char *name = g_dir_read_name(orphan_dir);
+        if (!name) { sweep_reset(); return G_SOURCE_REMOVE; }
+        if (g_hash_table_contains(orphan_live, name)) continue;
+
+        gchar *path = g_build_filename(DATA_DIR, "versions", name, NULL);
+        GStatBuf st;
+        if (g_stat(path, &st) == 0 && S_ISREG(st.st_mode) && now - (gint64)st.st_ctime > ORPHAN_MIN_AGE_SECONDS) {
+            gc_enqueue(NULL, name);
+        }
+        g_free(path);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean start_sweep(gpointer user_data) {
+    if (sweep_paths || orphan_dir) return G_SOURCE_CONTINUE; /* previous sweep still running */
+    sweep_paths = g_ptr_array_new_with_free_func(g_free);
+    files_index_foreach(collect_path, sweep_paths);
+    sweep_next = 0;
+    g_idle_add_full(G_PRIORITY_LOW, sweep_step, NULL, NULL);
+    return G_SOURCE_CONTINUE;
+}
+
+void retention_init(RetentionCollectedFunc func, gpointer user_data) {
+    if (rules) return;
+    collected_func = func;
+    collected_data = user_data;
+    gc_pending = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    load_rules();
+    if (rules->len == 0) return; /* no policy configured: keep everything */
+
+    g_timeout_add_seconds_full(G_PRIORITY_LOW, RETENTION_SWEEP_SECONDS, start_sweep, NULL, NULL);
+    start_sweep(NULL);
+}
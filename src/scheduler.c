@@ -0,0 +1,295 @@
+#include "scheduler.h"
+#include <gtk/gtk.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    SchedulerFunc func;
+    SchedulerDoneFunc done;
+    gpointer data;
+    GDestroyNotify destroy;
+    GCancellable *cancellable;
+    gboolean cancelled;
+} SchedulerTask;
+
+/* A worker's own deques: the owner pushes and pops at the tail, thieves take the head */
+typedef struct {
+    GMutex lock;
+    GQueue queues[SCHEDULER_N_PRIORITIES];
+} Worker;
+
+static Worker *workers = NULL;
+static guint n_workers = 0;
+static GPrivate current_worker;          /* worker index + 1 on pool threads */
+
+static GMutex shared_lock;               /* guards shared queues; also the sleep lock */
+static GCond wake;
+static GQueue shared[SCHEDULER_N_PRIORITIES];
+
+static gint queued = 0;                  /* atomic; tasks on any queue */
+static gint running = 0;                 /* atomic */
+static guint64 completed = 0;            /* under shared_lock */
+static guint64 stolen = 0;               /* under shared_lock */
+
+static void task_free(SchedulerTask *task) {
+    if (task->destroy) task->destroy(task->data);
+    if (task->cancellable) g_object_unref(task->cancellable);
+    g_free(task);
+}
+
+static gboolean deliver_done(gpointer user_data) {
+    SchedulerTask *task = user_data;
+    task->done(task->data, task->cancelled);
+    return G_SOURCE_REMOVE;
+}
+
+static void run_task(SchedulerTask *task) {
+    g_atomic_int_inc(&running);
+    task->cancelled = task->cancellable && g_cancellable_is_cancelled(task->cancellable);
+    if (!task->cancelled) {
+        task->func(task->data, task->cancellable);
+        task->cancelled = task->cancellable && g_cancellable_is_cancelled(task->cancellable);
+    }
+    g_atomic_int_add(&running, -1);
+    g_mutex_lock(&shared_lock);
+    completed++;
+    g_mutex_unlock(&shared_lock);
+
+    if (task->done) g_main_context_invoke_full(NULL, G_PRIORITY_DEFAULT, deliver_done, task, (GDestroyNotify)task_free);
+    else task_free(task);
+}
+
+/* Most urgent task visible to worker self: own deque, shared queue, then other deques */
+static SchedulerTask *take_task(guint self) {
+    for (guint p = 0; p < SCHEDULER_N_PRIORITIES; ++p) {
+        Worker *own = &workers[self];
+        g_mutex_lock(&own->lock);
+        SchedulerTask *task = g_queue_pop_tail(&own->queues[p]);
+        g_mutex_unlock(&own->lock);
+        if (task) return task;
+
+        g_mutex_lock(&shared_lock);
+        task = g_queue_pop_head(&shared[p]);
+        g_mutex_unlock(&shared_lock);
+        if (task) return task;
+
+        for (guint i = 1; i < n_workers; ++i) {
+            Worker *victim = &workers[(self + i) % n_workers];
+            g_mutex_lock(&victim->lock);
+            task = g_queue_pop_head(&victim->queues[p]);
+            g_mutex_unlock(&victim->lock);
+            if (task) {
+                g_mutex_lock(&shared_lock);
+                stolen++;
+                g_mutex_unlock(&shared_lock);
+                return task;
+            }
+        }
+    }
+    return NULL;
+}
+
+static gpointer worker_main(gpointer data) {
+    guint self = GPOINTER_TO_UINT(data);
+    g_private_set(&current_worker, GUINT_TO_POINTER(self + 1));
+    for (;;) {
+        SchedulerTask *task = take_task(self);
+        if (task) {
+            g_atomic_int_add(&queued, -1);
+            run_task(task);
+            continue;
+        }
+        /* Submitters bump queued before signalling under shared_lock, so no wake-up is lost */
+        g_mutex_lock(&shared_lock);
+        while (g_atomic_int_get(&queued) == 0) g_cond_wait(&wake, &shared_lock);
+        g_mutex_unlock(&shared_lock);
+    }
+    return NULL;
+}
+
+static gboolean log_stats(gpointer user_data) {
+    SchedulerStats stats;
+    scheduler_get_stats(&stats);
+    g_print("scheduler: %u threads, %u running, queued %u/%u/%u (interactive/default/background), "
+            "%" G_GUINT64_FORMAT " completed, %" G_GUINT64_FORMAT " stolen\n",
+            stats.threads, stats.running, stats.queued[SCHEDULER_PRIORITY_INTERACTIVE],
+            stats.queued[SCHEDULER_PRIORITY_DEFAULT], stats.queued[SCHEDULER_PRIORITY_BACKGROUND],
+            stats.completed, stats.stolen);
+    return G_SOURCE_CONTINUE;
+}
+
+void scheduler_init(void) {
+    static gsize once = 0;
+    if (!g_once_init_enter(&once)) return;
+    n_workers = MAX(2u, g_get_num_processors());
+    workers = g_new0(Worker, n_workers);
+    for (guint i = 0; i < n_workers; ++i) g_mutex_init(&workers[i].lock);
+    for (guint i = 0; i < n_workers; ++i) {
+        GThread *thread = g_thread_new("deltac-worker", worker_main, GUINT_TO_POINTER(i));
+        g_thread_unref(thread);
+    }
+
+    const char *interval = g_getenv("DELTAC_SCHEDULER_STATS");
+    guint seconds = interval ? (guint)atoi(interval) : 0;
+    if (seconds > 0) g_timeout_add_seconds(seconds, log_stats, NULL);
+    g_once_init_leave(&once, 1);
+}
+
+static void push_task(SchedulerPriority priority, SchedulerTask *task) {
+    scheduler_init();
+    guint self = GPOINTER_TO_UINT(g_private_get(&current_worker));
+    if (self > 0) {
+        Worker *own = &workers[self - 1];
+        g_mutex_lock(&own->lock);
+        g_queue_push_tail(&own->queues[priority], task);
+        g_mutex_unlock(&own->lock);
+        g_atomic_int_inc(&queued);
+        g_mutex_lock(&shared_lock);
+    } else {
+        g_mutex_lock(&shared_lock);
+        g_queue_push_tail(&shared[priority], task);
+        g_atomic_int_inc(&queued);
+    }
+    g_cond_signal(&wake);
+    g_mutex_unlock(&shared_lock);
+}
+
+void scheduler_submit(SchedulerPriority priority, SchedulerFunc func, SchedulerDoneFunc done,
+                      gpointer data, GDestroyNotify destroy, GCancellable *cancellable) {
+    SchedulerTask *task = g_new0(SchedulerTask, 1);
+    task->func = func;
+    task->done = done;
+    task->data = data;
+    task->destroy = destroy;
+    task->cancellable = cancellable ? g_object_ref(cancellable) : NULL;
+    push_task(priority, task);
+}
+
+// ---
+// --- GTask adapter
+// ---
+
+typedef struct {
+    GTask *task;
+    GTaskThreadFunc func;
+} TaskRun;
+
+static void task_run_free(gpointer data) {
+    TaskRun *run = data;
+    g_object_unref(run->task);
+    g_free(run);
+}
+
+static void run_gtask(gpointer data, GCancellable *cancellable) {
+    TaskRun *run = data;
+    /* Cancelled while queued: skip the work but still complete the task */
+    if (g_task_return_error_if_cancelled(run->task)) return;
+    run->func(run->task, g_task_get_source_object(run->task), g_task_get_task_data(run->task),
+              g_task_get_cancellable(run->task));
+}
+
+void scheduler_run_task(GTask *task, GTaskThreadFunc func, SchedulerPriority priority) {
+    TaskRun *run = g_new(TaskRun, 1);
+    run->task = g_object_ref(task);
+    run->func = func;
+    /* No cancellable here: run_gtask() must always run so the task returns;
+     * it checks the task's own cancellable instead */
+    scheduler_submit(priority, run_gtask, NULL, run, task_run_free, NULL);
+}
+
+// ---
+// --- Parallel for
+// ---
+
+/* Indices a helper runs before it re-queues itself, so that a worker busy
+ * with a long range goes back to take_task() and can pick more urgent work */
+#define PARALLEL_FOR_CHUNK 8
+
+typedef struct {
+    gint ref_count;
+    SchedulerPriority priority;
+    guint n;
+    gint next;       /* atomic; next index to claim */
+    gint finished;   /* atomic */
+    SchedulerRangeFunc func;
+    gpointer user_data;
+    GMutex lock;
+    GCond done;
+} ParallelFor;
+
+static void parallel_for_unref(gpointer data) {
+    ParallelFor *pf = data;
+    if (!g_atomic_int_dec_and_test(&pf->ref_count)) return;
+    g_mutex_clear(&pf->lock);
+    g_cond_clear(&pf->done);
+    g_free(pf);
+}
+
+/* Claims and runs up to limit indices (all remaining if 0); returns FALSE
+ * once none are left */
+static gboolean parallel_for_run(ParallelFor *pf, guint limit) {
+    for (guint count = 0; limit == 0 || count < limit; ++count) {
+        guint i = (guint)g_atomic_int_add(&pf->next, 1);
+        if (i >= pf->n) return FALSE;
+        pf->func(i, pf->user_data);
+        if ((guint)g_atomic_int_add(&pf->finished, 1) + 1 == pf->n) {
+            g_mutex_lock(&pf->lock);
+            g_cond_signal(&pf->done);
+            g_mutex_unlock(&pf->lock);
+        }
+    }
+    return (guint)g_atomic_int_get(&pf->next) < pf->n;
+}
+
+/* Helper task: one chunk, then back on the queue if indices are left.
+ * Helpers that start late find nothing to do. */
+static void parallel_for_work(gpointer data, GCancellable *cancellable) {
+    ParallelFor *pf = data;
+    if (!parallel_for_run(pf, PARALLEL_FOR_CHUNK)) return;
+    g_atomic_int_inc(&pf->ref_count);
+    scheduler_submit(pf->priority, parallel_for_work, NULL, pf, parallel_for_unref, NULL);
+}
+
+void scheduler_parallel_for(guint n, SchedulerPriority priority, SchedulerRangeFunc func, gpointer user_data) {
+    if (n == 0) return;
+    scheduler_init();
+    ParallelFor *pf = g_new0(ParallelFor, 1);
+    pf->ref_count = 1;
+    pf->priority = priority;
+    pf->n = n;
+    pf->func = func;
+    pf->user_data = user_data;
+    g_mutex_init(&pf->lock);
+    g_cond_init(&pf->done);
+
+    guint helpers = MIN(n, n_workers) - 1;
+    for (guint i = 0; i < helpers; ++i) {
+        g_atomic_int_inc(&pf->ref_count);
+        scheduler_submit(priority, parallel_for_work, NULL, pf, parallel_for_unref, NULL);
+    }
+    /* The caller has to wait for the range anyway, so it does not yield */
+    parallel_for_run(pf, 0);
+
+    /* Only indices already being run by helpers are left to wait for */
+    g_mutex_lock(&pf->lock);
+    while ((guint)g_atomic_int_get(&pf->finished) < n) g_cond_wait(&pf->done, &pf->lock);
+    g_mutex_unlock(&pf->lock);
+    parallel_for_unref(pf);
+}
+
+void scheduler_get_stats(SchedulerStats *stats) {
+    scheduler_init();
+    memset(stats, 0, sizeof(*stats));
+    stats->threads = n_workers;
+    stats->running = (guint)g_atomic_int_get(&running);
+    g_mutex_lock(&shared_lock);
+    for (guint p = 0; p < SCHEDULER_N_PRIORITIES; ++p) stats->queued[p] = shared[p].length;
+    stats->completed = completed;
+    stats->stolen = stolen;
+    g_mutex_unlock(&shared_lock);
+    for (guint i = 0; i < n_workers; ++i) {
+        g_mutex_lock(&workers[i].lock);
+        for (guint p = 0; p < SCHEDULER_N_PRIORITIES; ++p) stats->queued[p] += workers[i].queues[p].length;
+        g_mutex_unlock(&workers[i].lock);
+    }
+}
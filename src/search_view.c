@@ -0,0 +1,146 @@
+#include "search_view.h"
+#include "content_index.h"
+#include "context_menu.h"
+#include "list_items.h"
+#include <gtk/gtk.h>
+#include <string.h>
+
+/* At most this many matching versions are listed */
+#define SEARCH_MAX_RESULTS 2000
+
+typedef struct {
+    GListStore *results;      // DeltaVersionItem with hits set
+    GtkWidget *status_label;
+} SearchData;
+
+static void search_data_free(GtkWidget *widget, gpointer user_data) {
+    SearchData *data = (SearchData *)user_data;
+    g_object_unref(data->results);
+    g_free(data);
+}
+
+static void result_row_setup(GtkSignalListItemFactory *factory, GtkListItem *list_item, gpointer user_data) {
+    GtkWidget *hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 8);
+    GtkWidget *name_label = gtk_label_new(NULL);
+    gtk_widget_set_hexpand(name_label, TRUE);
+    gtk_label_set_xalign(GTK_LABEL(name_label), 0.0);
+    gtk_label_set_ellipsize(GTK_LABEL(name_label), PANGO_ELLIPSIZE_MIDDLE);
+    GtkWidget *time_label = gtk_label_new(NULL);
+    GtkWidget *hits_label = gtk_label_new(NULL);
+    gtk_label_set_xalign(GTK_LABEL(hits_label), 1.0);
+    gtk_label_set_width_chars(GTK_LABEL(hits_label), 8);
+    gtk_box_append(GTK_BOX(hbox), name_label);
+    gtk_box_append(GTK_BOX(hbox), time_label);
+    gtk_box_append(GTK_BOX(hbox), hits_label);
+    g_object_set_data(G_OBJECT(hbox), "name-label", name_label);
+    g_object_set_data(G_OBJECT(hbox), "time-label", time_label);
+    g_object_set_data(G_OBJECT(hbox), "hits-label", hits_label);
+    gtk_list_item_set_child(list_item, hbox);
+}
+
+static void result_row_bind(GtkSignalListItemFactory *factory, GtkListItem *list_item, gpointer user_data) {
+    GtkWidget *hbox = gtk_list_item_get_child(list_item);
+    DeltaVersionItem *item = gtk_list_item_get_item(list_item);
+    const char *ts = delta_version_item_get_timestamp(item);
+
+    char when[32];
+    if (strlen(ts) >= 14) {
+        g_snprintf(when, sizeof(when), "%.4s-%.2s-%.2s %.2s:%.2s:%.2s",
+                   ts, ts + 4, ts + 6, ts + 8, ts + 10, ts + 12);
+    } else {
+        g_strlcpy(when, ts, sizeof(when));
+    }
+    guint hits = delta_version_item_get_hits(item);
+    gchar *hits_text = g_strdup_printf("%u hit%s", hits, hits == 1 ? "" : "s");
+
+    gtk_label_set_text(GTK_LABEL(g_object_get_data(G_OBJECT(hbox), "name-label")),
+                       delta_version_item_get_stored_name(item));
+    gtk_label_set_text(GTK_LABEL(g_object_get_data(G_OBJECT(hbox), "time-label")), when);
+    gtk_label_set_text(GTK_LABEL(g_object_get_data(G_OBJECT(hbox), "hits-label")), hits_text);
+    g_free(hits_text);
+}
+
+static void on_search_changed(GtkSearchEntry *entry, gpointer user_data) {
+    SearchData *data = (SearchData *)user_data;
+    const char *text = gtk_editable_get_text(GTK_EDITABLE(entry));
+
+    GArray *hits = content_index_query(text, SEARCH_MAX_RESULTS);
+    gpointer *items = g_new(gpointer, hits->len ? hits->len : 1);
+    for (guint i = 0; i < hits->len; ++i) {
+        ContentHit *hit = &g_array_index(hits, ContentHit, i);
+        DeltaVersionItem *item = delta_version_item_new(hit->file_id, hit->stored_name, hit->timestamp);
+        delta_version_item_set_hits(item, hit->hits);
+        items[i] = item;
+    }
+    g_list_store_splice(data->results, 0, g_list_model_get_n_items(G_LIST_MODEL(data->results)), items, hits->len);
+    for (guint i = 0; i < hits->len; ++i) g_object_unref(items[i]);
+    g_free(items);
+
+    /* Versions still being indexed are not searchable yet; say so */
+    guint pending = content_index_pending();
+    gchar *status;
+    if (pending > 0)
+        status = g_strdup_printf("%u matching versions (%u still being indexed)", hits->len, pending);
+    else
+        status = g_strdup_printf("%u matching versions", hits->len);
+    gtk_label_set_text(GTK_LABEL(data->status_label), (text && *text) ? status : "");
+    g_free(status);
+    g_array_unref(hits);
+}
+
+static void on_result_activate(GtkListView *list_view, guint position, gpointer user_data) {
+    SearchData *data = (SearchData *)user_data;
+    DeltaVersionItem *item = g_list_model_get_item(G_LIST_MODEL(data->results), position);
+    if (!item) return;
+    gchar *path = delta_version_item_dup_path(item);
+    open_version_path(path);
+    g_free(path);
+    g_object_unref(item);
+}
+
+void create_search_window(GtkWindow *parent) {
+    content_index_init();
+
+    GtkWidget *window = gtk_window_new();
+    gtk_window_set_title(GTK_WINDOW(window), "Search Versions");
+    gtk_window_set_transient_for(GTK_WINDOW(window), parent);
+    gtk_window_set_default_size(GTK_WINDOW(window), 640, 420);
+
+    GtkWidget *vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 6);
+    gtk_widget_set_margin_top(vbox, 8);
+    gtk_widget_set_margin_bottom(vbox, 8);
+    gtk_widget_set_margin_start(vbox, 8);
+    gtk_widget_set_margin_end(vbox, 8);
+
+    GtkWidget *entry = gtk_search_entry_new();
+    gtk_search_entry_set_placeholder_text(GTK_SEARCH_ENTRY(entry), "Find text in any stored version");
+    GtkWidget *status_label = gtk_label_new(NULL);
+    gtk_label_set_xalign(GTK_LABEL(status_label), 0.0);
+
+    SearchData *data = g_new0(SearchData, 1);
+    data->results = g_list_store_new(DELTA_TYPE_VERSION_ITEM);
+    data->status_label = status_label;
+
+    GtkListItemFactory *factory = gtk_signal_list_item_factory_new();
+    g_signal_connect(factory, "setup", G_CALLBACK(result_row_setup), NULL);
+    g_signal_connect(factory, "bind", G_CALLBACK(result_row_bind), NULL);
+    GtkNoSelection *selection = gtk_no_selection_new(G_LIST_MODEL(g_object_ref(data->results)));
+    GtkWidget *list_view = gtk_list_view_new(GTK_SELECTION_MODEL(selection), factory);
+    gtk_list_view_set_single_click_activate(GTK_LIST_VIEW(list_view), FALSE);
+
+    GtkWidget *scrolled = gtk_scrolled_window_new();
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(scrolled), list_view);
+    gtk_widget_set_vexpand(scrolled, TRUE);
+
+    gtk_box_append(GTK_BOX(vbox), entry);
+    gtk_box_append(GTK_BOX(vbox), status_label);
+    gtk_box_append(GTK_BOX(vbox), scrolled);
+    gtk_window_set_child(GTK_WINDOW(window), vbox);
+
+    g_signal_connect(entry, "search-changed", G_CALLBACK(on_search_changed), data);
+    g_signal_connect(list_view, "activate", G_CALLBACK(on_result_activate), data);
+    g_signal_connect(window, "destroy", G_CALLBACK(search_data_free), data);
+
+    gtk_window_present(GTK_WINDOW(window));
+}
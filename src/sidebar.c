@@ -1,221 +1,401 @@
 #include "sidebar.h" // Or "temp.h" as your file includes
 #include "context_menu.h"
+#include "version_index.h"
+#include "list_items.h"
+#include "trigram_index.h"
+#include "version_cache.h"
 #include <gtk/gtk.h>
 #include <glib/gstdio.h> // For g_path_get_basename
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <time.h>
-#if defined(__has_include)
-# if __has_include(<json-glib/json-glib.h>)
-#  include <json-glib/json-glib.h>
-#  define HAVE_JSON_GLIB 1
-# endif
-#endif
 #if defined(G_OS_WIN32)
 #include <windows.h>
 #include <shellapi.h>
 #endif
 
+/* At most this many ranked matches are shown for a filter query */
+#define FILTER_MAX_RESULTS 1000
+
 // This struct now holds all widgets our sidebar needs
 typedef struct {
     GtkWindow *parent_window;
-    GtkWidget *list_box;
+    GListStore *files_store;       // DeltaFileItem per tracked file
+    GListStore *results_store;     // ranked matches while a filter is active
+    GtkSingleSelection *selection;
+    GtkWidget *list_view;
     GtkWidget *delete_button; // So we can enable/disable it
+    TrigramIndex *filter_index;    // over tracked paths, keyed by file id
+    GHashTable *items_by_id;       // file id -> DeltaFileItem (borrowed from files_store)
+    gchar *filter_query;           // NULL when the full list is shown
 } SidebarData;
 
-/* Forward: populate_versions_for_path is used externally */
-void populate_versions_for_path(GtkWindow *parent, GtkListBox *versions_list, const char *original_path);
+static void sidebar_data_free(GtkWidget *widget, gpointer user_data) {
+    SidebarData *data = (SidebarData *)user_data;
+    trigram_index_free(data->filter_index);
+    g_hash_table_destroy(data->items_by_id);
+    g_object_unref(data->results_store);
+    g_object_unref(data->files_store);
+    g_free(data->filter_query);
+    g_free(data);
+}
 
-/* Clear all children from a container (list box) */
-void clear_list_box_widget(GtkWidget *box_widget) {
-    if (!GTK_IS_WIDGET(box_widget)) return;
+static const char *path_for_id(guint32 id, gpointer user_data) {
+    return version_index_path_for_id(id);
+}
 
-    if (GTK_IS_LIST_BOX(box_widget)) {
-        GtkListBox *box = GTK_LIST_BOX(box_widget);
-        GtkListBoxRow *row;
-        while ((row = gtk_list_box_get_row_at_index(box, 0)) != NULL) {
-            gtk_list_box_remove(box, GTK_WIDGET(row));
-        }
-    } else {
-        GtkWidget *child;
-        while ((child = gtk_widget_get_first_child(box_widget)) != NULL) {
-            gtk_widget_unparent(child);
-        }
+/* Fills results_store with the ranked matches of the current query */
+static void apply_filter(SidebarData *data) {
+    if (!data->filter_query) {
+        gtk_single_selection_set_model(data->selection, G_LIST_MODEL(data->files_store));
+        return;
     }
+    GArray *ids = trigram_index_query(data->filter_index, data->filter_query, FILTER_MAX_RESULTS);
+    gpointer *items = g_new(gpointer, ids->len ? ids->len : 1);
+    guint n = 0;
+    for (guint i = 0; i < ids->len; ++i) {
+        gpointer item = g_hash_table_lookup(data->items_by_id, GUINT_TO_POINTER(g_array_index(ids, guint32, i)));
+        if (item) items[n++] = item;
+    }
+    g_list_store_splice(data->results_store, 0,
+                        g_list_model_get_n_items(G_LIST_MODEL(data->results_store)), items, n);
+    g_free(items);
+    g_array_unref(ids);
+    if (gtk_single_selection_get_model(data->selection) != G_LIST_MODEL(data->results_store))
+        gtk_single_selection_set_model(data->selection, G_LIST_MODEL(data->results_store));
 }
 
-/* Add a full path to the sidebar list (creates row, label, gesture, stores file-path) */
+static void on_filter_changed(GtkSearchEntry *entry, gpointer user_data) {
+    SidebarData *data = (SidebarData *)user_data;
+    const char *text = gtk_editable_get_text(GTK_EDITABLE(entry));
+    g_free(data->filter_query);
+    data->filter_query = (text && *text) ? g_strdup(text) : NULL;
+    apply_filter(data);
+}
+
+/* Add a full path to the sidebar list; the row itself is created on demand */
 static void add_path_to_list(SidebarData *data, const char *full_path) {
     if (!data || !full_path) return;
-    char *basename = g_path_get_basename(full_path);
-    GtkWidget *row = gtk_list_box_row_new();
-    GtkWidget *hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 6);
-    GtkWidget *list_row_label = gtk_label_new(basename);
-    gtk_widget_set_halign(list_row_label, GTK_ALIGN_START);
-    gtk_label_set_wrap(GTK_LABEL(list_row_label), TRUE);
-    gtk_box_append(GTK_BOX(hbox), list_row_label);
-    gtk_list_box_row_set_child(GTK_LIST_BOX_ROW(row), hbox);
-    gtk_widget_set_name(row, basename);
-    g_object_set_data(G_OBJECT(row), "label-widget", list_row_label);
+    DeltaFileItem *item = delta_file_item_new(full_path);
+    g_list_store_append(data->files_store, item);
+    guint32 id = version_index_lookup_path(full_path);
+    if (id != 0) {
+        g_hash_table_insert(data->items_by_id, GUINT_TO_POINTER(id), item);
+        trigram_index_add(data->filter_index, id, full_path);
+    }
+    g_object_unref(item);
+}
+
+static void remove_item(SidebarData *data, DeltaFileItem *item) {
+    const char *path = delta_file_item_get_path(item);
+    guint32 id = version_index_lookup_path(path);
+    if (id != 0 && g_hash_table_lookup(data->items_by_id, GUINT_TO_POINTER(id)) == item) {
+        g_hash_table_remove(data->items_by_id, GUINT_TO_POINTER(id));
+        trigram_index_remove(data->filter_index, id, path);
+    }
+    guint pos;
+    if (g_list_store_find(data->results_store, item, &pos))
+        g_list_store_remove(data->results_store, pos);
+    if (g_list_store_find(data->files_store, item, &pos))
+        g_list_store_remove(data->files_store, pos);
+}
+
+void sidebar_remove_file(GtkWindow *parent_window, DeltaFileItem *item) {
+    SidebarData *data = g_object_get_data(G_OBJECT(parent_window), "sidebar-data");
+    if (data && item) remove_item(data, item);
+}
+
+void sidebar_rename_file(GtkWindow *parent_window, DeltaFileItem *item, const char *new_path) {
+    SidebarData *data = g_object_get_data(G_OBJECT(parent_window), "sidebar-data");
+    if (!data || !item || !new_path) return;
+    /* The file id survives the rename, so only the postings move */
+    guint32 id = version_index_lookup_path(new_path);
+    if (id != 0) trigram_index_remove(data->filter_index, id, delta_file_item_get_path(item));
+    delta_file_item_set_path(item, new_path);
+    if (id != 0) trigram_index_add(data->filter_index, id, new_path);
+    delta_list_store_refresh(data->files_store, item);
+    if (data->filter_query) apply_filter(data);
+}
+
+/* files_index_foreach callback: adds a persisted path to the sidebar */
+static void add_indexed_path(const char *path, gpointer user_data) {
+    add_path_to_list((SidebarData *)user_data, path);
+}
+
+/* One right-click gesture per list view; the router resolves the row under the pointer */
+static void attach_context_gesture(GtkWidget *list_view, const char *context) {
     GtkGesture *right_click = gtk_gesture_click_new();
     gtk_gesture_single_set_button(GTK_GESTURE_SINGLE(right_click), GDK_BUTTON_SECONDARY);
     /* Do not make the right-click gesture exclusive — that can prevent
-     * normal left-click selection from reaching the list box. */
+     * normal left-click selection from reaching the list view. */
     gtk_gesture_single_set_exclusive(GTK_GESTURE_SINGLE(right_click), FALSE);
-    g_signal_connect(right_click, "pressed", G_CALLBACK(on_widget_right_click), (gpointer)"sidebar-element");
-    gtk_widget_add_controller(row, GTK_EVENT_CONTROLLER(right_click));
-    g_object_set_data_full(G_OBJECT(row), "file-path", g_strdup(full_path), g_free);
-    gtk_list_box_append(GTK_LIST_BOX(data->list_box), row);
+    g_signal_connect(right_click, "pressed", G_CALLBACK(on_widget_right_click), (gpointer)context);
+    gtk_widget_add_controller(list_view, GTK_EVENT_CONTROLLER(right_click));
+}
+
+// --- File rows: built once per visible slot, rebound as the list scrolls ---
+static void file_row_setup(GtkSignalListItemFactory *factory, GtkListItem *list_item, gpointer user_data) {
+    GtkWidget *hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 6);
+    GtkWidget *list_row_label = gtk_label_new(NULL);
+    gtk_widget_set_halign(list_row_label, GTK_ALIGN_START);
+    gtk_label_set_wrap(GTK_LABEL(list_row_label), TRUE);
+    gtk_box_append(GTK_BOX(hbox), list_row_label);
+    g_object_set_data(G_OBJECT(hbox), "label-widget", list_row_label);
+    gtk_list_item_set_child(list_item, hbox);
+}
+
+static void file_row_bind(GtkSignalListItemFactory *factory, GtkListItem *list_item, gpointer user_data) {
+    GtkWidget *hbox = gtk_list_item_get_child(list_item);
+    DeltaFileItem *item = gtk_list_item_get_item(list_item);
+    GtkWidget *label = g_object_get_data(G_OBJECT(hbox), "label-widget");
+    char *basename = g_path_get_basename(delta_file_item_get_path(item));
+    gtk_label_set_text(GTK_LABEL(label), basename);
     g_free(basename);
+    /* Lets the shared right-click handler map the picked widget back to its item */
+    g_object_set_data(G_OBJECT(hbox), "list-item", item);
 }
 
-/* Populate versions list for an original file path */
-void populate_versions_for_path(GtkWindow *parent, GtkListBox *versions_list, const char *original_path) {
-    if (!versions_list) return;
-    clear_list_box_widget(GTK_WIDGET(versions_list));
-    const char *data_dir = "data";
-    /* Try JSON index first (if available), otherwise fallback to text index */
-#ifdef HAVE_JSON_GLIB
-    gchar *index_path = g_build_filename(data_dir, "versions_index.json", NULL);
-    if (g_file_test(index_path, G_FILE_TEST_EXISTS)) {
-        GError *error = NULL;
-        JsonParser *parser = json_parser_new();
-        if (!json_parser_load_from_file(parser, index_path, &error)) {
-            g_printerr("Failed to parse versions index JSON: %s\n", error ? error->message : "unknown");
-            g_clear_error(&error);
-        } else {
-            JsonNode *root = json_parser_get_root(parser);
-            if (JSON_NODE_HOLDS_ARRAY(root)) {
-                JsonArray *arr = json_node_get_array(root);
-                guint len = json_array_get_length(arr);
-                for (guint i = 0; i < len; ++i) {
-                    JsonNode *elem = json_array_get_element(arr, i);
-                    if (!JSON_NODE_HOLDS_OBJECT(elem)) continue;
-                    JsonObject *obj = json_node_get_object(elem);
-                    const char *orig = json_object_get_string_member(obj, "original");
-                    const char *stored = json_object_get_string_member(obj, "stored");
-                    const char *ts = json_object_get_string_member(obj, "timestamp");
-                    if (!orig || !stored) continue;
-                    if (g_strcmp0(orig, original_path) == 0) {
-                        char timestr_human[128] = {0};
-                        if (ts && strlen(ts) >= 14) {
-                            struct tm tm = {0};
-                            char buf2[5];
-                            memcpy(buf2, ts+0, 4); buf2[4]='\0'; tm.tm_year = atoi(buf2) - 1900;
-                            memcpy(buf2, ts+4, 2); buf2[2]='\0'; tm.tm_mon = atoi(buf2) - 1;
-                            memcpy(buf2, ts+6, 2); buf2[2]='\0'; tm.tm_mday = atoi(buf2);
-                            memcpy(buf2, ts+8, 2); buf2[2]='\0'; tm.tm_hour = atoi(buf2);
-                            memcpy(buf2, ts+10,2); buf2[2]='\0'; tm.tm_min = atoi(buf2);
-                            memcpy(buf2, ts+12,2); buf2[2]='\0'; tm.tm_sec = atoi(buf2);
-                            strftime(timestr_human, sizeof(timestr_human), "%Y-%m-%d %H:%M:%S", &tm);
-                        } else if (ts) {
-                            g_strlcpy(timestr_human, ts, sizeof(timestr_human));
-                        }
-
-                        gchar *label_text = g_strdup_printf("%s  %s", stored, timestr_human);
-
-                        GtkWidget *vrow = gtk_list_box_row_new();
-                        GtkWidget *vlabel = gtk_label_new(label_text);
-                        gtk_widget_set_halign(vlabel, GTK_ALIGN_START);
-                        gtk_list_box_row_set_child(GTK_LIST_BOX_ROW(vrow), vlabel);
-
-                        gchar *stored_path = g_build_filename("data", "versions", stored, NULL);
-                        g_object_set_data_full(G_OBJECT(vrow), "version-path", g_strdup(stored_path), g_free);
-                        g_object_set_data_full(G_OBJECT(vrow), "file-path", g_strdup(stored_path), g_free); // Set file-path for comparison
-                        g_free(stored_path);
-
-                        /* Attach right-click gesture to version row so user can open/delete the version */
-                        GtkGesture *right_click = gtk_gesture_click_new();
-                        gtk_gesture_single_set_button(GTK_GESTURE_SINGLE(right_click), GDK_BUTTON_SECONDARY);
-                        gtk_gesture_single_set_exclusive(GTK_GESTURE_SINGLE(right_click), FALSE);
-                        g_signal_connect(right_click, "pressed", G_CALLBACK(on_widget_right_click), (gpointer)"version-element");
-                        gtk_widget_add_controller(vrow, GTK_EVENT_CONTROLLER(right_click));
-
-                        gtk_list_box_append(GTK_LIST_BOX(versions_list), vrow);
-                        g_free(label_text);
-                    }
-                }
-            }
-        }
-        g_object_unref(parser);
-        g_free(index_path);
-        return;
+static void row_unbind(GtkSignalListItemFactory *factory, GtkListItem *list_item, gpointer user_data) {
+    GtkWidget *child = gtk_list_item_get_child(list_item);
+    if (child) g_object_set_data(G_OBJECT(child), "list-item", NULL);
+}
+
+/* Versions the per-row sparkline spans, ending at the row's own version */
+#define SPARKLINE_POINTS 12
+
+static DeltaVersionItem *version_item_from_entry(const VersionEntry *e) {
+    DeltaVersionItem *item = delta_version_item_new(e->file_id, e->stored_name, e->timestamp);
+    if (e->has_stats) delta_version_item_set_stats(item, e->stats.added, e->stats.removed, e->stats.changed);
+    return item;
+}
+
+/* Catalog position of a version: binary search on the timestamp, then a
+ * pointer compare among versions recorded in the same second */
+static gint catalog_position(GArray *versions, DeltaVersionItem *item) {
+    const char *ts = delta_version_item_get_timestamp(item);
+    const char *stored = delta_version_item_get_stored_name(item);
+    for (guint i = version_index_lower_bound(versions, ts); i < versions->len; ++i) {
+        const VersionEntry *e = &g_array_index(versions, VersionEntry, i);
+        if (e->stored_name == stored) return (gint)i;
+        if (strcmp(e->timestamp, ts) != 0) break;
     }
-#endif
+    return -1;
+}
+
+/* Churn (lines added + removed + changed) of the versions leading up to this
+ * row, from the catalog only, so drawing never reads a file */
+static void draw_sparkline(GtkDrawingArea *area, cairo_t *cr, int width, int height, gpointer user_data) {
+    DeltaVersionItem *item = g_object_get_data(G_OBJECT(area), "version-item");
+    if (!item) return;
+    GArray *versions = version_index_get_versions_by_id(delta_version_item_get_file_id(item));
+    gint pos = versions ? catalog_position(versions, item) : -1;
+    if (pos < 0) return;
+
+    gint first = MAX(0, pos - SPARKLINE_POINTS + 1);
+    guint churn[SPARKLINE_POINTS];
+    guint n = 0, max = 1;
+    for (gint i = first; i <= pos; ++i) {
+        const VersionEntry *e = &g_array_index(versions, VersionEntry, i);
+        churn[n] = e->has_stats ? e->stats.added + e->stats.removed + e->stats.changed : 0;
+        max = MAX(max, churn[n]);
+        n++;
+    }
+
+    GdkRGBA color;
+    gtk_widget_get_color(GTK_WIDGET(area), &color);
+    gdk_cairo_set_source_rgba(cr, &color);
+    cairo_set_line_width(cr, 1.0);
+    double step = n > 1 ? (double)(width - 3) / (SPARKLINE_POINTS - 1) : 0;
+    double x0 = width - 2 - step * (n - 1);
+    for (guint i = 0; i < n; ++i) {
+        double x = x0 + step * i;
+        double y = height - 1.5 - (height - 3) * (double)churn[i] / max;
+        if (i == 0) cairo_move_to(cr, x, y);
+        else cairo_line_to(cr, x, y);
+    }
+    cairo_stroke(cr);
+    /* The row's own version */
+    double y = height - 1.5 - (height - 3) * (double)churn[n - 1] / max;
+    cairo_arc(cr, width - 2, y, 1.5, 0, 2 * G_PI);
+    cairo_fill(cr);
+}
+
+// --- Version rows: filename on the left, line stats and timestamp on the right ---
+static void version_row_setup(GtkSignalListItemFactory *factory, GtkListItem *list_item, gpointer user_data) {
+    GtkWidget *hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 8);
+    GtkWidget *name_label = gtk_label_new(NULL);
+    gtk_widget_set_halign(name_label, GTK_ALIGN_START);
+    gtk_widget_set_hexpand(name_label, TRUE);
+    gtk_label_set_xalign(GTK_LABEL(name_label), 0.0);
+
+    GtkWidget *sparkline = gtk_drawing_area_new();
+    gtk_drawing_area_set_content_width(GTK_DRAWING_AREA(sparkline), 48);
+    gtk_drawing_area_set_content_height(GTK_DRAWING_AREA(sparkline), 14);
+    gtk_widget_set_valign(sparkline, GTK_ALIGN_CENTER);
+    gtk_drawing_area_set_draw_func(GTK_DRAWING_AREA(sparkline), draw_sparkline, NULL, NULL);
+
+    GtkWidget *stats_label = gtk_label_new(NULL);
+    gtk_label_set_width_chars(GTK_LABEL(stats_label), 16);
+    gtk_label_set_xalign(GTK_LABEL(stats_label), 1.0);
+    gtk_widget_add_css_class(stats_label, "monospace");
+
+    GtkWidget *time_label = gtk_label_new(NULL);
+    gtk_widget_set_halign(time_label, GTK_ALIGN_END);
+    gtk_widget_set_hexpand(time_label, FALSE);
+    gtk_label_set_xalign(GTK_LABEL(time_label), 1.0);
+
+    gtk_box_append(GTK_BOX(hbox), name_label);
+    gtk_box_append(GTK_BOX(hbox), sparkline);
+    gtk_box_append(GTK_BOX(hbox), stats_label);
+    gtk_box_append(GTK_BOX(hbox), time_label);
+    g_object_set_data(G_OBJECT(hbox), "version-name-label", name_label);
+    g_object_set_data(G_OBJECT(hbox), "version-sparkline", sparkline);
+    g_object_set_data(G_OBJECT(hbox), "version-stats-label", stats_label);
+    g_object_set_data(G_OBJECT(hbox), "version-time-label", time_label);
+    gtk_list_item_set_child(list_item, hbox);
+}
+
+static void version_row_bind(GtkSignalListItemFactory *factory, GtkListItem *list_item, gpointer user_data) {
+    GtkWidget *hbox = gtk_list_item_get_child(list_item);
+    DeltaVersionItem *item = gtk_list_item_get_item(list_item);
+    const char *ts = delta_version_item_get_timestamp(item);
+
+    /* Only rows that scroll into view pay for timestamp formatting */
+    char timestr_human[128] = {0};
+    if (strlen(ts) >= 14) {
+        struct tm tm = {0};
+        char buf2[5];
+        memcpy(buf2, ts+0, 4); buf2[4]='\0'; tm.tm_year = atoi(buf2) - 1900;
+        memcpy(buf2, ts+4, 2); buf2[2]='\0'; tm.tm_mon = atoi(buf2) - 1;
+        memcpy(buf2, ts+6, 2); buf2[2]='\0'; tm.tm_mday = atoi(buf2);
+        memcpy(buf2, ts+8, 2); buf2[2]='\0'; tm.tm_hour = atoi(buf2);
+        memcpy(buf2, ts+10,2); buf2[2]='\0'; tm.tm_min = atoi(buf2);
+        memcpy(buf2, ts+12,2); buf2[2]='\0'; tm.tm_sec = atoi(buf2);
+        strftime(timestr_human, sizeof(timestr_human), "%Y-%m-%d %H:%M:%S", &tm);
+    } else {
+        g_strlcpy(timestr_human, ts, sizeof(timestr_human));
+    }
+
+    gtk_label_set_text(GTK_LABEL(g_object_get_data(G_OBJECT(hbox), "version-name-label")),
+                       delta_version_item_get_stored_name(item));
+    gtk_label_set_text(GTK_LABEL(g_object_get_data(G_OBJECT(hbox), "version-time-label")), timestr_human);
+
+    guint added, removed, changed;
+    GtkWidget *stats_label = g_object_get_data(G_OBJECT(hbox), "version-stats-label");
+    if (delta_version_item_get_stats(item, &added, &removed, &changed)) {
+        gchar *markup = g_strdup_printf("<span foreground='#2e7d32'>+%u</span> <span foreground='#c62828'>-%u</span> "
+                                        "<span foreground='#b26a00'>~%u</span>", added, removed, changed);
+        gtk_label_set_markup(GTK_LABEL(stats_label), markup);
+        g_free(markup);
+    } else {
+        gtk_label_set_text(GTK_LABEL(stats_label), "");
+    }
+    GtkWidget *sparkline = g_object_get_data(G_OBJECT(hbox), "version-sparkline");
+    g_object_set_data_full(G_OBJECT(sparkline), "version-item", g_object_ref(item), g_object_unref);
+    gtk_widget_queue_draw(sparkline);
+
+    if (delta_version_item_get_compare_selected(item))
+        gtk_widget_add_css_class(hbox, "selected-for-compare");
+    else
+        gtk_widget_remove_css_class(hbox, "selected-for-compare");
+
+    g_object_set_data(G_OBJECT(hbox), "list-item", item);
+}
 
-    /* Fallback: read text-based index */
-    gchar *index_path_txt = g_build_filename(data_dir, "versions_index.txt", NULL);
-    if (!g_file_test(index_path_txt, G_FILE_TEST_EXISTS)) { g_free(index_path_txt); return; }
-    FILE *f = fopen(index_path_txt, "r");
-    if (!f) { g_free(index_path_txt); return; }
-    char line[4096];
-    while (fgets(line, sizeof(line), f)) {
-        char *nl = strchr(line, '\n'); if (nl) *nl = '\0';
-        char *p1 = strchr(line, '|');
-        if (!p1) continue;
-        *p1 = '\0';
-        char *p2 = strchr(p1 + 1, '|');
-        if (!p2) continue;
-        *p2 = '\0';
-        const char *orig = line;
-        const char *stored = p1 + 1;
-        const char *ts = p2 + 1;
-        if (g_strcmp0(orig, original_path) == 0) {
-            char timestr_human[128] = {0};
-            if (strlen(ts) >= 14) {
-                struct tm tm = {0};
-                char buf2[5];
-                memcpy(buf2, ts+0, 4); buf2[4]='\0'; tm.tm_year = atoi(buf2) - 1900;
-                memcpy(buf2, ts+4, 2); buf2[2]='\0'; tm.tm_mon = atoi(buf2) - 1;
-                memcpy(buf2, ts+6, 2); buf2[2]='\0'; tm.tm_mday = atoi(buf2);
-                memcpy(buf2, ts+8, 2); buf2[2]='\0'; tm.tm_hour = atoi(buf2);
-                memcpy(buf2, ts+10,2); buf2[2]='\0'; tm.tm_min = atoi(buf2);
-                memcpy(buf2, ts+12,2); buf2[2]='\0'; tm.tm_sec = atoi(buf2);
-                strftime(timestr_human, sizeof(timestr_human), "%Y-%m-%d %H:%M:%S", &tm);
-            } else {
-                g_strlcpy(timestr_human, ts, sizeof(timestr_human));
-            }
-
-            gchar *label_text = g_strdup_printf("%s  %s", stored, timestr_human);
-
-            GtkWidget *vrow = gtk_list_box_row_new();
-            /* Create two-column row: filename on left, timestamp on right */
-            GtkWidget *hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 8);
-            GtkWidget *name_label = gtk_label_new(stored);
-            gtk_widget_set_halign(name_label, GTK_ALIGN_START);
-            gtk_widget_set_hexpand(name_label, TRUE);
-            gtk_label_set_xalign(GTK_LABEL(name_label), 0.0);
-
-            GtkWidget *time_label = gtk_label_new(timestr_human);
-            gtk_widget_set_halign(time_label, GTK_ALIGN_END);
-            gtk_widget_set_hexpand(time_label, FALSE);
-            gtk_label_set_xalign(GTK_LABEL(time_label), 1.0);
-
-            gtk_box_append(GTK_BOX(hbox), name_label);
-            gtk_box_append(GTK_BOX(hbox), time_label);
-            gtk_list_box_row_set_child(GTK_LIST_BOX_ROW(vrow), hbox);
-
-            gchar *stored_path = g_build_filename("data", "versions", stored, NULL);
-            g_object_set_data_full(G_OBJECT(vrow), "version-path", g_strdup(stored_path), g_free);
-            g_object_set_data_full(G_OBJECT(vrow), "file-path", g_strdup(stored_path), g_free); // Set file-path for comparison
-            /* Also store labels for potential updates */
-            g_object_set_data(G_OBJECT(vrow), "version-name-label", name_label);
-            g_object_set_data(G_OBJECT(vrow), "version-time-label", time_label);
-            g_free(stored_path);
-
-            /* Attach right-click gesture to version row so user can open/delete the version */
-            GtkGesture *right_click = gtk_gesture_click_new();
-            gtk_gesture_single_set_button(GTK_GESTURE_SINGLE(right_click), GDK_BUTTON_SECONDARY);
-            gtk_gesture_single_set_exclusive(GTK_GESTURE_SINGLE(right_click), FALSE);
-            g_signal_connect(right_click, "pressed", G_CALLBACK(on_widget_right_click), (gpointer)"version-element");
-            gtk_widget_add_controller(vrow, GTK_EVENT_CONTROLLER(right_click));
-
-            gtk_list_box_append(GTK_LIST_BOX(versions_list), vrow);
-            g_free(label_text);
+/* Mirrors one catalog change into the versions model. The model holds the
+ * shown file's catalog array in the same order, so positions map 1:1 and a
+ * record or delete touches a single row whatever the history size. */
+static void on_versions_changed(VersionIndexChange change, const VersionEntry *entry, guint position, gpointer user_data) {
+    GtkWindow *window = GTK_WINDOW(user_data);
+    GListStore *store = g_object_get_data(G_OBJECT(window), "versions-store");
+    const char *shown = g_object_get_data(G_OBJECT(window), "original-path");
+    if (!store || !shown || version_index_lookup_path(shown) != entry->file_id) return;
+
+    guint n = g_list_model_get_n_items(G_LIST_MODEL(store));
+    if (change == VERSION_INDEX_ADDED && position <= n) {
+        DeltaVersionItem *item = version_item_from_entry(entry);
+        g_list_store_insert(store, position, item);
+        g_object_unref(item);
+        return;
+    }
+    if (change == VERSION_INDEX_REMOVED && position < n) {
+        DeltaVersionItem *item = g_list_model_get_item(G_LIST_MODEL(store), position);
+        gboolean same = delta_version_item_get_stored_name(item) == entry->stored_name;
+        g_object_unref(item);
+        if (same) {
+            g_list_store_remove(store, position);
+            return;
         }
     }
-    fclose(f);
-    g_free(index_path_txt);
+    /* The model drifted from the catalog; rebuild it once */
+    populate_versions_for_path(window, store, shown);
+}
+
+/* Warms the cache with the selected version and the rows around it, nearest
+ * first, so stepping through the list with the keyboard finds them loaded. */
+static void on_version_selected(GtkSingleSelection *selection, GParamSpec *pspec, gpointer user_data) {
+    guint selected = gtk_single_selection_get_selected(selection);
+    GListModel *model = G_LIST_MODEL(selection);
+    guint n = g_list_model_get_n_items(model);
+    if (selected == GTK_INVALID_LIST_POSITION || selected >= n) return;
+
+    static const gint order[] = { 0, 1, -1, 2, -2 };
+    for (guint i = 0; i < G_N_ELEMENTS(order); ++i) {
+        gint pos = (gint)selected + order[i];
+        if (pos < 0 || (guint)pos >= n) continue;
+        DeltaVersionItem *item = g_list_model_get_item(model, pos);
+        version_cache_prefetch(delta_version_item_get_stored_name(item));
+        g_object_unref(item);
+    }
+}
+
+static void on_versions_view_destroy(GtkWidget *list_view, gpointer user_data) {
+    version_index_unwatch(GPOINTER_TO_UINT(user_data));
+}
+
+GtkWidget *create_versions_view(GtkWindow *parent_window) {
+    GListStore *store = g_list_store_new(DELTA_TYPE_VERSION_ITEM);
+    GtkSingleSelection *selection = gtk_single_selection_new(G_LIST_MODEL(g_object_ref(store)));
+    gtk_single_selection_set_autoselect(selection, FALSE);
+    gtk_single_selection_set_can_unselect(selection, TRUE);
+
+    GtkListItemFactory *factory = gtk_signal_list_item_factory_new();
+    g_signal_connect(factory, "setup", G_CALLBACK(version_row_setup), NULL);
+    g_signal_connect(factory, "bind", G_CALLBACK(version_row_bind), NULL);
+    g_signal_connect(factory, "unbind", G_CALLBACK(row_unbind), NULL);
+
+    /* The view takes ownership of the selection model and the factory */
+    GtkWidget *list_view = gtk_list_view_new(GTK_SELECTION_MODEL(selection), factory);
+    gtk_widget_set_name(list_view, "versions-list");
+    attach_context_gesture(list_view, "version-element");
+    g_signal_connect(selection, "notify::selected", G_CALLBACK(on_version_selected), NULL);
+
+    guint watch = version_index_watch(on_versions_changed, parent_window);
+    g_signal_connect(list_view, "destroy", G_CALLBACK(on_versions_view_destroy), GUINT_TO_POINTER(watch));
+
+    // Store the view and its model on the window so sidebar can populate it
+    g_object_set_data(G_OBJECT(parent_window), "versions-list", list_view);
+    g_object_set_data_full(G_OBJECT(parent_window), "versions-store", store, g_object_unref);
+    return list_view;
+}
+
+/* Populate versions list for an original file path */
+void populate_versions_for_path(GtkWindow *parent, GListStore *versions_store, const char *original_path) {
+    if (!versions_store) return;
+
+    /* Build the items straight from the catalog and swap them in with one splice,
+     * so the view sees a single items-changed instead of one per row. */
+    GArray *versions = version_index_get_versions(original_path);
+    guint n = versions ? versions->len : 0;
+    gpointer *items = g_new(gpointer, n ? n : 1);
+    for (guint i = 0; i < n; i++) {
+        VersionEntry *e = &g_array_index(versions, VersionEntry, i);
+        items[i] = version_item_from_entry(e);
+    }
+    g_list_store_splice(versions_store, 0, g_list_model_get_n_items(G_LIST_MODEL(versions_store)), items, n);
+    for (guint i = 0; i < n; i++) g_object_unref(items[i]);
+    g_free(items);
 }
 
 
@@ -241,31 +421,11 @@ on_browse_open_finish(GObject *source, GAsyncResult *res, gpointer user_data) {
     if (file) { // User selected a file
         char *full_path = g_file_get_path(file);
 
-        /* Add to UI */
-        void add_path_to_list(SidebarData *data, const char *full_path);
-        add_path_to_list(data, full_path);
-
-        /* Persist in data/files_index.txt (create data dir if needed) */
-        const char *data_dir = "data";
-        g_mkdir_with_parents(data_dir, 0755);
-        gchar *index_path = g_build_filename(data_dir, "files_index.txt", NULL);
-        gboolean already = FALSE;
-        if (g_file_test(index_path, G_FILE_TEST_EXISTS)) {
-            FILE *f = fopen(index_path, "r");
-            if (f) {
-                char buf[4096];
-                while (fgets(buf, sizeof(buf), f)) {
-                    char *nl = strchr(buf, '\n'); if (nl) *nl = '\0';
-                    if (g_strcmp0(buf, full_path) == 0) { already = TRUE; break; }
-                }
-                fclose(f);
-            }
-        }
-        if (!already) {
-            FILE *f = fopen(index_path, "a");
-            if (f) { fprintf(f, "%s\n", full_path); fclose(f); }
+        /* Persist in data/files_index.txt and add to UI unless already tracked */
+        if (files_index_add(full_path)) {
+            add_path_to_list(data, full_path);
+            if (data->filter_query) apply_filter(data);
         }
-        g_free(index_path);
 
         g_free(full_path);
         g_object_unref(file); // Unref the file
@@ -309,7 +469,7 @@ static void on_browse_clicked(GtkButton *button, gpointer user_data) {
 // --- Data struct for the delete confirmation callback ---
 typedef struct {
     SidebarData *sidebar_data;
-    GtkListBoxRow *row_to_delete;
+    DeltaFileItem *item_to_delete; // owned ref
 } DeleteCallbackData;
 
 
@@ -321,11 +481,9 @@ on_delete_response(GObject *source, GAsyncResult *res, gpointer user_data) {
     int response = gtk_alert_dialog_choose_finish(GTK_ALERT_DIALOG(source), res, NULL);
 
     if (response == 1) { // 1 is the "Delete" button
-        gtk_list_box_remove(
-            GTK_LIST_BOX(delete_data->sidebar_data->list_box),
-            GTK_WIDGET(delete_data->row_to_delete)
-        );
+        remove_item(delete_data->sidebar_data, delete_data->item_to_delete);
     }
+    g_object_unref(delete_data->item_to_delete);
     g_free(delete_data);
 }
 
@@ -334,17 +492,15 @@ on_delete_response(GObject *source, GAsyncResult *res, gpointer user_data) {
 static void on_delete_clicked(GtkButton *button, gpointer user_data) {
     SidebarData *data = (SidebarData *)user_data;
 
-    GtkListBoxRow *selected_row = gtk_list_box_get_selected_row(
-        GTK_LIST_BOX(data->list_box)
-    );
+    gpointer selected = gtk_single_selection_get_selected_item(data->selection);
 
-    if (selected_row == NULL) {
+    if (selected == NULL) {
         return;
     }
 
     DeleteCallbackData *delete_data = g_new(DeleteCallbackData, 1);
     delete_data->sidebar_data = data;
-    delete_data->row_to_delete = selected_row;
+    delete_data->item_to_delete = g_object_ref(selected);
 
     GtkAlertDialog *alert = gtk_alert_dialog_new("Do you want to delete this file?");
     const char *buttons[] = {"Cancel", "Delete", NULL};
@@ -363,42 +519,35 @@ static void on_delete_clicked(GtkButton *button, gpointer user_data) {
 }
 
 // --- "List Selection" callback ---
-static void on_row_selected(GtkListBox *list_box, GtkListBoxRow *row, gpointer user_data) {
+static void on_selection_changed(GtkSingleSelection *selection, GParamSpec *pspec, gpointer user_data) {
     SidebarData *data = (SidebarData *)user_data;
-    gtk_widget_set_sensitive(data->delete_button, (row != NULL));
-
-    /* When a row is selected, populate the versions list on the right and show it. */
-    GtkWidget *toplevel = NULL;
-    GtkListBox *versions_list = NULL;
-    if (row != NULL) {
-        /* Get stored file path on the row */
-        const char *path = g_object_get_data(G_OBJECT(row), "file-path");
-        toplevel = gtk_widget_get_ancestor(GTK_WIDGET(row), GTK_TYPE_WINDOW);
-        if (toplevel) {
-            g_object_set_data(G_OBJECT(toplevel), "original-path", (gpointer)path);
-            GtkWidget *v = g_object_get_data(G_OBJECT(toplevel), "versions-list");
-            if (v && GTK_IS_LIST_BOX(v)) {
-                versions_list = GTK_LIST_BOX(v);
-                /* Ensure visible */
-                gtk_widget_set_visible(GTK_WIDGET(versions_list), TRUE);
-                /* Populate with versions for this path */
-                populate_versions_for_path(GTK_WINDOW(toplevel), versions_list, path ? path : "");
-            }
+    DeltaFileItem *item = gtk_single_selection_get_selected_item(selection);
+    gtk_widget_set_sensitive(data->delete_button, (item != NULL));
+
+    /* When a file is selected, populate the versions list on the right and show it. */
+    GObject *window = G_OBJECT(data->parent_window);
+    GtkWidget *versions_list = g_object_get_data(window, "versions-list");
+    GListStore *versions_store = g_object_get_data(window, "versions-store");
+    if (item != NULL) {
+        const char *path = delta_file_item_get_path(item);
+        g_object_set_data_full(window, "original-path", g_strdup(path), g_free);
+        if (versions_list && versions_store) {
+            /* Ensure visible */
+            gtk_widget_set_visible(versions_list, TRUE);
+            /* Populate with versions for this path */
+            populate_versions_for_path(data->parent_window, versions_store, path);
         }
     } else {
-        /* No selection: hide versions list if we can find it */
-        toplevel = gtk_widget_get_ancestor(GTK_WIDGET(list_box), GTK_TYPE_WINDOW);
-        if (toplevel) {
-            GtkWidget *v = g_object_get_data(G_OBJECT(toplevel), "versions-list");
-            if (v) gtk_widget_set_visible(v, FALSE);
-        }
+        /* No selection: hide versions list */
+        g_object_set_data(window, "original-path", NULL);
+        if (versions_list) gtk_widget_set_visible(versions_list, FALSE);
     }
 }
 
 
 // --- Main create_sidebar function (Modified) ---
 GtkWidget *create_sidebar(GtkWindow *parent_window) {
-    GtkWidget *sidebar_vbox, *button_hbox, *browse_button, *delete_button, *scrolled_window, *list_box, *icon;
+    GtkWidget *sidebar_vbox, *button_hbox, *browse_button, *delete_button, *scrolled_window, *list_view, *icon;
 
     sidebar_vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
     button_hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
@@ -430,49 +579,58 @@ GtkWidget *create_sidebar(GtkWindow *parent_window) {
     gtk_box_append(GTK_BOX(button_hbox), browse_button);
     gtk_box_append(GTK_BOX(button_hbox), delete_button);
 
-    // 6. Create list box
+    // Filter box: fuzzy match over the tracked paths
+    GtkWidget *filter_entry = gtk_search_entry_new();
+    gtk_search_entry_set_placeholder_text(GTK_SEARCH_ENTRY(filter_entry), "Filter files");
+
+    // 6. Create the list view over a model of tracked files
     scrolled_window = gtk_scrolled_window_new();
     gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled_window),
                                    GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
-    list_box = gtk_list_box_new();
-    gtk_widget_set_name(list_box, "file-list-box"); // For CSS
-    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(scrolled_window), list_box);
+    GListStore *files_store = g_list_store_new(DELTA_TYPE_FILE_ITEM);
+    GtkSingleSelection *selection = gtk_single_selection_new(G_LIST_MODEL(g_object_ref(files_store)));
+    gtk_single_selection_set_autoselect(selection, FALSE);
+    gtk_single_selection_set_can_unselect(selection, TRUE);
+
+    GtkListItemFactory *factory = gtk_signal_list_item_factory_new();
+    g_signal_connect(factory, "setup", G_CALLBACK(file_row_setup), NULL);
+    g_signal_connect(factory, "bind", G_CALLBACK(file_row_bind), NULL);
+    g_signal_connect(factory, "unbind", G_CALLBACK(row_unbind), NULL);
+
+    list_view = gtk_list_view_new(GTK_SELECTION_MODEL(selection), factory);
+    gtk_widget_set_name(list_view, "file-list-box"); // For CSS
+    attach_context_gesture(list_view, "sidebar-element");
+    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(scrolled_window), list_view);
 
     // 7. Create and fill the SidebarData struct
     SidebarData *callback_data = g_new(SidebarData, 1);
     callback_data->parent_window = parent_window;
-    callback_data->list_box = list_box;
+    callback_data->files_store = files_store;
+    callback_data->selection = selection;
+    callback_data->list_view = list_view;
     callback_data->delete_button = delete_button;
+    callback_data->results_store = g_list_store_new(DELTA_TYPE_FILE_ITEM);
+    callback_data->filter_index = trigram_index_new(path_for_id, NULL);
+    callback_data->items_by_id = g_hash_table_new(g_direct_hash, g_direct_equal);
+    callback_data->filter_query = NULL;
+    g_object_set_data(G_OBJECT(parent_window), "sidebar-data", callback_data);
 
     // 8. Connect all signals
     g_signal_connect(browse_button, "clicked", G_CALLBACK(on_browse_clicked), callback_data);
     g_signal_connect(delete_button, "clicked", G_CALLBACK(on_delete_clicked), callback_data);
-    g_signal_connect(list_box, "row-selected", G_CALLBACK(on_row_selected), callback_data);
-    g_signal_connect(sidebar_vbox, "destroy", G_CALLBACK(g_free), callback_data);
+    g_signal_connect(selection, "notify::selected", G_CALLBACK(on_selection_changed), callback_data);
+    g_signal_connect(filter_entry, "search-changed", G_CALLBACK(on_filter_changed), callback_data);
+    g_signal_connect(sidebar_vbox, "destroy", G_CALLBACK(sidebar_data_free), callback_data);
 
     // 9. Pack main sidebar
     gtk_box_append(GTK_BOX(sidebar_vbox), button_hbox);
+    gtk_box_append(GTK_BOX(sidebar_vbox), filter_entry);
     gtk_widget_set_vexpand(scrolled_window, TRUE);
     gtk_widget_set_valign(scrolled_window, GTK_ALIGN_FILL);
     gtk_box_append(GTK_BOX(sidebar_vbox), scrolled_window);
 
     /* Load persisted files list from data/files_index.txt */
-    const char *data_dir = "data";
-    gchar *index_path = g_build_filename(data_dir, "files_index.txt", NULL);
-    if (g_file_test(index_path, G_FILE_TEST_EXISTS)) {
-        FILE *f = fopen(index_path, "r");
-        if (f) {
-            char buf[4096];
-            while (fgets(buf, sizeof(buf), f)) {
-                char *nl = strchr(buf, '\n'); if (nl) *nl = '\0';
-                if (buf[0] != '\0') {
-                    add_path_to_list(callback_data, buf);
-                }
-            }
-            fclose(f);
-        }
-    }
-    g_free(index_path);
+    files_index_foreach(add_indexed_path, callback_data);
 
     return sidebar_vbox;
 }
\ No newline at end of file
@@ -0,0 +1,249 @@
+#include "snapshot_cache.h"
+#include "version_index.h"
+#include "tree_hash.h"
+#include "inline_store.h"
+#include <gtk/gtk.h>
+#include <glib/gstdio.h>
+#include <sys/stat.h>
+#include <string.h>
+
+typedef struct {
+    SnapshotStamp stamp;
+    gboolean stat_valid;      /* FALSE when seeded from a stored version */
+    gint64 checked_at;        /* seconds; when the stamp was taken */
+    const char *stored_name;  /* interned by the catalog */
+    TreeHash *tree;           /* of the newest version, when hashed this session */
+    TreeHash *pending;        /* of the file at the last check that found changes */
+} CacheEntry;
+
+/* file id -> CacheEntry */
+static GHashTable *cache = NULL;
+
+static void cache_entry_free(CacheEntry *entry) {
+    tree_hash_free(entry->tree);
+    tree_hash_free(entry->pending);
+    g_free(entry);
+}
+
+// ---
+// --- Stat cache
+// ---
+
+/* Keeps each entry pointing at its file's newest version */
+static void on_version_changed(VersionIndexChange change, const VersionEntry *entry, guint position, gpointer user_data) {
+    CacheEntry *cached = g_hash_table_lookup(cache, GUINT_TO_POINTER(entry->file_id));
+    if (!cached) return;
+
+    if (change == VERSION_INDEX_REMOVED) {
+        if (cached->stored_name == entry->stored_name) g_hash_table_remove(cache, GUINT_TO_POINTER(entry->file_id));
+        return;
+    }
+
+    GArray *versions = version_index_get_versions_by_id(entry->file_id);
+    if (position + 1 < versions->len) return; /* an older version; the newest is unchanged */
+    if (!entry->digest) {
+        g_hash_table_remove(cache, GUINT_TO_POINTER(entry->file_id));
+        return;
+    }
+    /* A new newest version: the tree from the last check is its tree if the roots agree */
+    TreeHash *tree = NULL;
+    if (cached->pending && cached->pending->root == entry->digest) {
+        tree = cached->pending;
+        cached->pending = NULL;
+    }
+    tree_hash_free(cached->tree);
+    tree_hash_free(cached->pending);
+    cached->tree = tree;
+    cached->pending = NULL;
+    cached->stored_name = entry->stored_name;
+    cached->stamp.hash = entry->digest;
+    cached->stat_valid = FALSE;
+}
+
+static void cache_init(void) {
+    if (cache) return;
+    cache = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)cache_entry_free);
+    version_index_watch(on_version_changed, NULL);
+}
+
+static gboolean stat_file(const char *path, SnapshotStamp *stamp) {
+    GStatBuf st;
+    if (g_stat(path, &st) != 0) return FALSE;
+    stamp->size = (guint64)st.st_size;
+    stamp->mtime = (gint64)st.st_mtime;
+#ifdef _WIN32
+    stamp->inode = 0;
+#else
+    stamp->inode = (guint64)st.st_ino;
+#endif
+    return TRUE;
+}
+
+struct SnapshotCheck {
+    gchar *path;
+    guint32 file_id;
+    SnapshotStamp stamp;
+    gboolean stat_hit;        /* unchanged by stat alone; nothing to hash */
+    const char *seed_stored;  /* newest version to hash first: no cache entry and no digest */
+    const char *base_stored;  /* the entry's version when base_tree was taken from it */
+    guint64 base_hash;        /* root of that version, 0 if unknown */
+    TreeHash *base_tree;      /* the entry's tree, lent to the worker */
+    TreeHash *tree;           /* out: the file's tree, NULL if it could not be read */
+};
+
+/* Any thread: hashes a stored version, inline or file-backed */
+static TreeHash *hash_stored(const char *stored_name) {
+    GBytes *inlined = inline_store_lookup(stored_name);
+    if (!inlined) {
+        gchar *stored_path = g_build_filename("data", "versions", stored_name, NULL);
+        TreeHash *tree = tree_hash_file(stored_path);
+        g_free(stored_path);
+        return tree;
+    }
+    gsize len;
+    const void *data = g_bytes_get_data(inlined, &len);
+    TreeHash *tree = tree_hash_data(data, len);
+    g_bytes_unref(inlined);
+    return tree;
+}
+
+/* Builds an entry from the newest stored version, for files first recorded
+ * in an earlier session. The digest in the index saves reading it back;
+ * without one, the check hashes the version on its worker instead. */
+static CacheEntry *seed_entry(guint32 file_id, SnapshotCheck *check) {
+    GArray *versions = version_index_get_versions_by_id(file_id);
+    if (!versions || versions->len == 0) return NULL;
+    const VersionEntry *newest = &g_array_index(versions, VersionEntry, versions->len - 1);
+    if (!newest->digest) {
+        check->seed_stored = newest->stored_name;
+        return NULL;
+    }
+    CacheEntry *entry = g_new0(CacheEntry, 1);
+    entry->stamp.hash = newest->digest;
+    entry->stored_name = newest->stored_name;
+    g_hash_table_insert(cache, GUINT_TO_POINTER(file_id), entry);
+    return entry;
+}
+
+SnapshotCheck *snapshot_check_begin(const char *path) {
+    cache_init();
+    SnapshotCheck *check = g_new0(SnapshotCheck, 1);
+    check->path = g_strdup(path);
+    check->stamp.changed_bytes = G_MAXUINT64;
+    if (!stat_file(path, &check->stamp)) return check;
+
+    check->file_id = version_index_lookup_path(path);
+    CacheEntry *entry = check->file_id ? g_hash_table_lookup(cache, GUINT_TO_POINTER(check->file_id)) : NULL;
+    if (!entry && check->file_id) entry = seed_entry(check->file_id, check);
+    if (!entry) return check;
+
+    /* A write within the same second as the last check can keep size and
+     * mtime, so such a stamp is never trusted on its own. */
+    if (entry->stat_valid && entry->stamp.mtime < entry->checked_at &&
+        entry->stamp.size == check->stamp.size && entry->stamp.mtime == check->stamp.mtime &&
+        entry->stamp.inode == check->stamp.inode) {
+        check->stamp.hash = entry->stamp.hash;
+        check->stat_hit = TRUE;
+        return check;
+    }
+    /* The tree moves to the check so a concurrent catalog change cannot free it under the worker */
+    check->base_stored = entry->stored_name;
+    check->base_hash = entry->stamp.hash;
+    check->base_tree = entry->tree;
+    entry->tree = NULL;
+    return check;
+}
+
+gboolean snapshot_check_unchanged_by_stat(const SnapshotCheck *check) {
+    return check->stat_hit;
+}
+
+void snapshot_check_run(SnapshotCheck *check) {
+    if (check->stat_hit) return;
+    if (check->seed_stored) {
+        check->base_tree = hash_stored(check->seed_stored);
+        if (check->base_tree) {
+            check->base_stored = check->seed_stored;
+            check->base_hash = check->base_tree->root;
+        }
+    }
+    check->tree = tree_hash_file(check->path);
+    if (!check->tree) return;
+    check->stamp.hash = check->tree->root;
+    if (check->base_tree && check->base_hash != check->stamp.hash) {
+        GArray *ranges = tree_hash_changed_ranges(check->base_tree, check->tree);
+        check->stamp.changed_bytes = 0;
+        for (guint i = 0; i < ranges->len; ++i) check->stamp.changed_bytes += g_array_index(ranges, TreeHashRange, i).length;
+        g_array_unref(ranges);
+    }
+}
+
+const SnapshotStamp *snapshot_check_stamp(const SnapshotCheck *check) {
+    return &check->stamp;
+}
+
+gboolean snapshot_check_changed(const SnapshotCheck *check) {
+    /* An unreadable file counts as changed, so the caller's copy reports the error */
+    return !check->stat_hit && (!check->tree || !check->base_hash || check->base_hash != check->stamp.hash);
+}
+
+gboolean snapshot_check_finish(SnapshotCheck *check, SnapshotStamp *stamp) {
+    *stamp = check->stamp;
+    gboolean unchanged = check->stat_hit;
+    CacheEntry *entry = check->file_id ? g_hash_table_lookup(cache, GUINT_TO_POINTER(check->file_id)) : NULL;
+
+    /* Hand the lent (or freshly seeded) tree back if its version is still the entry's newest */
+    if (check->base_tree) {
+        if (!entry && check->seed_stored && version_index_lookup_stored(check->seed_stored, NULL)) {
+            entry = g_new0(CacheEntry, 1);
+            entry->stored_name = check->seed_stored;
+            entry->stamp.hash = check->base_hash;
+            g_hash_table_insert(cache, GUINT_TO_POINTER(check->file_id), entry);
+        }
+        if (entry && entry->stored_name == check->base_stored && !entry->tree) {
+            entry->tree = check->base_tree;
+        } else {
+            tree_hash_free(check->base_tree);
+        }
+    }
+
+    if (!unchanged && check->tree) {
+        if (entry && entry->stamp.hash == check->stamp.hash) {
+            /* Touched but not changed: refresh the stat so the next check is free */
+            entry->stamp = check->stamp;
+            entry->stat_valid = TRUE;
+            entry->checked_at = g_get_real_time() / G_USEC_PER_SEC;
+            tree_hash_free(entry->tree);
+            entry->tree = check->tree;
+            unchanged = TRUE;
+        } else if (entry) {
+            tree_hash_free(entry->pending);
+            entry->pending = check->tree;
+        } else {
+            tree_hash_free(check->tree);
+        }
+    } else {
+        tree_hash_free(check->tree);
+    }
+    g_free(check->path);
+    g_free(check);
+    return unchanged;
+}
+
+void snapshot_cache_note_recorded(const char *path, const char *stored_name, const SnapshotStamp *stamp) {
+    cache_init();
+    guint32 file_id = version_index_lookup_path(path);
+    VersionEntry version;
+    if (!file_id || !version_index_lookup_stored(stored_name, &version)) return;
+
+    /* The index's change event has normally moved the entry to this version already */
+    CacheEntry *entry = g_hash_table_lookup(cache, GUINT_TO_POINTER(file_id));
+    if (!entry || entry->stored_name != version.stored_name) {
+        entry = g_new0(CacheEntry, 1);
+        entry->stored_name = version.stored_name;
+        g_hash_table_replace(cache, GUINT_TO_POINTER(file_id), entry);
+    }
+    entry->stamp = *stamp;
+    entry->stat_valid = TRUE;
+    entry->checked_at = g_get_real_time() / G_USEC_PER_SEC;
+}
@@ -0,0 +1,285 @@
+#include "tree_hash.h"
+#include "scheduler.h"
+#include <gtk/gtk.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Files with at least this many leaves are hashed on the pool */
+#define PARALLEL_MIN_LEAVES 64
+/* Leaves per pool task, so each task hashes 1 MiB */
+#define LEAVES_PER_TASK 16
+
+#define PARENT_SEED 0x9e3779b97f4a7c15ULL
+#define ROOT_SEED   0xc2b2ae3d27d4eb4fULL
+
+// ---
+// --- XXH64
+// ---
+
+#define XXH_P1 11400714785074694791ULL
+#define XXH_P2 14029467366897019727ULL
+#define XXH_P3 1609587929392839161ULL
+#define XXH_P4 9650029242287828579ULL
+#define XXH_P5 2870177450012600261ULL
+
+static inline guint64 rotl64(guint64 x, int r) { return (x << r) | (x >> (64 - r)); }
+
+static inline guint64 read64(const guint8 *p) { guint64 v; memcpy(&v, p, 8); return GUINT64_FROM_LE(v); }
+static inline guint32 read32(const guint8 *p) { guint32 v; memcpy(&v, p, 4); return GUINT32_FROM_LE(v); }
+
+static inline guint64 xxh_round(guint64 acc, guint64 input) {
+    acc += input * XXH_P2;
+    acc = rotl64(acc, 31);
+    return acc * XXH_P1;
+}
+
+static inline guint64 xxh_merge(guint64 acc, guint64 val) {
+    acc ^= xxh_round(0, val);
+    return acc * XXH_P1 + XXH_P4;
+}
+
+guint64 tree_hash_xxh64(const void *data, gsize len, guint64 seed) {
+    const guint8 *p = data;
+    const guint8 *end = p + len;
+    guint64 h;
+
+    if (len >= 32) {
+        /* Four independent lanes; the compiler keeps them in registers */
+        guint64 v1 = seed + XXH_P1 + XXH_P2;
+        guint64 v2 = seed + XXH_P2;
+        guint64 v3 = seed;
+        guint64 v4 = seed - XXH_P1;
+        const guint8 *limit = end - 32;
+        do {
+            v1 = xxh_round(v1, read64(p));
+            v2 = xxh_round(v2, read64(p + 8));
+            v3 = xxh_round(v3, read64(p + 16));
+            v4 = xxh_round(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = xxh_merge(h, v1);
+        h = xxh_merge(h, v2);
+        h = xxh_merge(h, v3);
+        h = xxh_merge(h, v4);
+    } else {
+        h = seed + XXH_P5;
+    }
+    h += (guint64)len;
+
+    while (p + 8 <= end) {
+        h ^= xxh_round(0, read64(p));
+        h = rotl64(h, 27) * XXH_P1 + XXH_P4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        h ^= (guint64)read32(p) * XXH_P1;
+        h = rotl64(h, 23) * XXH_P2 + XXH_P3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= (*p++) * XXH_P5;
+        h = rotl64(h, 11) * XXH_P1;
+    }
+
+    h ^= h >> 33;
+    h *= XXH_P2;
+    h ^= h >> 29;
+    h *= XXH_P3;
+    h ^= h >> 32;
+    return h;
+}
+
+// ---
+// --- Tree construction
+// ---
+
+static guint64 leaf_count(guint64 size) {
+    return size == 0 ? 1 : (size + TREE_HASH_LEAF_BYTES - 1) / TREE_HASH_LEAF_BYTES;
+}
+
+static void hash_leaves(const guint8 *data, guint64 size, guint64 first, guint64 count, guint64 *out) {
+    for (guint64 i = first; i < first + count; ++i) {
+        guint64 offset = i * TREE_HASH_LEAF_BYTES;
+        gsize len = (gsize)MIN((guint64)TREE_HASH_LEAF_BYTES, size - offset);
+        out[i] = tree_hash_xxh64(data + offset, len, i);
+    }
+}
+
+/* Builds the parent levels over filled-in leaves and computes the root */
+static void finish_tree(TreeHash *tree) {
+    GArray *level = g_ptr_array_index(tree->levels, 0);
+    guint level_no = 0;
+    while (level->len > 1) {
+        level_no++;
+        GArray *parent = g_array_sized_new(FALSE, FALSE, sizeof(guint64), (level->len + 1) / 2);
+        for (guint i = 0; i < level->len; i += 2) {
+            guint64 node;
+            if (i + 1 < level->len) {
+                guint64 pair[2] = { GUINT64_TO_LE(g_array_index(level, guint64, i)),
+                                    GUINT64_TO_LE(g_array_index(level, guint64, i + 1)) };
+                node = tree_hash_xxh64(pair, sizeof(pair), PARENT_SEED + level_no);
+            } else {
+                /* An odd node moves up unchanged */
+                node = g_array_index(level, guint64, i);
+            }
+            g_array_append_val(parent, node);
+        }
+        g_ptr_array_add(tree->levels, parent);
+        level = parent;
+    }
+    guint64 top[2] = { GUINT64_TO_LE(g_array_index(level, guint64, 0)), GUINT64_TO_LE(tree->size) };
+    tree->root = tree_hash_xxh64(top, sizeof(top), ROOT_SEED);
+}
+
+static TreeHash *tree_new(guint64 size) {
+    TreeHash *tree = g_new0(TreeHash, 1);
+    tree->size = size;
+    tree->levels = g_ptr_array_new_with_free_func((GDestroyNotify)g_array_unref);
+    GArray *leaves = g_array_sized_new(FALSE, TRUE, sizeof(guint64), (guint)leaf_count(size));
+    g_array_set_size(leaves, (guint)leaf_count(size));
+    g_ptr_array_add(tree->levels, leaves);
+    return tree;
+}
+
+void tree_hash_free(TreeHash *tree) {
+    if (!tree) return;
+    g_ptr_array_free(tree->levels, TRUE);
+    g_free(tree);
+}
+
+TreeHash *tree_hash_data(const void *data, gsize len) {
+    TreeHash *tree = tree_new(len);
+    GArray *leaves = g_ptr_array_index(tree->levels, 0);
+    hash_leaves(data, len, 0, leaves->len, (guint64 *)leaves->data);
+    finish_tree(tree);
+    return tree;
+}
+
+// ---
+// --- Parallel hashing
+// ---
+
+typedef struct {
+    const guint8 *data;
+    guint64 size;
+    guint64 n_leaves;
+    guint64 *out;
+} LeafRange;
+
+static void hash_leaf_range(guint index, gpointer user_data) {
+    const LeafRange *range = user_data;
+    guint64 first = (guint64)index * LEAVES_PER_TASK;
+    hash_leaves(range->data, range->size, first, MIN((guint64)LEAVES_PER_TASK, range->n_leaves - first), range->out);
+}
+
+/* Splits the leaves of a mapped file into tasks on the shared scheduler and waits for all of them */
+static void hash_leaves_parallel(const guint8 *data, guint64 size, GArray *leaves) {
+    LeafRange range = { data, size, leaves->len, (guint64 *)leaves->data };
+    guint tasks = (guint)((leaves->len + LEAVES_PER_TASK - 1) / LEAVES_PER_TASK);
+    scheduler_parallel_for(tasks, SCHEDULER_PRIORITY_INTERACTIVE, hash_leaf_range, &range);
+}
+
+/* Fallback when the file cannot be mapped: one leaf at a time, in order */
+static TreeHash *hash_stream(const char *path) {
+    FILE *f = g_fopen(path, "rb");
+    if (!f) return NULL;
+    GArray *leaves = g_array_new(FALSE, FALSE, sizeof(guint64));
+    guint8 *buf = g_malloc(TREE_HASH_LEAF_BYTES);
+    guint64 size = 0;
+    gsize n;
+    while ((n = fread(buf, 1, TREE_HASH_LEAF_BYTES, f)) > 0) {
+        guint64 h = tree_hash_xxh64(buf, n, leaves->len);
+        g_array_append_val(leaves, h);
+        size += n;
+    }
+    gboolean failed = ferror(f);
+    fclose(f);
+    g_free(buf);
+    if (failed) {
+        g_array_unref(leaves);
+        return NULL;
+    }
+
+    TreeHash *tree = tree_new(size);
+    if (leaves->len > 0) {
+        g_array_unref(g_ptr_array_index(tree->levels, 0));
+        g_ptr_array_index(tree->levels, 0) = leaves;
+    } else {
+        /* Empty file: the single leaf is the hash of nothing, as in hash_leaves() */
+        g_array_index((GArray *)g_ptr_array_index(tree->levels, 0), guint64, 0) = tree_hash_xxh64(NULL, 0, 0);
+        g_array_unref(leaves);
+    }
+    finish_tree(tree);
+    return tree;
+}
+
+TreeHash *tree_hash_file(const char *path) {
+    GMappedFile *mapped = g_mapped_file_new(path, FALSE, NULL);
+    if (!mapped) return hash_stream(path);
+
+    const guint8 *data = (const guint8 *)g_mapped_file_get_contents(mapped);
+    gsize size = g_mapped_file_get_length(mapped);
+    TreeHash *tree = tree_new(size);
+    GArray *leaves = g_ptr_array_index(tree->levels, 0);
+    if (leaves->len >= PARALLEL_MIN_LEAVES) hash_leaves_parallel(data, size, leaves);
+    else hash_leaves(data, size, 0, leaves->len, (guint64 *)leaves->data);
+    finish_tree(tree);
+    g_mapped_file_unref(mapped);
+    return tree;
+}
+
+// ---
+// --- Comparison
+// ---
+
+static void add_range(GArray *ranges, guint64 first_leaf, guint levels_up, guint64 size) {
+    guint64 offset = (first_leaf << levels_up) * TREE_HASH_LEAF_BYTES;
+    if (offset >= size) return;
+    guint64 end = MIN(offset + ((guint64)TREE_HASH_LEAF_BYTES << levels_up), size);
+    if (ranges->len > 0) {
+        TreeHashRange *last = &g_array_index(ranges, TreeHashRange, ranges->len - 1);
+        if (last->offset + last->length == offset) {
+            last->length = end - last->offset;
+            return;
+        }
+    }
+    TreeHashRange r = { offset, end - offset };
+    g_array_append_val(ranges, r);
+}
+
+static gboolean node_at(const TreeHash *tree, guint level, guint64 index, guint64 *out) {
+    if (level >= tree->levels->len) return FALSE;
+    GArray *nodes = g_ptr_array_index(tree->levels, level);
+    if (index >= nodes->len) return FALSE;
+    *out = g_array_index(nodes, guint64, index);
+    return TRUE;
+}
+
+static void compare_node(const TreeHash *a, const TreeHash *b, guint level, guint64 index, GArray *ranges) {
+    /* Nothing of b lives under this node */
+    if (((index << level) * TREE_HASH_LEAF_BYTES) >= b->size) return;
+    guint64 ha, hb;
+    gboolean in_a = node_at(a, level, index, &ha);
+    gboolean in_b = node_at(b, level, index, &hb);
+    if (in_a && in_b && ha == hb) return;
+    /* Only b has data here: all of it is new */
+    if (!in_a && (index << level) * TREE_HASH_LEAF_BYTES >= a->size) {
+        add_range(ranges, index, level, b->size);
+        return;
+    }
+    if (level == 0) {
+        add_range(ranges, index, 0, b->size);
+        return;
+    }
+    compare_node(a, b, level - 1, index * 2, ranges);
+    compare_node(a, b, level - 1, index * 2 + 1, ranges);
+}
+
+GArray *tree_hash_changed_ranges(const TreeHash *a, const TreeHash *b) {
+    GArray *ranges = g_array_new(FALSE, FALSE, sizeof(TreeHashRange));
+    guint top = MAX(a->levels->len, b->levels->len) - 1;
+    compare_node(a, b, top, 0, ranges);
+    return ranges;
+}
@@ -0,0 +1,315 @@
+#include "trigram_index.h"
+#include <gtk/gtk.h>
+#include <string.h>
+
+/* Above this many postings the typo fallback is skipped; counting them
+ * would cost more than the query is allowed to take. */
+#define FUZZY_POSTINGS_LIMIT 262144
+/* Candidates ranked per query at most. A common trigram ("src", ".js")
+ * matches a large share of all paths; fetching and scanning every one of
+ * them would blow the query budget, so the rest are left unranked. */
+#define RANK_CANDIDATE_LIMIT 8192
+
+struct _TrigramIndex {
+    GHashTable *postings;   /* trigram key -> GArray of guint32 ids, ascending */
+    GArray *all_ids;        /* every indexed id, ascending; scanned for short queries */
+    TrigramTextFunc text_for_id;
+    gpointer user_data;
+};
+
+static guint32 trigram_key(const char *p) {
+    return ((guint32)(guchar)g_ascii_tolower(p[0]) << 16) |
+           ((guint32)(guchar)g_ascii_tolower(p[1]) << 8) |
+           (guint32)(guchar)g_ascii_tolower(p[2]);
+}
+
+static gint compare_guint32(gconstpointer a, gconstpointer b) {
+    guint32 x = *(const guint32 *)a, y = *(const guint32 *)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/* Distinct trigram keys of text, ascending */
+static GArray *text_trigrams(const char *text) {
+    GArray *keys = g_array_new(FALSE, FALSE, sizeof(guint32));
+    gsize len = strlen(text);
+    for (gsize i = 0; i + 3 <= len; ++i) {
+        guint32 key = trigram_key(text + i);
+        g_array_append_val(keys, key);
+    }
+    g_array_sort(keys, compare_guint32);
+    guint out = 0;
+    for (guint i = 0; i < keys->len; ++i) {
+        guint32 key = g_array_index(keys, guint32, i);
+        if (out == 0 || g_array_index(keys, guint32, out - 1) != key)
+            g_array_index(keys, guint32, out++) = key;
+    }
+    g_array_set_size(keys, out);
+    return keys;
+}
+
+static guint lower_bound(GArray *ids, guint from, guint32 id) {
+    guint lo = from, hi = ids->len;
+    while (lo < hi) {
+        guint mid = lo + (hi - lo) / 2;
+        if (g_array_index(ids, guint32, mid) < id) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/* New ids are nearly always the largest yet, so this is usually an append */
+static void sorted_insert(GArray *ids, guint32 id) {
+    if (ids->len == 0 || g_array_index(ids, guint32, ids->len - 1) < id) {
+        g_array_append_val(ids, id);
+        return;
+    }
+    guint pos = lower_bound(ids, 0, id);
+    if (pos < ids->len && g_array_index(ids, guint32, pos) == id) return;
+    g_array_insert_val(ids, pos, id);
+}
+
+static void sorted_remove(GArray *ids, guint32 id) {
+    guint pos = lower_bound(ids, 0, id);
+    if (pos < ids->len && g_array_index(ids, guint32, pos) == id)
+        g_array_remove_index(ids, pos);
+}
+
+TrigramIndex *trigram_index_new(TrigramTextFunc text_for_id, gpointer user_data) {
+    TrigramIndex *index = g_new0(TrigramIndex, 1);
+    index->postings = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)g_array_unref);
+    index->all_ids = g_array_new(FALSE, FALSE, sizeof(guint32));
+    index->text_for_id = text_for_id;
+    index->user_data = user_data;
+    return index;
+}
+
+void trigram_index_free(TrigramIndex *index) {
+    if (!index) return;
+    g_hash_table_destroy(index->postings);
+    g_array_unref(index->all_ids);
+    g_free(index);
+}
+
+void trigram_index_add(TrigramIndex *index, guint32 id, const char *text) {
+    if (!index || !text) return;
+    GArray *keys = text_trigrams(text);
+    for (guint i = 0; i < keys->len; ++i) {
+        gpointer key = GUINT_TO_POINTER(g_array_index(keys, guint32, i));
+        GArray *ids = g_hash_table_lookup(index->postings, key);
+        if (!ids) {
+            ids = g_array_new(FALSE, FALSE, sizeof(guint32));
+            g_hash_table_insert(index->postings, key, ids);
+        }
+        sorted_insert(ids, id);
+    }
+    g_array_unref(keys);
+    sorted_insert(index->all_ids, id);
+}
+
+void trigram_index_remove(TrigramIndex *index, guint32 id, const char *text) {
+    if (!index || !text) return;
+    GArray *keys = text_trigrams(text);
+    for (guint i = 0; i < keys->len; ++i) {
+        gpointer key = GUINT_TO_POINTER(g_array_index(keys, guint32, i));
+        GArray *ids = g_hash_table_lookup(index->postings, key);
+        if (!ids) continue;
+        sorted_remove(ids, id);
+        if (ids->len == 0) g_hash_table_remove(index->postings, key);
+    }
+    g_array_unref(keys);
+    sorted_remove(index->all_ids, id);
+}
+
+// ---
+// --- Queries
+// ---
+
+static gint compare_posting_length(gconstpointer a, gconstpointer b) {
+    const GArray *x = *(GArray * const *)a, *y = *(GArray * const *)b;
+    return x->len < y->len ? -1 : (x->len > y->len ? 1 : 0);
+}
+
+/* Ids present in every posting list: start from the shortest and probe the others */
+static GArray *intersect_postings(TrigramIndex *index, GArray *keys) {
+    GArray *result = g_array_new(FALSE, FALSE, sizeof(guint32));
+    GPtrArray *lists = g_ptr_array_sized_new(keys->len);
+    for (guint i = 0; i < keys->len; ++i) {
+        GArray *ids = g_hash_table_lookup(index->postings, GUINT_TO_POINTER(g_array_index(keys, guint32, i)));
+        if (!ids) {
+            g_ptr_array_free(lists, TRUE);
+            return result;
+        }
+        g_ptr_array_add(lists, ids);
+    }
+    g_ptr_array_sort(lists, compare_posting_length);
+
+    GArray *smallest = g_ptr_array_index(lists, 0);
+    g_array_append_vals(result, smallest->data, smallest->len);
+    for (guint l = 1; l < lists->len && result->len > 0; ++l) {
+        GArray *ids = g_ptr_array_index(lists, l);
+        guint out = 0, from = 0;
+        for (guint i = 0; i < result->len; ++i) {
+            guint32 id = g_array_index(result, guint32, i);
+            /* Candidates ascend, so each probe resumes where the last one stopped */
+            from = lower_bound(ids, from, id);
+            if (from == ids->len) break;
+            if (g_array_index(ids, guint32, from) == id)
+                g_array_index(result, guint32, out++) = id;
+        }
+        g_array_set_size(result, out);
+    }
+    g_ptr_array_free(lists, TRUE);
+    return result;
+}
+
+/* Ids present in at least need of the posting lists (typo tolerance) */
+static GArray *count_postings(TrigramIndex *index, GArray *keys, guint need) {
+    GArray *result = g_array_new(FALSE, FALSE, sizeof(guint32));
+    GPtrArray *lists = g_ptr_array_sized_new(keys->len);
+    gsize total = 0;
+    for (guint i = 0; i < keys->len; ++i) {
+        GArray *ids = g_hash_table_lookup(index->postings, GUINT_TO_POINTER(g_array_index(keys, guint32, i)));
+        if (!ids) continue;
+        g_ptr_array_add(lists, ids);
+        total += ids->len;
+    }
+    if (lists->len >= need && total <= FUZZY_POSTINGS_LIMIT) {
+        GHashTable *counts = g_hash_table_new(g_direct_hash, g_direct_equal);
+        for (guint l = 0; l < lists->len; ++l) {
+            GArray *ids = g_ptr_array_index(lists, l);
+            for (guint i = 0; i < ids->len; ++i) {
+                gpointer id = GUINT_TO_POINTER(g_array_index(ids, guint32, i));
+                guint n = GPOINTER_TO_UINT(g_hash_table_lookup(counts, id)) + 1;
+                g_hash_table_insert(counts, id, GUINT_TO_POINTER(n));
+                if (n == need) {
+                    guint32 hit = GPOINTER_TO_UINT(id);
+                    g_array_append_val(result, hit);
+                }
+            }
+        }
+        g_hash_table_destroy(counts);
+    }
+    g_ptr_array_free(lists, TRUE);
+    return result;
+}
+
+/* Case-insensitive substring search; needle is already lower case */
+static const char *ascii_find(const char *haystack, const char *needle) {
+    gsize n = strlen(needle);
+    for (const char *p = haystack; *p; ++p) {
+        if (g_ascii_strncasecmp(p, needle, n) == 0) return p;
+    }
+    return NULL;
+}
+
+static GArray *scan_substring(TrigramIndex *index, const char *needle, guint max_results) {
+    GArray *result = g_array_new(FALSE, FALSE, sizeof(guint32));
+    for (guint i = 0; i < index->all_ids->len && result->len < max_results; ++i) {
+        guint32 id = g_array_index(index->all_ids, guint32, i);
+        const char *text = index->text_for_id(id, index->user_data);
+        if (text && ascii_find(text, needle)) g_array_append_val(result, id);
+    }
+    return result;
+}
+
+typedef struct {
+    guint32 id;
+    gint score;
+    gsize length;
+} RankedId;
+
+static gint compare_ranked(gconstpointer a, gconstpointer b) {
+    const RankedId *x = a, *y = b;
+    if (x->score != y->score) return y->score - x->score;
+    if (x->length != y->length) return x->length < y->length ? -1 : 1;
+    return x->id < y->id ? -1 : (x->id > y->id ? 1 : 0);
+}
+
+/* heap[0] is the worst result kept, so a better candidate replaces it */
+static void heap_sift_up(RankedId *heap, guint i) {
+    while (i > 0) {
+        guint parent = (i - 1) / 2;
+        if (compare_ranked(&heap[i], &heap[parent]) <= 0) return;
+        RankedId tmp = heap[i];
+        heap[i] = heap[parent];
+        heap[parent] = tmp;
+        i = parent;
+    }
+}
+
+static void heap_sift_down(RankedId *heap, guint n, guint i) {
+    for (;;) {
+        guint worst = i, left = 2 * i + 1, right = left + 1;
+        if (left < n && compare_ranked(&heap[left], &heap[worst]) > 0) worst = left;
+        if (right < n && compare_ranked(&heap[right], &heap[worst]) > 0) worst = right;
+        if (worst == i) return;
+        RankedId tmp = heap[i];
+        heap[i] = heap[worst];
+        heap[worst] = tmp;
+        i = worst;
+    }
+}
+
+/* Keeps the best max_results candidates seen so far */
+static void heap_offer(GArray *heap, guint max_results, const RankedId *r) {
+    RankedId *items = (RankedId *)heap->data;
+    if (heap->len < max_results) {
+        g_array_append_val(heap, *r);
+        heap_sift_up((RankedId *)heap->data, heap->len - 1);
+    } else if (compare_ranked(r, &items[0]) < 0) {
+        items[0] = *r;
+        heap_sift_down(items, heap->len, 0);
+    }
+}
+
+static const char *basename_of(const char *path) {
+    const char *base = path;
+    for (const char *p = path; *p; ++p) {
+        if (*p == '/' || *p == '\\') base = p + 1;
+    }
+    return base;
+}
+
+GArray *trigram_index_query(TrigramIndex *index, const char *query, guint max_results) {
+    if (!index || !query || !*query || max_results == 0)
+        return g_array_new(FALSE, FALSE, sizeof(guint32));
+
+    gchar *needle = g_ascii_strdown(query, -1);
+    GArray *keys = text_trigrams(needle);
+    GArray *candidates;
+    if (keys->len == 0) {
+        candidates = scan_substring(index, needle, max_results);
+    } else {
+        candidates = intersect_postings(index, keys);
+        if (candidates->len == 0 && keys->len > 1) {
+            g_array_unref(candidates);
+            candidates = count_postings(index, keys, (keys->len * 2 + 2) / 3);
+        }
+    }
+    g_array_unref(keys);
+
+    /* Rank the first candidates only, keeping the best max_results in a heap;
+     * the rest of the index is never touched */
+    guint budget = MIN(candidates->len, RANK_CANDIDATE_LIMIT);
+    GArray *ranked = g_array_sized_new(FALSE, FALSE, sizeof(RankedId), MIN(budget, max_results));
+    for (guint i = 0; i < budget; ++i) {
+        RankedId r;
+        r.id = g_array_index(candidates, guint32, i);
+        const char *text = index->text_for_id(r.id, index->user_data);
+        if (!text) continue;
+        const char *base = basename_of(text);
+        const char *hit = ascii_find(base, needle);
+        if (hit) r.score = (hit == base) ? 4 : 3;
+        else r.score = ascii_find(text, needle) ? 2 : 1;
+        r.length = strlen(text);
+        heap_offer(ranked, max_results, &r);
+    }
+    g_array_unref(candidates);
+    g_free(needle);
+    g_array_sort(ranked, compare_ranked);
+
+    GArray *result = g_array_sized_new(FALSE, FALSE, sizeof(guint32), ranked->len);
+    for (guint i = 0; i < ranked->len; ++i) g_array_append_val(result, g_array_index(ranked, RankedId, i).id);
+    g_array_unref(ranked);
+    return result;
+}
@@ -0,0 +1,180 @@
+#include "version_cache.h"
+#include "version_index.h"
+#include "inline_store.h"
+#include "scheduler.h"
+#include <gtk/gtk.h>
+#include <string.h>
+
+/* Prefetches allowed in flight at once; new requests are skipped beyond this */
+#define MAX_PREFETCH 8
+
+typedef struct {
+    gchar *stored_name;
+    GBytes *bytes;
+} CacheItem;
+
+static GMutex cache_lock;
+static GQueue lru = G_QUEUE_INIT;      /* CacheItem, most recently used first */
+static GHashTable *items = NULL;       /* stored name -> GList link in lru */
+static GHashTable *loading = NULL;     /* stored names being prefetched -> removed meanwhile */
+static gsize cached_bytes = 0;
+
+static void cache_item_free(CacheItem *item) {
+    g_free(item->stored_name);
+    g_bytes_unref(item->bytes);
+    g_free(item);
+}
+
+/* Called with cache_lock held */
+static void ensure_tables(void) {
+    if (items) return;
+    items = g_hash_table_new(g_str_hash, g_str_equal);
+    loading = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+}
+
+/* Called with cache_lock held */
+static void evict_link(GList *link) {
+    CacheItem *item = link->data;
+    g_hash_table_remove(items, item->stored_name);
+    g_queue_delete_link(&lru, link);
+    cached_bytes -= g_bytes_get_size(item->bytes);
+    cache_item_free(item);
+}
+
+/* Turns a stored name into its contents: a copy from the inline pack for tiny
+ * versions, otherwise the file in data/versions. Both are NUL-terminated
+ * (g_file_get_contents() adds one), so callers may treat the data as a string. */
+static GBytes *materialize(const char *stored_name) {
+    GBytes *inlined = inline_store_lookup(stored_name);
+    if (inlined) return inlined;
+
+    gchar *path = g_build_filename("data", "versions", stored_name, NULL);
+    gchar *contents = NULL;
+    gsize len = 0;
+    GBytes *bytes = NULL;
+    if (g_file_get_contents(path, &contents, &len, NULL)) {
+        bytes = g_bytes_new_take(contents, len);
+    } else {
+        g_printerr("version_cache: failed to read %s\n", path);
+    }
+    g_free(path);
+    return bytes;
+}
+
+/* Called with cache_lock held */
+static void insert(const char *stored_name, GBytes *bytes) {
+    gsize size = g_bytes_get_size(bytes);
+    if (size > VERSION_CACHE_BYTES / 4 || g_hash_table_contains(items, stored_name)) return;
+    while (cached_bytes + size > VERSION_CACHE_BYTES && lru.tail) evict_link(lru.tail);
+
+    CacheItem *item = g_new(CacheItem, 1);
+    item->stored_name = g_strdup(stored_name);
+    item->bytes = g_bytes_ref(bytes);
+    g_queue_push_head(&lru, item);
+    g_hash_table_insert(items, item->stored_name, lru.head);
+    cached_bytes += size;
+}
+
+/* Called with cache_lock held; returns a new reference or NULL */
+static GBytes *lookup(const char *stored_name) {
+    GList *link = g_hash_table_lookup(items, stored_name);
+    if (!link) return NULL;
+    g_queue_unlink(&lru, link);
+    g_queue_push_head_link(&lru, link);
+    return g_bytes_ref(((CacheItem *)link->data)->bytes);
+}
+
+GBytes *version_cache_get(const char *stored_name) {
+    if (!stored_name) return NULL;
+    g_mutex_lock(&cache_lock);
+    ensure_tables();
+    GBytes *bytes = lookup(stored_name);
+    g_mutex_unlock(&cache_lock);
+    if (bytes) return bytes;
+
+    bytes = materialize(stored_name);
+    if (!bytes) return NULL;
+    g_mutex_lock(&cache_lock);
+    insert(stored_name, bytes);
+    g_mutex_unlock(&cache_lock);
+    return bytes;
+}
+
+GBytes *version_cache_get_uncached(const char *stored_name) {
+    if (!stored_name) return NULL;
+    g_mutex_lock(&cache_lock);
+    ensure_tables();
+    GBytes *bytes = lookup(stored_name);
+    g_mutex_unlock(&cache_lock);
+    return bytes ? bytes : materialize(stored_name);
+}
+
+const char *version_cache_stored_name_for_path(const char *path) {
+    gchar *stored_name = g_path_get_basename(path);
+    gchar *expected = g_build_filename("data", "versions", stored_name, NULL);
+    VersionEntry entry;
+    gboolean live = g_strcmp0(path, expected) == 0 && version_index_lookup_stored(stored_name, &entry);
+    g_free(stored_name);
+    g_free(expected);
+    return live ? entry.stored_name : NULL;
+}
+
+GBytes *version_cache_load(const char *stored_name, const char *path) {
+    if (stored_name) return version_cache_get(stored_name);
+    gchar *contents = NULL;
+    gsize len = 0;
+    if (g_file_get_contents(path, &contents, &len, NULL)) return g_bytes_new_take(contents, len);
+    g_printerr("version_cache: failed to read %s\n", path);
+    return NULL;
+}
+
+/* The version index is main-thread only, so a removal during the load is
+ * noticed through the flag on_version_changed() sets in loading */
+static void prefetch_worker(GTask *task, gpointer source, gpointer task_data, GCancellable *cancellable) {
+    const char *stored_name = task_data;
+    GBytes *bytes = materialize(stored_name);
+
+    g_mutex_lock(&cache_lock);
+    if (bytes && !GPOINTER_TO_INT(g_hash_table_lookup(loading, stored_name))) insert(stored_name, bytes);
+    g_hash_table_remove(loading, stored_name);
+    g_mutex_unlock(&cache_lock);
+    if (bytes) g_bytes_unref(bytes);
+    g_task_return_boolean(task, TRUE);
+}
+
+void version_cache_prefetch(const char *stored_name) {
+    if (!stored_name) return;
+    g_mutex_lock(&cache_lock);
+    ensure_tables();
+    gboolean skip = g_hash_table_contains(items, stored_name) ||
+                    g_hash_table_contains(loading, stored_name) ||
+                    g_hash_table_size(loading) >= MAX_PREFETCH;
+    if (!skip) g_hash_table_insert(loading, g_strdup(stored_name), GINT_TO_POINTER(FALSE));
+    g_mutex_unlock(&cache_lock);
+    if (skip) return;
+
+    GTask *task = g_task_new(NULL, NULL, NULL, NULL);
+    g_task_set_task_data(task, g_strdup(stored_name), g_free);
+    scheduler_run_task(task, prefetch_worker, SCHEDULER_PRIORITY_DEFAULT);
+    g_object_unref(task);
+}
+
+static void on_version_changed(VersionIndexChange change, const VersionEntry *entry, guint position, gpointer user_data) {
+    if (change != VERSION_INDEX_REMOVED) return;
+    g_mutex_lock(&cache_lock);
+    GList *link = g_hash_table_lookup(items, entry->stored_name);
+    if (link) evict_link(link);
+    if (g_hash_table_contains(loading, entry->stored_name))
+        g_hash_table_insert(loading, g_strdup(entry->stored_name), GINT_TO_POINTER(TRUE));
+    g_mutex_unlock(&cache_lock);
+}
+
+void version_cache_init(void) {
+    static gboolean initialized = FALSE;
+    if (initialized) return;
+    initialized = TRUE;
+    g_mutex_lock(&cache_lock);
+    ensure_tables();
+    g_mutex_unlock(&cache_lock);
+    version_index_watch(on_version_changed, NULL);
+}
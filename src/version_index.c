@@ -0,0 +1,873 @@
+#include "version_index.h"
+#include <gtk/gtk.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(_WIN32) || defined(__MINGW32__)
+#include <windows.h>
+#endif
+#if defined(__has_include)
+# if __has_include(<json-glib/json-glib.h>)
+#  include <json-glib/json-glib.h>
+#  define HAVE_JSON_GLIB 1
+# endif
+#endif
+
+#define DATA_DIR "data"
+
+/* Compaction starts once this many tombstones exist and they make up
+ * at least COMPACT_MIN_RATIO of the log. */
+#define COMPACT_MIN_TOMBSTONES 32
+#define COMPACT_MIN_RATIO 0.25
+/* Lines handled per idle tick, so a single tick stays well under a frame. */
+#define COMPACT_CHUNK_LINES 256
+
+typedef struct _Compaction Compaction;
+
+/* One append-only log file and its bookkeeping */
+typedef struct {
+    const char *file_name;
+    /* Splits a line into its key; returns TRUE if the line is a tombstone.
+     * The line is modified in place and key points into it. */
+    gboolean (*parse_key)(char *line, char **key);
+    guint lines;        /* record + tombstone lines currently in the file */
+    guint tombstones;   /* tombstone lines currently in the file */
+    Compaction *compaction; /* non-NULL while a compaction is running */
+} IndexLog;
+
+typedef enum {
+    COMPACT_SCAN,   /* collect the last tombstone position of every key */
+    COMPACT_WRITE   /* copy surviving records into the temporary file */
+} CompactPhase;
+
+struct _Compaction {
+    IndexLog *log;
+    gchar *index_path;
+    gchar *tmp_path;
+    FILE *in;
+    FILE *out;
+    CompactPhase phase;
+    long end_offset;            /* log size when compaction started */
+    guint line_no;
+    GHashTable *last_tombstone; /* key -> line number + 1 of its last tombstone */
+    guint kept;
+};
+
+static gboolean parse_version_key(char *line, char **key);
+static gboolean parse_file_key(char *line, char **key);
+static gboolean parse_path_key(char *line, char **key);
+
+static IndexLog versions_log = { "versions_index.txt", parse_version_key, 0, 0, NULL };
+static IndexLog files_log = { "files_index.txt", parse_file_key, 0, 0, NULL };
+static IndexLog paths_log = { "paths_index.txt", parse_path_key, 0, 0, NULL };
+
+static gboolean initialized = FALSE;
+
+/* Interned strings (paths and stored names) live here for the whole session */
+static GStringChunk *strings = NULL;
+
+/* Path dictionary, replayed from paths_index.txt ("id|path", the last line
+ * for an id wins). A rename appends one line; version records keep their id. */
+static GPtrArray *id_paths = NULL;  /* file id -> interned path; slot 0 unused */
+static GHashTable *path_ids = NULL; /* interned path -> file id */
+
+/* In-memory catalog of live versions, built once from versions_index.txt and
+ * kept current by every append and tombstone. */
+typedef struct {
+    GArray *versions; /* VersionEntry, sorted oldest first */
+} CatalogFile;
+
+static GHashTable *catalog_files = NULL;    /* file id -> CatalogFile */
+static GHashTable *catalog_versions = NULL; /* interned stored name -> file id */
+
+/* Observers of catalog changes (VersionWatch), in registration order */
+typedef struct {
+    guint id;
+    VersionIndexWatchFunc func;
+    gpointer user_data;
+    gboolean dead;   /* unwatched during a dispatch; freed once it ends */
+} VersionWatch;
+
+static GSList *watches = NULL;
+static guint next_watch_id = 1;
+static guint dispatch_depth = 0;  /* notify_watches() calls in progress */
+
+/* Tracked files (the sidebar), in insertion order. files_lookup maps a file id to its link. */
+static GQueue files_order = G_QUEUE_INIT;
+static GHashTable *files_lookup = NULL;
+
+static void strip_newline(char *line) {
+    char *nl = strpbrk(line, "\r\n");
+    if (nl) *nl = '\0';
+}
+
+/* "@id|stored|timestamp" or "!|stored|timestamp" -> stored */
+static gboolean parse_version_key(char *line, char **key) {
+    *key = NULL;
+    char *p1 = strchr(line, '|');
+    if (!p1) return FALSE;
+    *p1 = '\0';
+    char *p2 = strchr(p1 + 1, '|');
+    if (p2) *p2 = '\0';
+    *key = p1 + 1;
+    return g_strcmp0(line, "!") == 0;
+}
+
+/* "@id" or "!@id" -> "@id" */
+static gboolean parse_file_key(char *line, char **key) {
+    if (line[0] == '!') {
+        *key = line + 1;
+        return TRUE;
+    }
+    *key = line;
+    return FALSE;
+}
+
+/* "id|path" -> id; the dictionary never has tombstones */
+static gboolean parse_path_key(char *line, char **key) {
+    char *p = strchr(line, '|');
+    if (p) *p = '\0';
+    *key = line;
+    return FALSE;
+}
+
+static gchar *log_path(IndexLog *log) {
+    return g_build_filename(DATA_DIR, log->file_name, NULL);
+}
+
+static gboolean log_append_line(IndexLog *log, const char *line, gboolean tombstone) {
+    g_mkdir_with_parents(DATA_DIR, 0755);
+    gchar *path = log_path(log);
+    FILE *f = fopen(path, "a");
+    g_free(path);
+    if (!f) {
+        g_printerr("version_index: cannot append to %s\n", log->file_name);
+        return FALSE;
+    }
+    fprintf(f, "%s\n", line);
+    fclose(f);
+    log->lines++;
+    if (tombstone) log->tombstones++;
+    return TRUE;
+}
+
+/* Replaces to with from in one step; to is never missing, even on Windows */
+static gboolean replace_file(const char *from, const char *to) {
+#if defined(_WIN32) || defined(__MINGW32__)
+    /* rename() does not replace an existing file on Windows */
+    gunichar2 *wfrom = g_utf8_to_utf16(from, -1, NULL, NULL, NULL);
+    gunichar2 *wto = g_utf8_to_utf16(to, -1, NULL, NULL, NULL);
+    gboolean ok = wfrom && wto &&
+                  MoveFileExW((LPCWSTR)wfrom, (LPCWSTR)wto, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+    g_free(wfrom);
+    g_free(wto);
+    return ok;
+#else
+    return g_rename(from, to) == 0;
+#endif
+}
+
+/* A compacted copy is only written next to the log. If the log is missing,
+ * a swap was interrupted and the copy is complete, so it is adopted; if the
+ * log is there, the copy is stale or partial. */
+static void log_recover(IndexLog *log) {
+    gchar *path = log_path(log);
+    gchar *tmp_path = g_strconcat(path, ".compact", NULL);
+    if (g_file_test(tmp_path, G_FILE_TEST_EXISTS)) {
+        if (g_file_test(path, G_FILE_TEST_EXISTS)) {
+            g_remove(tmp_path);
+        } else if (replace_file(tmp_path, path)) {
+            g_print("version_index: recovered %s from an interrupted compaction\n", log->file_name);
+        } else {
+            g_printerr("version_index: cannot recover %s from %s\n", log->file_name, tmp_path);
+        }
+    }
+    g_free(tmp_path);
+    g_free(path);
+}
+
+/* Atomically replaces a log with contents holding no tombstones */
+static void log_write_snapshot(IndexLog *log, GString *contents, guint lines) {
+    gchar *path = log_path(log);
+    GError *error = NULL;
+    if (g_file_set_contents(path, contents->str, contents->len, &error)) {
+        log->lines = lines;
+        log->tombstones = 0;
+    } else {
+        g_printerr("version_index: cannot rewrite %s: %s\n", log->file_name, error ? error->message : "unknown");
+        g_clear_error(&error);
+    }
+    g_free(path);
+}
+
+// ---
+// --- Path dictionary
+// ---
+
+static void dictionary_set(guint32 id, const char *path) {
+    if (id >= id_paths->len) g_ptr_array_set_size(id_paths, id + 1);
+    const char *old = g_ptr_array_index(id_paths, id);
+    if (old && GPOINTER_TO_UINT(g_hash_table_lookup(path_ids, old)) == id) {
+        g_hash_table_remove(path_ids, old);
+    }
+    const char *interned = g_string_chunk_insert_const(strings, path);
+    g_ptr_array_index(id_paths, id) = (gpointer)interned;
+    g_hash_table_insert(path_ids, (gpointer)interned, GUINT_TO_POINTER(id));
+}
+
+static void load_paths_index(void) {
+    strings = g_string_chunk_new(4096);
+    id_paths = g_ptr_array_new();
+    g_ptr_array_add(id_paths, NULL); /* ids start at 1 so 0 can mean "unknown" */
+    path_ids = g_hash_table_new(g_str_hash, g_str_equal);
+    paths_log.lines = 0;
+    gchar *path = log_path(&paths_log);
+    FILE *f = fopen(path, "r");
+    g_free(path);
+    if (!f) return;
+    char line[4096];
+    while (fgets(line, sizeof(line), f)) {
+        strip_newline(line);
+        char *sep = strchr(line, '|');
+        if (!sep) continue;
+        *sep = '\0';
+        guint32 id = (guint32)strtoul(line, NULL, 10);
+        if (id == 0) continue;
+        paths_log.lines++;
+        dictionary_set(id, sep + 1);
+    }
+    fclose(f);
+}
+
+guint32 version_index_lookup_path(const char *path) {
+    if (!path) return 0;
+    version_index_init();
+    return GPOINTER_TO_UINT(g_hash_table_lookup(path_ids, path));
+}
+
+guint32 version_index_intern_path(const char *path) {
+    if (!path) return 0;
+    version_index_init();
+    guint32 id = GPOINTER_TO_UINT(g_hash_table_lookup(path_ids, path));
+    if (id != 0) return id;
+    id = id_paths->len;
+    gchar *line = g_strdup_printf("%u|%s", id, path);
+    gboolean ok = log_append_line(&paths_log, line, FALSE);
+    g_free(line);
+    if (!ok) return 0;
+    dictionary_set(id, path);
+    return id;
+}
+
+const char *version_index_path_for_id(guint32 id) {
+    version_index_init();
+    if (id == 0 || id >= id_paths->len) return NULL;
+    return g_ptr_array_index(id_paths, id);
+}
+
+gboolean version_index_rename_path(const char *old_path, const char *new_path) {
+    if (!old_path || !new_path) return FALSE;
+    version_index_init();
+    guint32 id = GPOINTER_TO_UINT(g_hash_table_lookup(path_ids, old_path));
+    if (id == 0) return FALSE;
+    /* Two ids for one path would split its history; the caller must not rename onto it */
+    if (g_hash_table_contains(path_ids, new_path)) {
+        g_printerr("version_index: '%s' already has a history; not renaming '%s' onto it\n", new_path, old_path);
+        return FALSE;
+    }
+    gchar *line = g_strdup_printf("%u|%s", id, new_path);
+    gboolean ok = log_append_line(&paths_log, line, FALSE);
+    g_free(line);
+    if (ok) dictionary_set(id, new_path);
+    return ok;
+}
+
+// ---
+// --- Version catalog
+// ---
+
+static void notify_watches(VersionIndexChange change, const VersionEntry *entry, guint position) {
+    /* Callbacks may unwatch any watch, so nodes are only marked dead here and reaped afterwards */
+    dispatch_depth++;
+    for (GSList *l = watches; l != NULL; l = l->next) {
+        VersionWatch *w = l->data;
+        if (!w->dead) w->func(change, entry, position, w->user_data);
+    }
+    if (--dispatch_depth > 0) return;
+    for (GSList *l = watches; l != NULL; ) {
+        GSList *next = l->next;
+        VersionWatch *w = l->data;
+        if (w->dead) {
+            watches = g_slist_delete_link(watches, l);
+            g_free(w);
+        }
+        l = next;
+    }
+}
+
+/* Sorted insert; versions are nearly always recorded newest-last so this is usually an append.
+ * Returns the position the entry was inserted at. */
+static guint catalog_add(guint32 file_id, const char *stored_name, const char *timestamp,
+                         guint64 digest, const VersionStats *stats) {
+    CatalogFile *file = g_hash_table_lookup(catalog_files, GUINT_TO_POINTER(file_id));
+    if (!file) {
+        file = g_new0(CatalogFile, 1);
+        file->versions = g_array_new(FALSE, TRUE, sizeof(VersionEntry));
+        g_hash_table_insert(catalog_files, GUINT_TO_POINTER(file_id), file);
+    }
+
+    VersionEntry v;
+    memset(&v, 0, sizeof(v));
+    v.file_id = file_id;
+    v.stored_name = g_string_chunk_insert_const(strings, stored_name);
+    g_strlcpy(v.timestamp, timestamp, sizeof(v.timestamp));
+    v.digest = digest;
+    if (stats) {
+        v.stats = *stats;
+        v.has_stats = TRUE;
+    }
+
+    guint pos = file->versions->len;
+    while (pos > 0) {
+        const VersionEntry *prev = &g_array_index(file->versions, VersionEntry, pos - 1);
+        if (strcmp(prev->timestamp, v.timestamp) <= 0) break;
+        pos--;
+    }
+    g_array_insert_val(file->versions, pos, v);
+    g_hash_table_insert(catalog_versions, (gpointer)v.stored_name, GUINT_TO_POINTER(file_id));
+    return pos;
+}
+
+/* Returns the position the entry held, or -1 if the name was not live.
+ * The removed entry is copied to *removed when given. */
+static gint catalog_remove(const char *stored_name, VersionEntry *removed) {
+    gpointer key, value;
+    if (!g_hash_table_lookup_extended(catalog_versions, stored_name, &key, &value)) return -1;
+    g_hash_table_remove(catalog_versions, stored_name);
+    CatalogFile *file = g_hash_table_lookup(catalog_files, value);
+    if (!file) return -1;
+    /* Stored names are interned, so a pointer compare finds the entry */
+    for (guint i = file->versions->len; i > 0; --i) {
+        if (g_array_index(file->versions, VersionEntry, i - 1).stored_name == key) {
+            if (removed) *removed = g_array_index(file->versions, VersionEntry, i - 1);
+            g_array_remove_index(file->versions, i - 1);
+            return (gint)(i - 1);
+        }
+    }
+    return -1;
+}
+
+/* Replays versions_index.txt once into the catalog, counting tombstones as it goes.
+ * Returns TRUE if the log still holds records keyed by full path (pre-dictionary format). */
+static gboolean load_versions_index(void) {
+    catalog_files = g_hash_table_new(g_direct_hash, g_direct_equal);
+    catalog_versions = g_hash_table_new(g_str_hash, g_str_equal);
+    versions_log.lines = 0;
+    versions_log.tombstones = 0;
+    gboolean legacy = FALSE;
+    log_recover(&versions_log);
+    gchar *path = log_path(&versions_log);
+    FILE *f = fopen(path, "r");
+    g_free(path);
+    if (!f) return FALSE;
+    char line[4096];
+    while (fgets(line, sizeof(line), f)) {
+        strip_newline(line);
+        if (line[0] == '\0') continue;
+        versions_log.lines++;
+        char *p1 = strchr(line, '|');
+        if (!p1) continue;
+        *p1 = '\0';
+        char *p2 = strchr(p1 + 1, '|');
+        if (!p2) continue;
+        *p2 = '\0';
+        const char *owner = line;
+        const char *stored = p1 + 1;
+        const char *ts = p2 + 1;
+        guint64 digest = 0;
+        VersionStats stats;
+        gboolean has_stats = FALSE;
+        char *p3 = strchr(p2 + 1, '|');
+        if (p3) {
+            *p3 = '\0';
+            digest = g_ascii_strtoull(p3 + 1, NULL, 16);
+            char *p4 = strchr(p3 + 1, '|');
+            if (p4) has_stats = sscanf(p4 + 1, "%u:%u:%u", &stats.added, &stats.removed, &stats.changed) == 3;
+        }
+        if (g_strcmp0(owner, "!") == 0) {
+            versions_log.tombstones++;
+            catalog_remove(stored, NULL);
+        } else if (owner[0] == '@') {
+            catalog_add((guint32)strtoul(owner + 1, NULL, 10), stored, ts, digest, has_stats ? &stats : NULL);
+        } else {
+            legacy = TRUE;
+            catalog_add(version_index_intern_path(owner), stored, ts, digest, has_stats ? &stats : NULL);
+        }
+    }
+    fclose(f);
+    return legacy;
+}
+
+static void files_lookup_add(guint32 id) {
+    g_queue_push_tail(&files_order, GUINT_TO_POINTER(id));
+    g_hash_table_insert(files_lookup, GUINT_TO_POINTER(id), g_queue_peek_tail_link(&files_order));
+}
+
+static void files_lookup_remove(guint32 id) {
+    GList *link = g_hash_table_lookup(files_lookup, GUINT_TO_POINTER(id));
+    if (!link) return;
+    g_hash_table_remove(files_lookup, GUINT_TO_POINTER(id));
+    g_queue_delete_link(&files_order, link);
+}
+
+/* "@id" -> id; a bare path (pre-dictionary format) is interned */
+static guint32 file_key_to_id(const char *key, gboolean *legacy) {
+    if (key[0] == '@') return (guint32)strtoul(key + 1, NULL, 10);
+    *legacy = TRUE;
+    return version_index_intern_path(key);
+}
+
+/* Replays files_index.txt into the in-memory set of tracked files.
+ * Returns TRUE if it still holds full paths instead of file ids. */
+static gboolean load_files_index(void) {
+    files_lookup = g_hash_table_new(g_direct_hash, g_direct_equal);
+    files_log.lines = 0;
+    files_log.tombstones = 0;
+    gboolean legacy = FALSE;
+    log_recover(&files_log);
+    gchar *path = log_path(&files_log);
+    FILE *f = fopen(path, "r");
+    g_free(path);
+    if (!f) return FALSE;
+    char buf[4096];
+    while (fgets(buf, sizeof(buf), f)) {
+        strip_newline(buf);
+        if (buf[0] == '\0') continue;
+        char *key;
+        files_log.lines++;
+        gboolean tombstone = parse_file_key(buf, &key);
+        guint32 id = file_key_to_id(key, &legacy);
+        if (id == 0) continue;
+        if (tombstone) {
+            files_log.tombstones++;
+            files_lookup_remove(id);
+        } else if (!g_hash_table_contains(files_lookup, GUINT_TO_POINTER(id))) {
+            files_lookup_add(id);
+        }
+    }
+    fclose(f);
+    return legacy;
+}
+
+/* "@id|stored|timestamp[|digest[|added:removed:changed]]", without the newline */
+static void append_version_record(GString *out, guint32 id, const char *stored_name, const char *timestamp,
+                                  guint64 digest, const VersionStats *stats) {
+    g_string_append_printf(out, "@%u|%s|%s", id, stored_name, timestamp ? timestamp : "");
+    if (digest || stats) g_string_append_printf(out, "|%016" G_GINT64_MODIFIER "x", digest);
+    if (stats) g_string_append_printf(out, "|%u:%u:%u", stats->added, stats->removed, stats->changed);
+}
+
+/* One-time upgrade of path-keyed logs to id-keyed records */
+static void migrate_versions_log(void) {
+    GString *out = g_string_new("");
+    guint lines = 0;
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, catalog_files);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        GArray *versions = ((CatalogFile *)value)->versions;
+        for (guint i = 0; i < versions->len; ++i) {
+            const VersionEntry *v = &g_array_index(versions, VersionEntry, i);
+            append_version_record(out, v->file_id, v->stored_name, v->timestamp, v->digest,
+                                  v->has_stats ? &v->stats : NULL);
+            g_string_append_c(out, '\n');
+            lines++;
+        }
+    }
+    log_write_snapshot(&versions_log, out, lines);
+    g_string_free(out, TRUE);
+}
+
+static void migrate_files_log(void) {
+    GString *out = g_string_new("");
+    for (GList *l = files_order.head; l != NULL; l = l->next) {
+        g_string_append_printf(out, "@%u\n", GPOINTER_TO_UINT(l->data));
+    }
+    log_write_snapshot(&files_log, out, files_order.length);
+    g_string_free(out, TRUE);
+}
+
+#ifdef HAVE_JSON_GLIB
+/* Older builds kept versions in a JSON array that had to be rewritten on
+ * every change. Fold it into the text log once and move it aside. */
+static void import_legacy_json_index(void) {
+    gchar *json_path = g_build_filename(DATA_DIR, "versions_index.json", NULL);
+    if (!g_file_test(json_path, G_FILE_TEST_EXISTS)) { g_free(json_path); return; }
+
+    GError *error = NULL;
+    JsonParser *parser = json_parser_new();
+    if (!json_parser_load_from_file(parser, json_path, &error)) {
+        g_printerr("version_index: failed to parse %s: %s\n", json_path, error ? error->message : "unknown");
+        g_clear_error(&error);
+        g_object_unref(parser);
+        g_free(json_path);
+        return;
+    }
+    JsonNode *root = json_parser_get_root(parser);
+    if (JSON_NODE_HOLDS_ARRAY(root)) {
+        JsonArray *arr = json_node_get_array(root);
+        guint len = json_array_get_length(arr);
+        for (guint i = 0; i < len; ++i) {
+            JsonNode *elem = json_array_get_element(arr, i);
+            if (!JSON_NODE_HOLDS_OBJECT(elem)) continue;
+            JsonObject *obj = json_node_get_object(elem);
+            const char *orig = json_object_get_string_member(obj, "original");
+            const char *stored = json_object_get_string_member(obj, "stored");
+            const char *ts = json_object_get_string_member(obj, "timestamp");
+            if (orig && stored) version_index_append(orig, stored, ts ? ts : "", 0, NULL);
+        }
+    }
+    g_object_unref(parser);
+
+    gchar *moved = g_strconcat(json_path, ".imported", NULL);
+    if (g_rename(json_path, moved) != 0) {
+        g_printerr("version_index: could not move %s aside\n", json_path);
+    }
+    g_free(moved);
+    g_free(json_path);
+}
+#endif
+
+void version_index_init(void) {
+    if (initialized) return;
+    initialized = TRUE;
+
+    load_paths_index();
+    if (load_versions_index()) migrate_versions_log();
+    if (load_files_index()) migrate_files_log();
+#ifdef HAVE_JSON_GLIB
+    import_legacy_json_index();
+#endif
+    version_index_maybe_compact();
+}
+
+gboolean version_index_append(const char *original_path, const char *stored_name, const char *timestamp,
+                              guint64 digest, const VersionStats *stats) {
+    if (!original_path || !stored_name) return FALSE;
+    guint32 id = version_index_intern_path(original_path);
+    if (id == 0) return FALSE;
+    GString *line = g_string_new(NULL);
+    append_version_record(line, id, stored_name, timestamp, digest, stats);
+    gboolean ok = log_append_line(&versions_log, line->str, FALSE);
+    g_string_free(line, TRUE);
+    if (ok) {
+        guint pos = catalog_add(id, stored_name, timestamp ? timestamp : "", digest, stats);
+        if (watches) {
+            CatalogFile *file = g_hash_table_lookup(catalog_files, GUINT_TO_POINTER(id));
+            notify_watches(VERSION_INDEX_ADDED, &g_array_index(file->versions, VersionEntry, pos), pos);
+        }
+    }
+    return ok;
+}
+
+gboolean version_index_remove(const char *stored_name) {
+    if (!stored_name) return FALSE;
+    return version_index_remove_batch(&stored_name, 1);
+}
+
+gboolean version_index_remove_batch(const char * const *stored_names, guint n) {
+    if (!stored_names || n == 0) return FALSE;
+    version_index_init();
+    GDateTime *now = g_date_time_new_now_local();
+    gchar *ts = g_date_time_format(now, "%Y%m%d%H%M%S");
+    g_date_time_unref(now);
+
+    /* One open/write for the whole batch */
+    GString *lines = g_string_new("");
+    guint count = 0;
+    for (guint i = 0; i < n; ++i) {
+        if (!stored_names[i]) continue;
+        g_string_append_printf(lines, "!|%s|%s\n", stored_names[i], ts ? ts : "");
+        count++;
+    }
+    gboolean ok = FALSE;
+    if (count > 0) {
+        g_string_truncate(lines, lines->len - 1);
+        ok = log_append_line(&versions_log, lines->str, FALSE);
+        if (ok) {
+            versions_log.lines += count - 1;
+            versions_log.tombstones += count;
+        }
+    }
+    /* The catalog only changes once the tombstones are on disk */
+    for (guint i = 0; ok && i < n; ++i) {
+        if (!stored_names[i]) continue;
+        VersionEntry removed;
+        gint pos = catalog_remove(stored_names[i], &removed);
+        if (pos >= 0) notify_watches(VERSION_INDEX_REMOVED, &removed, (guint)pos);
+    }
+    g_string_free(lines, TRUE);
+    g_free(ts);
+    version_index_maybe_compact();
+    return ok;
+}
+
+guint version_index_watch(VersionIndexWatchFunc func, gpointer user_data) {
+    if (!func) return 0;
+    VersionWatch *w = g_new0(VersionWatch, 1);
+    w->id = next_watch_id++;
+    w->func = func;
+    w->user_data = user_data;
+    watches = g_slist_append(watches, w);
+    return w->id;
+}
+
+void version_index_unwatch(guint watch_id) {
+    for (GSList *l = watches; l != NULL; l = l->next) {
+        VersionWatch *w = l->data;
+        if (w->id == watch_id) {
+            if (dispatch_depth > 0) {
+                w->dead = TRUE;
+            } else {
+                watches = g_slist_delete_link(watches, l);
+                g_free(w);
+            }
+            return;
+        }
+    }
+}
+
+gboolean version_index_lookup_stored(const char *stored_name, VersionEntry *entry) {
+    version_index_init();
+    gpointer key, value;
+    if (!stored_name || !g_hash_table_lookup_extended(catalog_versions, stored_name, &key, &value)) return FALSE;
+    if (!entry) return TRUE;
+    CatalogFile *file = g_hash_table_lookup(catalog_files, value);
+    if (!file) return FALSE;
+    for (guint i = file->versions->len; i > 0; --i) {
+        const VersionEntry *v = &g_array_index(file->versions, VersionEntry, i - 1);
+        if (v->stored_name == key) {
+            *entry = *v;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+GArray *version_index_get_versions_by_id(guint32 file_id) {
+    version_index_init();
+    CatalogFile *file = g_hash_table_lookup(catalog_files, GUINT_TO_POINTER(file_id));
+    return file ? file->versions : NULL;
+}
+
+GArray *version_index_get_versions(const char *original_path) {
+    guint32 id = version_index_lookup_path(original_path);
+    return id ? version_index_get_versions_by_id(id) : NULL;
+}
+
+guint version_index_lower_bound(GArray *versions, const char *timestamp) {
+    guint lo = 0, hi = versions->len;
+    while (lo < hi) {
+        guint mid = lo + (hi - lo) / 2;
+        if (strcmp(g_array_index(versions, VersionEntry, mid).timestamp, timestamp) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+gboolean version_index_version_at(guint32 file_id, const char *timestamp, VersionEntry *entry) {
+    GArray *versions = version_index_get_versions_by_id(file_id);
+    if (!versions) return FALSE;
+    /* One past the last version recorded at or before timestamp */
+    guint lo = 0, hi = versions->len;
+    while (lo < hi) {
+        guint mid = lo + (hi - lo) / 2;
+        if (strcmp(g_array_index(versions, VersionEntry, mid).timestamp, timestamp) <= 0) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == 0) return FALSE;
+    *entry = g_array_index(versions, VersionEntry, lo - 1);
+    return TRUE;
+}
+
+void version_index_foreach_for_path(const char *original_path, VersionIndexFunc func, gpointer user_data) {
+    if (!original_path || !func) return;
+    GArray *versions = version_index_get_versions(original_path);
+    if (!versions) return;
+    for (guint i = 0; i < versions->len; ++i) {
+        const VersionEntry *v = &g_array_index(versions, VersionEntry, i);
+        func(original_path, v->stored_name, v->timestamp, user_data);
+    }
+}
+
+void version_index_foreach(VersionIndexFunc func, gpointer user_data) {
+    if (!func) return;
+    version_index_init();
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, catalog_files);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        const char *path = version_index_path_for_id(GPOINTER_TO_UINT(key));
+        GArray *versions = ((CatalogFile *)value)->versions;
+        for (guint i = 0; i < versions->len; ++i) {
+            const VersionEntry *v = &g_array_index(versions, VersionEntry, i);
+            func(path, v->stored_name, v->timestamp, user_data);
+        }
+    }
+}
+
+gboolean files_index_add(const char *path) {
+    guint32 id = version_index_intern_path(path);
+    if (id == 0) return FALSE;
+    if (g_hash_table_contains(files_lookup, GUINT_TO_POINTER(id))) return FALSE;
+    gchar *line = g_strdup_printf("@%u", id);
+    gboolean ok = log_append_line(&files_log, line, FALSE);
+    g_free(line);
+    if (ok) files_lookup_add(id);
+    return ok;
+}
+
+gboolean files_index_remove(const char *path) {
+    guint32 id = version_index_lookup_path(path);
+    if (id == 0 || !g_hash_table_contains(files_lookup, GUINT_TO_POINTER(id))) return FALSE;
+    gchar *line = g_strdup_printf("!@%u", id);
+    gboolean ok = log_append_line(&files_log, line, TRUE);
+    g_free(line);
+    if (ok) files_lookup_remove(id);
+    version_index_maybe_compact();
+    return ok;
+}
+
+void files_index_foreach(FilesIndexFunc func, gpointer user_data) {
+    if (!func) return;
+    version_index_init();
+    for (GList *l = files_order.head; l != NULL; l = l->next) {
+        const char *path = version_index_path_for_id(GPOINTER_TO_UINT(l->data));
+        if (path) func(path, user_data);
+    }
+}
+
+// ---
+// --- Incremental compaction
+// ---
+
+static void compaction_free(Compaction *c) {
+    if (c->in) fclose(c->in);
+    if (c->out) fclose(c->out);
+    if (c->tmp_path) g_remove(c->tmp_path);
+    if (c->last_tombstone) g_hash_table_destroy(c->last_tombstone);
+    c->log->compaction = NULL;
+    g_free(c->index_path);
+    g_free(c->tmp_path);
+    g_free(c);
+}
+
+/* Copies everything appended since compaction started, then swaps the files in */
+static gboolean compaction_finish(Compaction *c) {
+    guint lines = c->kept;
+    guint tombstones = 0;
+    char buf[4096];
+
+    if (fseek(c->in, c->end_offset, SEEK_SET) != 0) return FALSE;
+    while (fgets(buf, sizeof(buf), c->in)) {
+        fputs(buf, c->out);
+        strip_newline(buf);
+        if (buf[0] == '\0') continue;
+        char *key;
+        lines++;
+        if (c->log->parse_key(buf, &key)) tombstones++;
+    }
+    fclose(c->in);
+    c->in = NULL;
+    if (fclose(c->out) != 0) { c->out = NULL; return FALSE; }
+    c->out = NULL;
+
+    /* The copy is complete from here on: compaction_free() must not delete
+     * it, whether the swap works or not (log_recover() sorts it out) */
+    gboolean swapped = replace_file(c->tmp_path, c->index_path);
+    g_free(c->tmp_path);
+    c->tmp_path = NULL;
+    if (!swapped) return FALSE;
+
+    g_print("version_index: compacted %s (%u -> %u lines)\n", c->log->file_name, c->log->lines, lines);
+    c->log->lines = lines;
+    c->log->tombstones = tombstones;
+    return TRUE;
+}
+
+/* Handles up to COMPACT_CHUNK_LINES lines per call so the UI never waits on it */
+static gboolean compaction_step(gpointer user_data) {
+    Compaction *c = user_data;
+    char buf[4096];
+
+    for (guint n = 0; n < COMPACT_CHUNK_LINES; ++n) {
+        if (ftell(c->in) >= c->end_offset || !fgets(buf, sizeof(buf), c->in)) {
+            if (c->phase == COMPACT_SCAN) {
+                /* Second pass over the same range, now knowing every tombstone */
+                c->phase = COMPACT_WRITE;
+                c->line_no = 0;
+                rewind(c->in);
+                return G_SOURCE_CONTINUE;
+            }
+            if (!compaction_finish(c)) {
+                g_printerr("version_index: compaction of %s failed\n", c->log->file_name);
+            }
+            compaction_free(c);
+            return G_SOURCE_REMOVE;
+        }
+
+        guint line_no = ++c->line_no;
+        gchar *copy = g_strdup(buf);
+        strip_newline(copy);
+        if (copy[0] == '\0') { g_free(copy); continue; }
+        char *key;
+        gboolean tombstone = c->log->parse_key(copy, &key);
+
+        if (c->phase == COMPACT_SCAN) {
+            if (tombstone) {
+                g_hash_table_insert(c->last_tombstone, g_strdup(key), GUINT_TO_POINTER(line_no));
+            }
+        } else if (!tombstone) {
+            /* A record survives unless a tombstone for its key follows it */
+            guint dead_until = GPOINTER_TO_UINT(g_hash_table_lookup(c->last_tombstone, key));
+            if (dead_until < line_no) {
+                fputs(buf, c->out);
+                c->kept++;
+            }
+        }
+        g_free(copy);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static void log_maybe_compact(IndexLog *log) {
+    if (log->compaction) return;
+    if (log->tombstones < COMPACT_MIN_TOMBSTONES) return;
+    if (log->tombstones < log->lines * COMPACT_MIN_RATIO) return;
+
+    Compaction *c = g_new0(Compaction, 1);
+    c->log = log;
+    c->index_path = log_path(log);
+    c->tmp_path = g_strconcat(c->index_path, ".compact", NULL);
+    /* Binary mode keeps ftell() offsets exact and line endings untouched */
+    c->in = fopen(c->index_path, "rb");
+    c->out = fopen(c->tmp_path, "wb");
+    c->last_tombstone = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    c->phase = COMPACT_SCAN;
+    log->compaction = c;
+    if (!c->in || !c->out || fseek(c->in, 0, SEEK_END) != 0) {
+        g_printerr("version_index: cannot start compaction of %s\n", log->file_name);
+        compaction_free(c);
+        return;
+    }
+    c->end_offset = ftell(c->in);
+    rewind(c->in);
+
+    g_idle_add_full(G_PRIORITY_LOW, compaction_step, c, NULL);
+}
+
+void version_index_maybe_compact(void) {
+    log_maybe_compact(&versions_log);
+    log_maybe_compact(&files_log);
+}